@@ -31,8 +31,12 @@ namespace managers {
     virtual ~RobotisOp2MotionTimerManager();
     static void MotionTimerInit();
 
+    // the running timer, e.g. to query its tick statistics (NULL before MotionTimerInit)
+    static LinuxMotionTimer *getMotionTimer() { return mMotionTimer; }
+
   private:
     static bool mStarted;
+    static LinuxMotionTimer *mMotionTimer;
   };
 }  // namespace managers
 
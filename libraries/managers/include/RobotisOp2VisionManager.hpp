@@ -37,7 +37,11 @@ namespace managers {
     virtual ~RobotisOp2VisionManager();
 
     bool getBallCenter(double &x, double &y, const unsigned char *image);
+    // The mask of isDetected is made by getBallCenter while the image is valid, once enabled here
+    // or by a first call to isDetected: that call makes it from the image last given to
+    // getBallCenter, which must not have changed since.
     bool isDetected(int x, int y);
+    void setDetectionMask(bool enabled) { mIsMaskEnabled = enabled; }
     void setHue(int hue) { mFinder->m_hue = hue; }
     void setHueTolerance(int hueTolerance) { mFinder->m_hue_tolerance = hueTolerance; }
     void setMinSaturation(int minSaturation) { mFinder->m_min_saturation = minSaturation; }
@@ -46,8 +50,12 @@ namespace managers {
     void setmaxPercent(int maxPercent) { mFinder->m_max_percent = maxPercent; }
 
   private:
+    void makeMask();
+
     ColorFinder *mFinder;
     FrameBuffer *mBuffer;
+    bool mIsResultValid;
+    bool mIsMaskEnabled;
   };
 }  // namespace managers
 
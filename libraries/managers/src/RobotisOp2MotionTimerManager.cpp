@@ -29,8 +29,10 @@ RobotisOp2MotionTimerManager::RobotisOp2MotionTimerManager() {
 
 void RobotisOp2MotionTimerManager::MotionTimerInit() {
   if (!mStarted) {
-    LinuxMotionTimer *motion_timer = new LinuxMotionTimer(MotionManager::GetInstance());
-    motion_timer->Start();
+    // let the CM730 I/O thread carry the bus traffic so that the timer only computes
+    MotionManager::GetInstance()->SetPipelineEnable(true);
+    mMotionTimer = new LinuxMotionTimer(MotionManager::GetInstance());
+    mMotionTimer->Start();
     mStarted = true;
   }
 }
@@ -39,3 +41,4 @@ RobotisOp2MotionTimerManager::~RobotisOp2MotionTimerManager() {
 }
 
 bool RobotisOp2MotionTimerManager::mStarted = false;
+LinuxMotionTimer *RobotisOp2MotionTimerManager::mMotionTimer = NULL;
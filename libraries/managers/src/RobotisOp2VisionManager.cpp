@@ -22,6 +22,8 @@ RobotisOp2VisionManager::RobotisOp2VisionManager(int width, int height, int hue,
                                                  int minValue, int minPercent, int maxPercent) {
   mFinder = new ColorFinder(hue, hueTolerance, minSaturation, minValue, minPercent, maxPercent);
   mBuffer = new FrameBuffer(width, height);
+  mIsResultValid = false;
+  mIsMaskEnabled = false;
 }
 
 RobotisOp2VisionManager::~RobotisOp2VisionManager() {
@@ -34,10 +36,12 @@ bool RobotisOp2VisionManager::getBallCenter(double &x, double &y, const unsigned
 
   // Put the image in mBuffer
   mBuffer->m_BGRAFrame->m_ImageData = (unsigned char *)image;
-  // Convert the image from BGRA format to HSV format
-  ImgProcess::BGRAtoHSV(mBuffer);
-  // Extract position of the ball from HSV verson of the image
-  pos = mFinder->GetPosition(mBuffer->m_HSVFrame);
+  // Extract position of the ball in a single pass over the image,
+  // the HSV version of the image and the mask are only made for isDetected
+  pos = mFinder->GetPositionBGRA(mBuffer->m_BGRAFrame);
+  mIsResultValid = false;
+  if (mIsMaskEnabled)
+    makeMask();
 
   if (pos.X == -1 && pos.Y == -1) {
     x = 0.0;
@@ -51,6 +55,11 @@ bool RobotisOp2VisionManager::getBallCenter(double &x, double &y, const unsigned
 }
 
 bool RobotisOp2VisionManager::isDetected(int x, int y) {
+  // the mask of the next images is made by getBallCenter
+  mIsMaskEnabled = true;
+  if (!mIsResultValid)
+    makeMask();
+
   if (x > mFinder->m_result->m_Width || y > mFinder->m_result->m_Height)
     return false;
 
@@ -61,3 +70,9 @@ bool RobotisOp2VisionManager::isDetected(int x, int y) {
   else
     return false;
 }
+
+void RobotisOp2VisionManager::makeMask() {
+  ImgProcess::BGRAtoHSV(mBuffer);
+  mFinder->GetPosition(mBuffer->m_HSVFrame);
+  mIsResultValid = true;
+}
@@ -0,0 +1,207 @@
+/*
+ *   ActionCompileCheck.cpp
+ *   Every page of a motion file played from its compiled chain must give the same joints,
+ *   tick by tick, as the interpreter. Also when the chain is stopped, when another page is
+ *   queued or preempts it, and when the pose changes between Start() and the first tick.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "Action.h"
+#include "MotionStatus.h"
+
+using namespace Robot;
+
+
+static const int STOP_TICKS = 3000;		// a looping page is stopped after that
+static const int MAX_TICKS = 6000;		// and braked after that
+static const double BLEND_TIME = 100;	// msec, of the preempting pages
+
+enum
+{
+    PLAY,			// until the chain ends
+    STOP,			// Stop() early, the exit links are followed
+    QUEUE,			// Queue() another page early
+    MOVED_POSE,		// the pose changes between Start() and the first tick
+    PREEMPT,		// Preempt() another page early
+    PREEMPT_QUEUED,	// Queue() a page and Preempt() another one as the chain ends, both play
+    NUMBER_OF_SCENARIOS
+};
+static const char *SCENARIO_NAME[NUMBER_OF_SCENARIOS] = { "play", "stop", "queue", "moved pose", "preempt", "preempt queued" };
+
+static void SetPose(int seed)
+{
+    for(int id = JointData::ID_R_SHOULDER_PITCH; id < JointData::NUMBER_OF_JOINTS; id++)
+        MotionStatus::m_CurrentJoints.SetValue(id, 2048 + ((seed * 37 + id * 101) % 401) - 200);
+}
+
+// the next page of the file after page, with something to play
+static int NextPage(Action *action, int page)
+{
+    do
+        page = page % (Action::MAXNUM_PAGE - 1) + 1;
+    while(action->GetPage(page)->header.stepnum == 0 || action->GetPage(page)->header.repeat == 0);
+
+    return page;
+}
+
+static bool Compare(Action *compiled, Action *interpreted, int page, int scenario, int tick)
+{
+    int compiled_page, compiled_step, interpreted_page, interpreted_step;
+    bool compiled_running = compiled->IsRunning(&compiled_page, &compiled_step);
+    bool interpreted_running = interpreted->IsRunning(&interpreted_page, &interpreted_step);
+
+    if(compiled_running != interpreted_running || compiled_page != interpreted_page || compiled_step != interpreted_step)
+    {
+        fprintf(stderr, "page %d (%s) tick %d: compiled at page %d step %d (%d), interpreted at page %d step %d (%d)\n",
+                page, SCENARIO_NAME[scenario], tick, compiled_page, compiled_step, compiled_running,
+                interpreted_page, interpreted_step, interpreted_running);
+        return false;
+    }
+
+    for(int id = JointData::ID_R_SHOULDER_PITCH; id < JointData::NUMBER_OF_JOINTS; id++)
+    {
+        if(compiled->m_Joint.GetValue(id) != interpreted->m_Joint.GetValue(id)
+            || compiled->m_Joint.GetPGain(id) != interpreted->m_Joint.GetPGain(id))
+        {
+            fprintf(stderr, "page %d (%s) tick %d: joint %d is %d (P %d) compiled, %d (P %d) interpreted\n",
+                    page, SCENARIO_NAME[scenario], tick, id,
+                    compiled->m_Joint.GetValue(id), compiled->m_Joint.GetPGain(id),
+                    interpreted->m_Joint.GetValue(id), interpreted->m_Joint.GetPGain(id));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Returns the number of ticks followed by a compiled one, -1 if the two differ.
+// length is the number of ticks of the page played alone, set by the PLAY scenario
+static int Play(Action *compiled, Action *interpreted, int page, int scenario, int *length)
+{
+    SetPose(page);
+    compiled->Initialize();
+    interpreted->Initialize();
+    if(compiled->Start(page) == false || interpreted->Start(page) == false)
+    {
+        fprintf(stderr, "page %d: can not start\n", page);
+        return -1;
+    }
+
+    if(scenario == MOVED_POSE)
+        SetPose(page + 1);
+
+    int early = 20 + page % 50;
+    int ending = *length - 2;
+    int queued = 0;
+    bool queued_played = false;
+    int compiled_ticks = 0;
+    int tick;
+    for(tick = 0; compiled->IsRunning() == true || interpreted->IsRunning() == true; tick++)
+    {
+        if(tick == early && scenario == STOP)
+        {
+            compiled->Stop();
+            interpreted->Stop();
+        }
+        else if(tick == early && scenario == QUEUE)
+        {
+            compiled->Queue(NextPage(compiled, page));
+            interpreted->Queue(NextPage(interpreted, page));
+        }
+        else if(tick == early && scenario == PREEMPT)
+        {
+            compiled->Preempt(NextPage(compiled, page));
+            interpreted->Preempt(NextPage(interpreted, page));
+        }
+        else if(tick == ending && scenario == PREEMPT_QUEUED)
+        {
+            queued = NextPage(compiled, NextPage(compiled, page));
+            compiled->Queue(queued);
+            interpreted->Queue(queued);
+            compiled->Preempt(NextPage(compiled, page));
+            interpreted->Preempt(NextPage(interpreted, page));
+        }
+        else if(tick == STOP_TICKS)
+        {
+            compiled->Stop();
+            interpreted->Stop();
+        }
+        else if(tick == MAX_TICKS)
+        {
+            compiled->Brake();
+            interpreted->Brake();
+        }
+
+        compiled->Process();
+        interpreted->Process();
+        if(Compare(compiled, interpreted, page, scenario, tick) == false)
+            return -1;
+
+        if(compiled->IsCompiled() == true)
+            compiled_ticks++;
+
+        int playing_page, playing_step;
+        if(queued != 0 && compiled->IsRunning(&playing_page, &playing_step) == true && playing_page == queued)
+            queued_played = true;
+    }
+
+    if(queued != 0 && queued_played == false)
+    {
+        fprintf(stderr, "page %d (%s): the queued page %d was not played\n", page, SCENARIO_NAME[scenario], queued);
+        return -1;
+    }
+
+    if(scenario == PLAY)
+        *length = tick;
+    return compiled_ticks;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filename = (argc > 1) ? argv[1] : "../robotis/Data/motion_4096.bin";
+    Action compiled, interpreted;
+
+    if(compiled.LoadFile((char *)filename) == false || interpreted.LoadFile((char *)filename) == false)
+    {
+        fprintf(stderr, "Can not load %s\n", filename);
+        return 1;
+    }
+    compiled.COMPILE_ENABLE = true;
+    interpreted.COMPILE_ENABLE = false;
+    compiled.BLEND_TIME = BLEND_TIME;
+    interpreted.BLEND_TIME = BLEND_TIME;
+    compiled.m_Joint.SetEnableBody(true);
+    interpreted.m_Joint.SetEnableBody(true);
+
+    int pages = 0;
+    int compiled_ticks[NUMBER_OF_SCENARIOS] = {0, };
+    for(int page = 1; page < Action::MAXNUM_PAGE; page++)
+    {
+        if(compiled.GetPage(page)->header.stepnum == 0 || compiled.GetPage(page)->header.repeat == 0)
+            continue;
+
+        int length = 0;
+        for(int scenario = 0; scenario < NUMBER_OF_SCENARIOS; scenario++)
+        {
+            int ticks = Play(&compiled, &interpreted, page, scenario, &length);
+            if(ticks < 0)
+                return 1;
+            compiled_ticks[scenario] += ticks;
+        }
+        pages++;
+    }
+
+    // a chain compiled for another pose must not be played at all
+    if(pages == 0 || compiled_ticks[PLAY] == 0 || compiled_ticks[MOVED_POSE] != 0)
+    {
+        fprintf(stderr, "%d pages: %d ticks compiled, %d with a moved pose\n", pages, compiled_ticks[PLAY], compiled_ticks[MOVED_POSE]);
+        return 1;
+    }
+
+    printf("action compile: %d pages identical to the interpreter (%d, %d, %d, %d, %d ticks compiled)\n",
+           pages, compiled_ticks[PLAY], compiled_ticks[STOP], compiled_ticks[QUEUE], compiled_ticks[PREEMPT],
+           compiled_ticks[PREEMPT_QUEUED]);
+    return 0;
+}
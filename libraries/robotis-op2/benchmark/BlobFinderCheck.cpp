@@ -0,0 +1,246 @@
+/*
+ *   BlobFinderCheck.cpp
+ *   The blobs of BlobFinder must be the sets of pixels connected through their 8
+ *   neighbours that a flood fill finds, with the same areas, boxes and moments, on
+ *   random masks of discs, rectangles, rings and lines that touch and cross.
+ *
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "ImgProcess.h"
+#include "ColorFinder.h"
+
+using namespace Robot;
+
+
+static const int NUMBER_OF_MASKS = 400;
+static const int MAX_WIDTH = 300;
+static const int MAX_HEIGHT = 80;
+static const double MAX_ERROR = 1e-9;
+
+static unsigned int g_Random = 1;
+static int Random(int max)
+{
+    g_Random = g_Random * 1103515245 + 12345;
+    return (g_Random >> 8) % max;
+}
+
+static void Set(unsigned char *mask, int width, int height, int x, int y)
+{
+    if(x >= 0 && x < width && y >= 0 && y < height)
+        mask[y * width + x] = 1;
+}
+
+// a disc, a rectangle, a ring or a line, anywhere and partly out of the mask
+static void DrawShape(unsigned char *mask, int width, int height)
+{
+    int cx = Random(width), cy = Random(height), r = 1 + Random(12);
+
+    switch(Random(4))
+    {
+    case 0:
+    case 1:
+        for(int y = cy - r; y <= cy + r; y++)
+        {
+            for(int x = cx - r; x <= cx + r; x++)
+            {
+                int d = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+                if(Random(4) == 0 ? (d <= r * r && d >= (r - 2) * (r - 2)) : (d <= r * r))
+                    Set(mask, width, height, x, y);
+            }
+        }
+        break;
+    case 2:
+        for(int y = cy; y < cy + 1 + Random(20); y++)
+            for(int x = cx; x < cx + 1 + Random(80); x++)
+                Set(mask, width, height, x, y);
+        break;
+    default:
+    {
+        int length = 1 + Random(100), dx = Random(3) - 1, dy = Random(3) - 1;
+        for(int i = 0; i < length; i++)
+            Set(mask, width, height, cx + i * dx, cy + i * dy * (1 + i % 2) / 2);
+        break;
+    }
+    }
+}
+
+// the reference: every pixel not yet labelled starts a flood fill through the 8 neighbours
+static void FloodFill(const unsigned char *mask, int width, int height, std::vector<Blob> &blobs)
+{
+    std::vector<int> labels(width * height, -1), stack;
+
+    blobs.clear();
+    for(int start = 0; start < width * height; start++)
+    {
+        if(mask[start] == 0 || labels[start] >= 0)
+            continue;
+
+        double n = 0, sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+        Blob blob;
+        blob.left = width;
+        blob.top = height;
+        blob.right = blob.bottom = -1;
+
+        labels[start] = (int)blobs.size();
+        stack.push_back(start);
+        while(!stack.empty())
+        {
+            int pixel = stack.back(), x = pixel % width, y = pixel / width;
+            stack.pop_back();
+
+            n++;
+            sx += x;
+            sy += y;
+            sxx += (double)x * x;
+            syy += (double)y * y;
+            sxy += (double)x * y;
+            blob.left = std::min(blob.left, x);
+            blob.top = std::min(blob.top, y);
+            blob.right = std::max(blob.right, x);
+            blob.bottom = std::max(blob.bottom, y);
+
+            for(int ny = y - 1; ny <= y + 1; ny++)
+            {
+                for(int nx = x - 1; nx <= x + 1; nx++)
+                {
+                    if(nx < 0 || nx >= width || ny < 0 || ny >= height)
+                        continue;
+                    int neighbour = ny * width + nx;
+                    if(mask[neighbour] != 0 && labels[neighbour] < 0)
+                    {
+                        labels[neighbour] = labels[start];
+                        stack.push_back(neighbour);
+                    }
+                }
+            }
+        }
+
+        blob.area = (int)n;
+        blob.x = sx / n;
+        blob.y = sy / n;
+        blob.xx = sxx / n - blob.x * blob.x;
+        blob.yy = syy / n - blob.y * blob.y;
+        blob.xy = sxy / n - blob.x * blob.y;
+        blob.score = 0;
+        blobs.push_back(blob);
+    }
+}
+
+// a pass of BlobFinder over the rows of the mask, packed as ColorFinder does
+static void FindBlobs(BlobFinder *finder, const unsigned char *mask, int width, int height, double min_area, double max_area,
+                      std::vector<Blob> &blobs)
+{
+    std::vector<unsigned long long> row(ImgProcess::GetMaskWords(width));
+
+    finder->Start(width);
+    for(int y = 0; y < height; y++)
+    {
+        ImgProcess::PackMask(&mask[y * width], &row[0], width);
+        finder->AddRow(&row[0], y);
+    }
+    finder->Finish(blobs, min_area, max_area);
+}
+
+static bool IsBefore(const Blob &blob1, const Blob &blob2)
+{
+    if(blob1.top != blob2.top)
+        return blob1.top < blob2.top;
+    if(blob1.left != blob2.left)
+        return blob1.left < blob2.left;
+    if(blob1.area != blob2.area)
+        return blob1.area < blob2.area;
+    return blob1.y < blob2.y;
+}
+
+static bool IsClose(double value, double expected, double scale)
+{
+    return fabs(value - expected) <= MAX_ERROR * (1 + scale * scale);
+}
+
+static bool Compare(int mask, std::vector<Blob> found, std::vector<Blob> expected, int width, int height)
+{
+    if(found.size() != expected.size())
+    {
+        fprintf(stderr, "mask %d (%dx%d): %d blobs instead of %d\n", mask, width, height,
+                (int)found.size(), (int)expected.size());
+        return false;
+    }
+
+    // the ball first: the highest area * score
+    for(size_t i = 0; i < found.size(); i++)
+    {
+        if(found[i].score < 0 || found[i].score > 1 || (i > 0 && found[i].area * found[i].score > found[i - 1].area * found[i - 1].score))
+        {
+            fprintf(stderr, "mask %d: blob %d has the score %g, out of order\n", mask, (int)i, found[i].score);
+            return false;
+        }
+    }
+
+    std::sort(found.begin(), found.end(), IsBefore);
+    std::sort(expected.begin(), expected.end(), IsBefore);
+    for(size_t i = 0; i < found.size(); i++)
+    {
+        const Blob &f = found[i], &e = expected[i];
+        double scale = std::max(width, height);
+        if(f.area != e.area || f.left != e.left || f.top != e.top || f.right != e.right || f.bottom != e.bottom
+            || !IsClose(f.x, e.x, 1) || !IsClose(f.y, e.y, 1)
+            || !IsClose(f.xx, e.xx, scale) || !IsClose(f.yy, e.yy, scale) || !IsClose(f.xy, e.xy, scale))
+        {
+            fprintf(stderr, "mask %d (%dx%d): blob of %d pixels in %d,%d-%d,%d at %g,%g (%g %g %g)\n"
+                    "  instead of %d pixels in %d,%d-%d,%d at %g,%g (%g %g %g)\n", mask, width, height,
+                    f.area, f.left, f.top, f.right, f.bottom, f.x, f.y, f.xx, f.yy, f.xy,
+                    e.area, e.left, e.top, e.right, e.bottom, e.x, e.y, e.xx, e.yy, e.xy);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    BlobFinder finder;
+    std::vector<Blob> found, expected;
+    int blobs = 0;
+
+    for(int mask = 0; mask < NUMBER_OF_MASKS; mask++)
+    {
+        int width = 1 + Random(MAX_WIDTH), height = 1 + Random(MAX_HEIGHT);
+        std::vector<unsigned char> pixels(width * height, 0);
+
+        // at most MAXNUM_BLOBS blobs, so that none is dropped
+        do
+        {
+            std::fill(pixels.begin(), pixels.end(), 0);
+            int shapes = Random(BlobFinder::MAXNUM_BLOBS + 1);
+            for(int i = 0; i < shapes; i++)
+                DrawShape(&pixels[0], width, height);
+            FloodFill(&pixels[0], width, height, expected);
+        }
+        while(expected.size() > (size_t)BlobFinder::MAXNUM_BLOBS);
+
+        FindBlobs(&finder, &pixels[0], width, height, 0, width * height, found);
+        if(Compare(mask, found, expected, width, height) == false)
+            return 1;
+        blobs += (int)expected.size();
+
+        // the areas out of the range are left out
+        int min_area = Random(40), max_area = min_area + Random(400);
+        std::vector<Blob> kept;
+        for(size_t i = 0; i < expected.size(); i++)
+        {
+            if(expected[i].area > min_area && expected[i].area <= max_area)
+                kept.push_back(expected[i]);
+        }
+        FindBlobs(&finder, &pixels[0], width, height, min_area, max_area, found);
+        if(Compare(mask, found, kept, width, height) == false)
+            return 1;
+    }
+
+    printf("blob finder: %d masks, %d blobs identical to the flood fill\n", NUMBER_OF_MASKS, blobs);
+    return 0;
+}
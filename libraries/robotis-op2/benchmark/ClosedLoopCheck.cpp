@@ -0,0 +1,178 @@
+/*
+ *   ClosedLoopCheck.cpp
+ *   MotionManager with Walking and Action on a SimulatedCM730: every tick goes through
+ *   the packets of the real bus, the servos follow and the BulkRead reads them back.
+ *   Prints how many ticks run per second of CPU, and fails if the servos did not
+ *   reach the pose the modules asked for.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "MotionManager.h"
+#include "MotionModule.h"
+#include "Walking.h"
+#include "Action.h"
+#include "MX28.h"
+#include "SimulatedCM730.h"
+
+using namespace Robot;
+
+
+static const int SETTLE_TICKS = 250;	// 2 sec for the servos to stop, after the walk
+static const int MAX_POSITION_ERROR = 8;
+
+static double GetTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+// Same as the timer thread of the robot: one Process() every TIME_UNIT of the simulated clock
+static void Tick(MotionManager *manager, SimulatedCM730 *simulated)
+{
+    double start = simulated->GetTime();
+    manager->Process();
+
+    double left = MotionModule::TIME_UNIT - (simulated->GetTime() - start);
+    if(left > 0)
+        simulated->Sleep(left);
+}
+
+// the next page of the file after page, with something to play
+static int NextPage(Action *action, int page)
+{
+    for(int i = 1; i < Action::MAXNUM_PAGE; i++)
+    {
+        page = page % (Action::MAXNUM_PAGE - 1) + 1;
+        if(action->GetPage(page)->header.stepnum != 0 && action->GetPage(page)->header.repeat != 0)
+            return page;
+    }
+    return 0;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  -n ticks  ticks of walking (default 20000)\n");
+    fprintf(stderr, "  -p        through the CM730Async I/O thread\n");
+    fprintf(stderr, "  -f rate   status bytes dropped and packets corrupted, 0 to 1 (default 0)\n");
+    fprintf(stderr, "  -a file   motion file (default ../robotis/Data/motion_4096.bin)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int ticks = 20000;
+    bool pipeline = false;
+    double fault_rate = 0;
+    const char *motion_file = "../robotis/Data/motion_4096.bin";
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:pf:a:h")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n': ticks = atoi(optarg); break;
+        case 'p': pipeline = true; break;
+        case 'f': fault_rate = atof(optarg); break;
+        case 'a': motion_file = optarg; break;
+        default:
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    SimulatedCM730 simulated;
+    CM730 cm730(&simulated);
+    MotionManager manager;
+    Walking walking;
+    Action action;
+
+    if(action.LoadFile((char *)motion_file) == false || NextPage(&action, 0) == 0)
+    {
+        fprintf(stderr, "Can not load %s\n", motion_file);
+        return 1;
+    }
+    if(manager.Initialize(&cm730) == false || manager.SetPipelineEnable(pipeline) == false)
+    {
+        fprintf(stderr, "Can not initialize the motion manager\n");
+        return 1;
+    }
+
+    // Walking moves the legs and the arms, Action plays every page on the head
+    manager.AddModule(&walking);
+    manager.AddModule(&action);
+    walking.m_Joint.SetEnableBody(false);
+    walking.m_Joint.SetEnableBodyWithoutHead(true);
+    action.m_Joint.SetEnableBody(false);
+    action.m_Joint.SetEnableHeadOnly(true);
+    manager.SetEnable(true);
+
+    // faults only once the gyro is calibrated, it needs 100 clean ticks in a row
+    while(manager.GetCalibrationStatus() != 1)
+        Tick(&manager, &simulated);
+    simulated.DROP_BYTE_RATE = fault_rate;
+    simulated.CORRUPT_RATE = fault_rate;
+
+    int page = 0;
+    walking.Start();
+    double start_time = GetTime();
+    double start_clock = simulated.GetTime();
+    for(int tick = 0; tick < ticks + SETTLE_TICKS; tick++)
+    {
+        if(tick % 500 == 0)
+        {
+            walking.X_MOVE_AMPLITUDE = (tick / 500) % 5 * 10.0 - 20.0;
+            walking.A_MOVE_AMPLITUDE = (tick / 500) % 3 * 10.0 - 10.0;
+        }
+        if(tick == ticks)
+        {
+            walking.Stop();
+            action.Stop();
+        }
+        else if(tick < ticks && action.IsRunning() == false)
+            action.Start(page = NextPage(&action, page));
+
+        Tick(&manager, &simulated);
+    }
+    double cpu_time = GetTime() - start_time;
+    double clock_time = simulated.GetTime() - start_clock;
+
+    if(pipeline == true)
+        manager.SetPipelineEnable(false);
+    simulated.DROP_BYTE_RATE = 0;
+    simulated.CORRUPT_RATE = 0;
+    for(int tick = 0; tick < SETTLE_TICKS; tick++)
+        Tick(&manager, &simulated);
+
+    // the loop is closed when what the BulkRead reads back is where the modules sent the servos
+    int errors = 0;
+    for(int id = JointData::ID_R_SHOULDER_PITCH; id < JointData::NUMBER_OF_JOINTS; id++)
+    {
+        int goal = manager.GetStatus()->m_CurrentJoints.GetValue(id) + manager.m_Offset[id];
+        int present = cm730.m_BulkReadData[id].ReadWord(MX28::P_PRESENT_POSITION_L);
+        if(cm730.m_BulkReadData[id].error != 0 || abs(present - goal) > MAX_POSITION_ERROR
+            || present != simulated.GetWord(id, MX28::P_PRESENT_POSITION_L))
+        {
+            fprintf(stderr, "joint %d: goal %d, read %d (error %d), servo at %d\n", id, goal, present,
+                    cm730.m_BulkReadData[id].error, simulated.GetWord(id, MX28::P_PRESENT_POSITION_L));
+            errors++;
+        }
+    }
+    if(walking.IsRunning() == true)
+    {
+        fprintf(stderr, "Walking did not stop\n");
+        errors++;
+    }
+    if(errors != 0)
+        return 1;
+
+    printf("closed loop%s: %d ticks in %.0f msec, %.0f ticks/s (%.0fx real time), %d faults\n",
+           pipeline ? " (pipeline)" : "", ticks + SETTLE_TICKS, cpu_time, (ticks + SETTLE_TICKS) * 1000.0 / cpu_time,
+           clock_time / cpu_time, simulated.GetFaultCount());
+    return 0;
+}
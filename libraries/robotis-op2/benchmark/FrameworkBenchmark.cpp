@@ -0,0 +1,624 @@
+/*
+ *   FrameworkBenchmark.cpp
+ *   Time per call of the Framework hot paths, written as JSON so that
+ *   releases can be compared.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "Matrix.h"
+#include "LegIK.h"
+#include "Walking.h"
+#include "Action.h"
+#include "MotionStatus.h"
+#include "CM730.h"
+#include "Image.h"
+#include "ImgProcess.h"
+#include "ColorFinder.h"
+
+using namespace Robot;
+
+
+// names of the ImgProcess kernels, in the order of their enum
+static const int NUMBER_OF_KERNELS = 4;
+static const char *KERNEL_NAME[NUMBER_OF_KERNELS] = { "scalar", "sse41", "avx2", "neon" };
+
+// same as webots::Camera::mResolution in transfer/src/Camera.cpp
+static const int NUMBER_OF_RESOLUTIONS = 6;
+static const int RESOLUTION[NUMBER_OF_RESOLUTIONS][2] = {{320, 240}, {640, 360}, {640, 400},
+                                                        {640, 480}, {768, 480}, {800, 600}};
+
+// results are summed in here so that the compiler keeps the calls
+static volatile double g_Sink = 0;
+
+static double GetTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000.0 + now.tv_nsec;
+}
+
+// Same sequence on every run
+static unsigned int g_Random = 1;
+static int Random(int range)
+{
+    g_Random = g_Random * 1103515245 + 12345;
+    return (int)((g_Random >> 8) % (unsigned int)range);
+}
+
+
+/*
+A benchmark sets itself up in its constructor, Run() then calls the measured
+code iterations times. Image benchmarks give the resolution they run at.
+*/
+class Benchmark
+{
+public:
+    const char *m_Name;
+    int m_Width;
+    int m_Height;
+
+    Benchmark(const char *name, int width = 0, int height = 0) :
+            m_Name(name), m_Width(width), m_Height(height) {}
+    virtual ~Benchmark() {}
+
+    virtual void Run(int iterations) = 0;
+};
+
+class WalkingProcess : public Benchmark
+{
+private:
+    Walking m_Walking;
+
+public:
+    WalkingProcess() : Benchmark("walking_process")
+    {
+        m_Walking.Initialize();
+        m_Walking.X_MOVE_AMPLITUDE = 20;
+        m_Walking.A_MOVE_AMPLITUDE = 5;
+        m_Walking.Start();
+    }
+
+    void Run(int iterations)
+    {
+        for(int i = 0; i < iterations; i++)
+        {
+            m_Walking.Process();
+            g_Sink += m_Walking.m_Joint.GetValue(JointData::ID_R_KNEE);
+        }
+    }
+};
+
+// Both legs at once, as Walking::Process() does
+class LegIKCompute : public Benchmark
+{
+private:
+    enum { NUMBER_OF_POSES = 1024 };
+    double m_Pose[NUMBER_OF_POSES][LegIK::NUMBER_OF_LEGS * LegIK::POSE_SIZE];
+
+public:
+    LegIKCompute() : Benchmark("leg_ik")
+    {
+        // foot poses around the walking range
+        for(int i = 0; i < NUMBER_OF_POSES; i++)
+        {
+            for(int j = 0; j < LegIK::NUMBER_OF_LEGS * LegIK::POSE_SIZE; j += LegIK::POSE_SIZE)
+            {
+                m_Pose[i][j + 0] = Random(1000) / 10.0 - 50.0;
+                m_Pose[i][j + 1] = Random(1000) / 10.0 - 50.0;
+                m_Pose[i][j + 2] = Random(1000) / 20.0 + 10.0;
+                m_Pose[i][j + 3] = Random(1000) / 5000.0 - 0.1;
+                m_Pose[i][j + 4] = Random(1000) / 5000.0 - 0.1;
+                m_Pose[i][j + 5] = Random(1000) / 2500.0 - 0.2;
+            }
+        }
+    }
+
+    void Run(int iterations)
+    {
+        double out[LegIK::NUMBER_OF_LEGS * LegIK::POSE_SIZE];
+
+        for(int i = 0; i < iterations; i++)
+        {
+            LegIK::Compute(out, m_Pose[i % NUMBER_OF_POSES]);
+            g_Sink += out[3];
+        }
+    }
+};
+
+// Plays every page of the motion file whose chain ends, one after the other
+class ActionProcess : public Benchmark
+{
+private:
+    enum { MAX_TICKS = 4000 };
+
+    Action m_Action;
+    int m_Page[Action::MAXNUM_PAGE];
+    int m_NumberOfPages;
+    int m_Next;
+
+public:
+    ActionProcess(const char *name, const char *filename, bool compile) :
+            Benchmark(name), m_NumberOfPages(0), m_Next(0)
+    {
+        m_Action.m_Joint.SetEnableBody(true);
+        m_Action.Initialize();
+        if(m_Action.LoadFile((char *)filename) == false)
+            return;
+
+        m_Action.COMPILE_ENABLE = false;
+        for(int page = 1; page < Action::MAXNUM_PAGE; page++)
+        {
+            if(m_Action.GetPage(page)->header.stepnum == 0 || m_Action.Start(page) == false)
+                continue;
+
+            int ticks = 0;
+            while(m_Action.IsRunning() == true && ticks++ < MAX_TICKS)
+                m_Action.Process();
+
+            if(m_Action.IsRunning() == true)
+            {
+                m_Action.Brake();
+                m_Action.Process();
+            }
+            else
+                m_Page[m_NumberOfPages++] = page;
+        }
+        m_Action.COMPILE_ENABLE = compile;
+    }
+
+    bool IsLoaded()     { return m_NumberOfPages > 0; }
+
+    void Run(int iterations)
+    {
+        for(int i = 0; i < iterations; i++)
+        {
+            if(m_Action.IsRunning() == false)
+            {
+                m_Action.Start(m_Page[m_Next]);
+                m_Next = (m_Next + 1) % m_NumberOfPages;
+            }
+            m_Action.Process();
+            g_Sink += m_Action.m_Joint.GetValue(JointData::ID_R_KNEE);
+        }
+    }
+};
+
+class MatrixInverse : public Benchmark
+{
+private:
+    enum { NUMBER_OF_MATRICES = 64 };
+    Matrix3D m_Matrix[NUMBER_OF_MATRICES];
+
+public:
+    MatrixInverse() : Benchmark("matrix3d_inverse")
+    {
+        for(int i = 0; i < NUMBER_OF_MATRICES; i++)
+        {
+            m_Matrix[i].SetTransform(Point3D(Random(200) - 100, Random(200) - 100, Random(200) - 100),
+                                     Vector3D(Random(360) - 180, Random(180) - 90, Random(360) - 180));
+        }
+    }
+
+    void Run(int iterations)
+    {
+        for(int i = 0; i < iterations; i++)
+        {
+            Matrix3D matrix = m_Matrix[i % NUMBER_OF_MATRICES];
+            matrix.Inverse();
+            g_Sink += matrix.m[3];
+        }
+    }
+};
+
+// A SyncWrite of the 20 joints, as sent by MotionManager every tick
+class ChecksumBenchmark : public Benchmark
+{
+private:
+    unsigned char m_Packet[MAXNUM_TXPARAM + 10];
+
+public:
+    ChecksumBenchmark() : Benchmark("cm730_checksum")
+    {
+        int each_length = MX28::P_GOAL_POSITION_H - MX28::P_D_GAIN + 2;
+
+        m_Packet[0] = 0xFF;
+        m_Packet[1] = 0xFF;
+        m_Packet[2] = CM730::ID_BROADCAST;
+        m_Packet[3] = (JointData::NUMBER_OF_JOINTS - 1) * each_length + 4;
+        m_Packet[4] = 0x83;
+        m_Packet[5] = MX28::P_D_GAIN;
+        m_Packet[6] = each_length - 1;
+        for(int i = 7; i < m_Packet[3] + 3; i++)
+            m_Packet[i] = (unsigned char)Random(256);
+    }
+
+    void Run(int iterations)
+    {
+        for(int i = 0; i < iterations; i++)
+        {
+            m_Packet[8] = (unsigned char)i;
+            g_Sink += CM730::CalculateChecksum(m_Packet);
+        }
+    }
+};
+
+// The status packets of a BulkRead of the CM730 and the 20 joints (position and speed),
+// fed to the parser in the chunks a USB serial port would return
+class BulkReadDecode : public Benchmark
+{
+private:
+    enum { CHUNK = 64 };
+
+    BulkReadData m_Data[CM730::ID_BROADCAST];
+    unsigned char m_Buffer[MAXNUM_RXPARAM + 10];
+    int m_Length;
+    int m_ID[JointData::NUMBER_OF_JOINTS];
+    int m_NumberOfDevices;
+
+    void AddStatus(int id, int start_address, int length)
+    {
+        unsigned char *status = &m_Buffer[m_Length];
+
+        status[0] = 0xFF;
+        status[1] = 0xFF;
+        status[2] = (unsigned char)id;
+        status[3] = (unsigned char)(length + 2);
+        status[4] = 0;
+        for(int i = 0; i < length; i++)
+            status[5 + i] = (unsigned char)Random(256);
+        status[5 + length] = CM730::CalculateChecksum(status);
+        m_Length += length + 6;
+
+        m_Data[id].start_address = start_address;
+        m_Data[id].length = length;
+        m_ID[m_NumberOfDevices++] = id;
+    }
+
+public:
+    BulkReadDecode() : Benchmark("bulkread_decode"), m_Length(0), m_NumberOfDevices(0)
+    {
+        AddStatus(CM730::ID_CM, CM730::P_DXL_POWER, 30);
+        for(int id = 1; id < JointData::NUMBER_OF_JOINTS; id++)
+            AddStatus(id, MX28::P_PRESENT_POSITION_L, 4);
+    }
+
+    void Run(int iterations)
+    {
+        for(int i = 0; i < iterations; i++)
+        {
+            BulkReadParser parser(m_Data, i + 1);
+            for(int n = 0; n < m_NumberOfDevices; n++)
+                parser.Expect(m_ID[n]);
+
+            for(int n = 0; n < m_Length; n += CHUNK)
+                parser.Parse(&m_Buffer[n], (m_Length - n < CHUNK) ? m_Length - n : CHUNK);
+
+            g_Sink += parser.GetRemaining() + m_Data[JointData::ID_R_KNEE].ReadWord(MX28::P_PRESENT_POSITION_L);
+        }
+    }
+};
+
+/*
+A camera frame: noise over the whole image and a red ball of a tenth
+of the height in its middle, which ColorFinder's default color finds.
+*/
+class ImageBenchmark : public Benchmark
+{
+public:
+    enum
+    {
+        YUV_TO_RGB,
+        RGB_TO_HSV,
+        BGRA_TO_HSV,
+        EROSION,
+        DILATION,
+        COLOR_FINDER,
+        BALL_CENTER,
+        BALL_CENTER_FUSED,
+        BALL_CENTER_TABLE,
+        BALL_CENTER_BLOBS,
+        COLOR_TABLE_CLASSIFY,
+        NUMBER_OF_OPERATIONS
+    };
+
+    static const char *NAME[NUMBER_OF_OPERATIONS];
+
+private:
+    int m_Operation;
+    FrameBuffer m_Frame;
+    Image m_Mask;
+    ColorFinder m_Finder;
+    ColorFinder m_Goal;
+    ColorFinder m_Field;
+    ColorTable m_Table;
+    Image m_Classes;
+
+public:
+    ImageBenchmark(int operation, int width, int height) :
+            Benchmark(NAME[operation], width, height),
+            m_Operation(operation),
+            m_Frame(width, height),
+            m_Mask(width, height, 1),
+            m_Goal(60, 15, 40, 100, 20, 100, 0.07, 30.0),
+            m_Field(120, 30, 30, 100, 10, 100, 0.07, 30.0),
+            m_Table(6),
+            m_Classes(width, height, 1)
+    {
+        int radius = height / 20;
+
+        for(int y = 0; y < height; y++)
+        {
+            for(int x = 0; x < width; x++)
+            {
+                unsigned char *bgra = &m_Frame.m_BGRAFrame->m_ImageData[(y * width + x) * Image::BGRA_PIXEL_SIZE];
+                int dx = x - width / 2, dy = y - height / 2;
+                bool ball = (dx * dx + dy * dy) <= radius * radius;
+
+                bgra[0] = ball ? 20 + Random(10) : Random(256);
+                bgra[1] = ball ? 30 + Random(10) : Random(256);
+                bgra[2] = ball ? 240 + Random(16) : Random(256);
+                bgra[3] = 255;
+                m_Mask.m_ImageData[y * width + x] = ball ? 1 : (Random(64) == 0);
+            }
+        }
+
+        for(int i = 0; i < m_Frame.m_YUVFrame->m_ImageSize; i++)
+            m_Frame.m_YUVFrame->m_ImageData[i] = (unsigned char)Random(256);
+
+        ImgProcess::YUVtoRGB(&m_Frame);
+        ImgProcess::BGRAtoHSV(&m_Frame);
+
+        // ball, goal and field, the table is computed before the measure
+        if(operation == BALL_CENTER_TABLE)
+            m_Finder.m_table_bits = 6;
+        if(operation == BALL_CENTER_BLOBS)
+            m_Finder.m_find_blobs = true;
+        m_Table.AddClass(&m_Finder);
+        m_Table.AddClass(&m_Goal);
+        m_Table.AddClass(&m_Field);
+        m_Table.Update();
+    }
+
+    void Run(int iterations)
+    {
+        for(int i = 0; i < iterations; i++)
+        {
+            switch(m_Operation)
+            {
+            case YUV_TO_RGB:
+                ImgProcess::YUVtoRGB(&m_Frame);
+                g_Sink += m_Frame.m_RGBFrame->m_ImageData[0];
+                break;
+
+            case RGB_TO_HSV:
+                ImgProcess::RGBtoHSV(&m_Frame);
+                g_Sink += m_Frame.m_HSVFrame->m_ImageData[0];
+                break;
+
+            case BGRA_TO_HSV:
+                ImgProcess::BGRAtoHSV(&m_Frame);
+                g_Sink += m_Frame.m_HSVFrame->m_ImageData[0];
+                break;
+
+            case EROSION:
+                ImgProcess::Erosion(&m_Mask);
+                g_Sink += m_Mask.m_ImageData[m_Mask.m_NumberOfPixels / 2];
+                break;
+
+            case DILATION:
+                ImgProcess::Dilation(&m_Mask);
+                g_Sink += m_Mask.m_ImageData[m_Mask.m_NumberOfPixels / 2];
+                break;
+
+            case COLOR_FINDER:
+                // the HSV frame is the one of the BGRA frame, RGB_TO_HSV is never run here
+                g_Sink += m_Finder.GetPosition(m_Frame.m_HSVFrame).X;
+                break;
+
+            case BALL_CENTER:
+                // the way RobotisOp2VisionManager::getBallCenter used to do it
+                ImgProcess::BGRAtoHSV(&m_Frame);
+                g_Sink += m_Finder.GetPosition(m_Frame.m_HSVFrame).X;
+                break;
+
+            case BALL_CENTER_FUSED:
+            case BALL_CENTER_TABLE:
+            case BALL_CENTER_BLOBS:
+                g_Sink += m_Finder.GetPositionBGRA(m_Frame.m_BGRAFrame).X;
+                break;
+
+            case COLOR_TABLE_CLASSIFY:
+                m_Table.Classify(m_Frame.m_BGRAFrame, &m_Classes);
+                g_Sink += m_Classes.m_ImageData[m_Classes.m_NumberOfPixels / 2];
+                break;
+            }
+        }
+    }
+};
+
+const char *ImageBenchmark::NAME[NUMBER_OF_OPERATIONS] =
+{
+    "yuv_to_rgb",
+    "rgb_to_hsv",
+    "bgra_to_hsv",
+    "erosion",
+    "dilation",
+    "color_finder_get_position",
+    "ball_center",
+    "ball_center_fused",
+    "ball_center_table",
+    "ball_center_blobs",
+    "color_table_classify"
+};
+
+
+// Runs the benchmark for at least min_time ns and writes its JSON object
+static void Measure(Benchmark *benchmark, double min_time, FILE *out, bool first)
+{
+    int iterations = 1;
+    double time;
+
+    benchmark->Run(1);  // warm up
+    while(1)
+    {
+        double start = GetTime();
+        benchmark->Run(iterations);
+        time = GetTime() - start;
+
+        if(time >= min_time || iterations >= (1 << 30))
+            break;
+
+        // aim 20% above the minimum from the time per call so far
+        double next = (time > 0) ? iterations * min_time * 1.2 / time : iterations * 10.0;
+        if(next > iterations * 10.0)
+            next = iterations * 10.0;
+        if(next < iterations * 2.0)
+            next = iterations * 2.0;
+        iterations = (next > (1 << 30)) ? (1 << 30) : (int)next;
+    }
+
+    double ns_per_op = time / iterations;
+    fprintf(out, "%s\n    {\"name\": \"%s\", ", first ? "" : ",", benchmark->m_Name);
+    if(benchmark->m_Width > 0)
+        fprintf(out, "\"width\": %d, \"height\": %d, ", benchmark->m_Width, benchmark->m_Height);
+    fprintf(out, "\"iterations\": %d, \"ns_per_op\": %.2f, \"ops_per_sec\": %.1f",
+            iterations, ns_per_op, 1000000000.0 / ns_per_op);
+    if(benchmark->m_Width > 0)
+        fprintf(out, ", \"mpixels_per_sec\": %.2f", benchmark->m_Width * benchmark->m_Height * 1000.0 / ns_per_op);
+    fprintf(out, "}");
+    fflush(out);
+
+    fprintf(stderr, "%-28s", benchmark->m_Name);
+    if(benchmark->m_Width > 0)
+        fprintf(stderr, " %4dx%-4d", benchmark->m_Width, benchmark->m_Height);
+    else
+        fprintf(stderr, "          ");
+    fprintf(stderr, " %14.1f ns/op\n", ns_per_op);
+}
+
+static bool Selected(const char *filter, const char *name)
+{
+    return filter == 0 || strstr(name, filter) != 0;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  -o file   JSON output (default stdout)\n");
+    fprintf(stderr, "  -t msec   minimum time per benchmark (default 200)\n");
+    fprintf(stderr, "  -f text   only the benchmarks whose name contains text\n");
+    fprintf(stderr, "  -a file   motion file (default ../robotis/Data/motion_4096.bin)\n");
+    fprintf(stderr, "  -k name   kernel of the color conversions: scalar, sse41, avx2 or neon (default the fastest)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output = 0;
+    const char *filter = 0;
+    const char *motion_file = "../robotis/Data/motion_4096.bin";
+    double min_time = 200.0;
+    const char *kernel = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "o:t:f:a:k:h")) != -1)
+    {
+        switch(opt)
+        {
+        case 'o': output = optarg; break;
+        case 't': min_time = atof(optarg); break;
+        case 'f': filter = optarg; break;
+        case 'a': motion_file = optarg; break;
+        case 'k': kernel = optarg; break;
+        default:
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(kernel != 0)
+    {
+        int k = 0;
+        while(k < NUMBER_OF_KERNELS && strcmp(kernel, KERNEL_NAME[k]) != 0)
+            k++;
+        if(k == NUMBER_OF_KERNELS || ImgProcess::SetKernel(k) == false)
+        {
+            fprintf(stderr, "Kernel %s is not supported\n", kernel);
+            return 1;
+        }
+    }
+
+    FILE *out = stdout;
+    if(output != 0 && (out = fopen(output, "w")) == 0)
+    {
+        fprintf(stderr, "Can not open %s\n", output);
+        return 1;
+    }
+
+    time_t now = time(0);
+    char date[32];
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(out, "{\n  \"date\": \"%s\",\n", date);
+#ifdef __VERSION__
+    fprintf(out, "  \"compiler_version\": \"%s\",\n", __VERSION__);
+#endif
+    fprintf(out, "  \"image_kernel\": \"%s\",\n", KERNEL_NAME[ImgProcess::GetKernel()]);
+    fprintf(out, "  \"min_time_ms\": %.1f,\n  \"benchmarks\": [", min_time);
+
+    min_time *= 1000000.0;
+    bool first = true;
+    Benchmark *benchmark;
+
+#define MEASURE(name, create) \
+    if(Selected(filter, name)) \
+    { \
+        benchmark = create; \
+        Measure(benchmark, min_time, out, first); \
+        first = false; \
+        delete benchmark; \
+    }
+
+    MEASURE("walking_process", new WalkingProcess());
+    MEASURE("leg_ik", new LegIKCompute());
+
+    const char *action_name[2] = { "action_process", "action_process_interpreted" };
+    for(int i = 0; i < 2; i++)
+    {
+        if(Selected(filter, action_name[i]) == false)
+            continue;
+
+        ActionProcess *action = new ActionProcess(action_name[i], motion_file, i == 0);
+        if(action->IsLoaded() == true)
+        {
+            Measure(action, min_time, out, first);
+            first = false;
+        }
+        else
+            fprintf(stderr, "%s skipped, no page to play in %s\n", action_name[i], motion_file);
+        delete action;
+    }
+
+    MEASURE("matrix3d_inverse", new MatrixInverse());
+    MEASURE("cm730_checksum", new ChecksumBenchmark());
+    MEASURE("bulkread_decode", new BulkReadDecode());
+
+    for(int operation = 0; operation < ImageBenchmark::NUMBER_OF_OPERATIONS; operation++)
+    {
+        for(int r = 0; r < NUMBER_OF_RESOLUTIONS; r++)
+            MEASURE(ImageBenchmark::NAME[operation], new ImageBenchmark(operation, RESOLUTION[r][0], RESOLUTION[r][1]));
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    fprintf(stderr, "(checksum %g)\n", (double)g_Sink);
+
+    if(out != stdout)
+        fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ *   GaitGeneratorCheck.cpp
+ *   The rows of GaitGenerator::Render() must be the joints of a Walking engine
+ *   stepped through Process() tick by tick, for the number of periods asked, and
+ *   two generators rendering at once in their own thread must give the same rows.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <vector>
+#include "GaitGenerator.h"
+#include "JointData.h"
+
+using namespace Robot;
+
+
+static const int NUMBER_OF_RUNS = 200;
+static const int MAX_CYCLES = 4;
+static const int NUMBER_OF_THREADS = 2;
+static const int THREAD_RUNS = 50;
+static const int THREAD_REPEATS = 4;
+
+static unsigned int g_Random = 1;
+static double Random(double min, double max)
+{
+    g_Random = g_Random * 1103515245 + 12345;
+    return min + (max - min) * ((g_Random >> 8) & 0xFFFF) / 65535.0;
+}
+
+static void RandomParameters(GaitParameters *param)
+{
+    *param = GaitParameters();
+    param->PERIOD_TIME = Random(300, 1200);
+    param->DSP_RATIO = Random(0.0, 0.6);
+    param->STEP_FB_RATIO = Random(0, 0.5);
+    param->Z_MOVE_AMPLITUDE = Random(10, 60);
+    param->Y_SWAP_AMPLITUDE = Random(0, 40);
+    param->Z_SWAP_AMPLITUDE = Random(0, 20);
+    param->PELVIS_OFFSET = Random(0, 6);
+    param->HIP_PITCH_OFFSET = Random(0, 20);
+    param->ARM_SWING_GAIN = Random(0, 3);
+    param->X_MOVE_AMPLITUDE = Random(-40, 40);
+    param->Y_MOVE_AMPLITUDE = Random(-30, 30);
+    param->A_MOVE_AMPLITUDE = Random(-30, 30);
+    param->A_MOVE_AIM_ON = Random(0, 1) < 0.5;
+}
+
+// the reference: the engine as the motion thread runs it, from the stand pose, without the gyro
+static bool Compare(const GaitParameters &param, int cycles, const int *rows, int count, int run)
+{
+    Walking walking;
+    param.Set(&walking);
+    walking.BALANCE_ENABLE = false;
+    walking.Initialize();
+    walking.X_MOVE_AMPLITUDE = param.X_MOVE_AMPLITUDE;
+    walking.Y_MOVE_AMPLITUDE = param.Y_MOVE_AMPLITUDE;
+    walking.A_MOVE_AMPLITUDE = param.A_MOVE_AMPLITUDE;
+    walking.Start();
+
+    // the periods end when the phase wraps around
+    int periods = 0;
+    int phase = walking.GetCurrentPhase();
+    for(int tick = 0; tick <= count; tick++)
+    {
+        walking.Process();
+        if(phase == Walking::PHASE3 && walking.GetCurrentPhase() == Walking::PHASE0)
+            periods++;
+        phase = walking.GetCurrentPhase();
+        if(tick == count)
+            break;
+
+        for(int id = 0; id < JointData::NUMBER_OF_JOINTS; id++)
+        {
+            if(rows[tick * JointData::NUMBER_OF_JOINTS + id] != walking.m_Joint.GetValue(id))
+            {
+                fprintf(stderr, "run %d tick %d: joint %d is %d rendered, %d processed\n", run, tick, id,
+                        rows[tick * JointData::NUMBER_OF_JOINTS + id], walking.m_Joint.GetValue(id));
+                return false;
+            }
+        }
+    }
+
+    // the tick after the last row starts the period after the last one
+    if(periods != cycles)
+    {
+        fprintf(stderr, "run %d: %d ticks rendered for %d periods, %d asked\n", run, count, periods, cycles);
+        return false;
+    }
+    return true;
+}
+
+struct ThreadRun
+{
+    GaitParameters param[THREAD_RUNS];
+    std::vector<int> expected[THREAD_RUNS];
+    int errors;
+};
+
+// renders the parameters of its runs again and again, while the other thread does the same
+static void *ThreadProc(void *param)
+{
+    ThreadRun *runs = (ThreadRun *)param;
+    GaitGenerator generator;
+
+    for(int repeat = 0; repeat < THREAD_REPEATS; repeat++)
+    {
+        for(int run = 0; run < THREAD_RUNS; run++)
+        {
+            int max_ticks = GaitGenerator::GetMaxTicks(runs->param[run], MAX_CYCLES);
+            std::vector<int> rows(max_ticks * JointData::NUMBER_OF_JOINTS);
+            int count = generator.Render(runs->param[run], MAX_CYCLES, &rows[0], max_ticks);
+            rows.resize(count * JointData::NUMBER_OF_JOINTS);
+            if(rows != runs->expected[run])
+                runs->errors++;
+        }
+    }
+    return 0;
+}
+
+int main()
+{
+    GaitGenerator generator;
+    GaitParameters param;
+    int ticks = 0;
+
+    for(int run = 0; run < NUMBER_OF_RUNS; run++)
+    {
+        RandomParameters(&param);
+        int cycles = 1 + run % MAX_CYCLES;
+        int max_ticks = GaitGenerator::GetMaxTicks(param, cycles);
+        std::vector<int> rows(max_ticks * JointData::NUMBER_OF_JOINTS);
+
+        int count = generator.Render(param, cycles, &rows[0], max_ticks);
+        if(count >= max_ticks || Compare(param, cycles, &rows[0], count, run) == false)
+        {
+            if(count >= max_ticks)
+                fprintf(stderr, "run %d: %d periods do not fit in GetMaxTicks() = %d\n", run, cycles, max_ticks);
+            return 1;
+        }
+        ticks += count;
+
+        // a buffer too short gets the first rows only
+        int short_ticks = count / 2;
+        std::vector<int> first(short_ticks * JointData::NUMBER_OF_JOINTS + 1);
+        if(generator.Render(param, cycles, &first[0], short_ticks) != short_ticks
+            || memcmp(&first[0], &rows[0], short_ticks * JointData::NUMBER_OF_JOINTS * sizeof(int)) != 0)
+        {
+            fprintf(stderr, "run %d: the first %d rows differ in a short buffer\n", run, short_ticks);
+            return 1;
+        }
+    }
+
+    // the results of one thread first, then the threads at once
+    static ThreadRun runs[NUMBER_OF_THREADS];
+    pthread_t threads[NUMBER_OF_THREADS];
+    for(int t = 0; t < NUMBER_OF_THREADS; t++)
+    {
+        for(int run = 0; run < THREAD_RUNS; run++)
+        {
+            RandomParameters(&runs[t].param[run]);
+            int max_ticks = GaitGenerator::GetMaxTicks(runs[t].param[run], MAX_CYCLES);
+            runs[t].expected[run].resize(max_ticks * JointData::NUMBER_OF_JOINTS);
+            int count = generator.Render(runs[t].param[run], MAX_CYCLES, &runs[t].expected[run][0], max_ticks);
+            runs[t].expected[run].resize(count * JointData::NUMBER_OF_JOINTS);
+        }
+        runs[t].errors = 0;
+    }
+    for(int t = 0; t < NUMBER_OF_THREADS; t++)
+        pthread_create(&threads[t], 0, ThreadProc, &runs[t]);
+    for(int t = 0; t < NUMBER_OF_THREADS; t++)
+        pthread_join(threads[t], 0);
+    for(int t = 0; t < NUMBER_OF_THREADS; t++)
+    {
+        if(runs[t].errors != 0)
+        {
+            fprintf(stderr, "thread %d: %d renders differ when %d generators run at once\n", t, runs[t].errors, NUMBER_OF_THREADS);
+            return 1;
+        }
+    }
+
+    printf("gait generator: %d renders (%d ticks) identical to Walking::Process(), %d threads at once\n",
+           NUMBER_OF_RUNS, ticks, NUMBER_OF_THREADS);
+    return 0;
+}
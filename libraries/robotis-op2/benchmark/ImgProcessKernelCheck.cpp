@@ -0,0 +1,140 @@
+/*
+ *   ImgProcessKernelCheck.cpp
+ *   Every ImgProcess kernel the CPU supports must give the same bytes as the scalar one:
+ *   all the 2^24 colours through RGBtoHSV and BGRAtoHSV, random YUYV frames through
+ *   YUVtoRGB, and the runs too short or too long for the vectors.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "Image.h"
+#include "ImgProcess.h"
+
+using namespace Robot;
+
+
+// names of the ImgProcess kernels, in the order of their enum
+static const int NUMBER_OF_KERNELS = 4;
+static const char *KERNEL_NAME[NUMBER_OF_KERNELS] = { "scalar", "sse41", "avx2", "neon" };
+
+static const int WIDTH = 4096;
+static const int HEIGHT = 256;	// 2^20 pixels, the colours are done in 16 frames
+static const int NUMBER_OF_COLORS = 1 << 24;
+static const int NUMBER_OF_YUV_FRAMES = 16;
+static const int MAX_RUN = 100;
+
+static unsigned int g_Random = 1;
+static unsigned char RandomByte()
+{
+    g_Random = g_Random * 1103515245 + 12345;
+    return (g_Random >> 16) & 0xFF;
+}
+
+static bool Compare(const char *name, int kernel, const Image *reference, const Image *image, int offset)
+{
+    for(int i = 0; i < reference->m_ImageSize; i++)
+    {
+        if(reference->m_ImageData[i] != image->m_ImageData[i])
+        {
+            fprintf(stderr, "%s, %s kernel: pixel %d, byte %d is %d instead of %d\n", name, KERNEL_NAME[kernel],
+                    offset + i / reference->m_PixelSize, i % reference->m_PixelSize, image->m_ImageData[i],
+                    reference->m_ImageData[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// runs func with the scalar kernel in reference, and with kernel in buf
+static bool Check(const char *name, int kernel, void (*func)(FrameBuffer *), FrameBuffer *buf, Image *result, Image *reference, int offset)
+{
+    ImgProcess::SetKernel(ImgProcess::KERNEL_SCALAR);
+    memset(result->m_ImageData, 0xA5, result->m_ImageSize);
+    func(buf);
+    memcpy(reference->m_ImageData, result->m_ImageData, result->m_ImageSize);
+
+    ImgProcess::SetKernel(kernel);
+    memset(result->m_ImageData, 0xA5, result->m_ImageSize);
+    func(buf);
+
+    return Compare(name, kernel, reference, result, offset);
+}
+
+static bool CheckKernel(int kernel, FrameBuffer *buf, Image *hsv, Image *rgb)
+{
+    for(int first = 0; first < NUMBER_OF_COLORS; first += WIDTH * HEIGHT)
+    {
+        for(int i = 0; i < WIDTH * HEIGHT; i++)
+        {
+            int color = first + i;
+            unsigned char *pixel = &buf->m_RGBFrame->m_ImageData[i * Image::RGB_PIXEL_SIZE];
+            pixel[0] = color >> 16;
+            pixel[1] = color >> 8;
+            pixel[2] = color;
+
+            pixel = &buf->m_BGRAFrame->m_ImageData[i * Image::BGRA_PIXEL_SIZE];
+            pixel[0] = color;
+            pixel[1] = color >> 8;
+            pixel[2] = color >> 16;
+            pixel[3] = RandomByte();
+        }
+        if(Check("RGBtoHSV", kernel, ImgProcess::RGBtoHSV, buf, buf->m_HSVFrame, hsv, first) == false
+            || Check("BGRAtoHSV", kernel, ImgProcess::BGRAtoHSV, buf, buf->m_HSVFrame, hsv, first) == false)
+            return false;
+    }
+
+    for(int frame = 0; frame < NUMBER_OF_YUV_FRAMES; frame++)
+    {
+        for(int i = 0; i < buf->m_YUVFrame->m_ImageSize; i++)
+            buf->m_YUVFrame->m_ImageData[i] = RandomByte();
+        if(Check("YUVtoRGB", kernel, ImgProcess::YUVtoRGB, buf, buf->m_RGBFrame, rgb, 0) == false)
+            return false;
+    }
+
+    // every length of run, for the tails of the vectors
+    for(int pixels = 1; pixels <= MAX_RUN; pixels++)
+    {
+        FrameBuffer run(pixels, 1);
+        Image run_hsv(pixels, 1, Image::HSV_PIXEL_SIZE);
+        Image run_rgb(pixels, 1, Image::RGB_PIXEL_SIZE);
+
+        for(int i = 0; i < run.m_YUVFrame->m_ImageSize; i++)
+            run.m_YUVFrame->m_ImageData[i] = RandomByte();
+        for(int i = 0; i < run.m_RGBFrame->m_ImageSize; i++)
+            run.m_RGBFrame->m_ImageData[i] = RandomByte();
+        for(int i = 0; i < run.m_BGRAFrame->m_ImageSize; i++)
+            run.m_BGRAFrame->m_ImageData[i] = RandomByte();
+
+        if(Check("RGBtoHSV", kernel, ImgProcess::RGBtoHSV, &run, run.m_HSVFrame, &run_hsv, 0) == false
+            || Check("BGRAtoHSV", kernel, ImgProcess::BGRAtoHSV, &run, run.m_HSVFrame, &run_hsv, 0) == false
+            || Check("YUVtoRGB", kernel, ImgProcess::YUVtoRGB, &run, run.m_RGBFrame, &run_rgb, 0) == false)
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    FrameBuffer buf(WIDTH, HEIGHT);
+    Image hsv(WIDTH, HEIGHT, Image::HSV_PIXEL_SIZE);
+    Image rgb(WIDTH, HEIGHT, Image::RGB_PIXEL_SIZE);
+    char checked[64] = "";
+
+    for(int kernel = ImgProcess::KERNEL_SSE41; kernel < NUMBER_OF_KERNELS; kernel++)
+    {
+        if(ImgProcess::SetKernel(kernel) == false)
+            continue;
+        if(CheckKernel(kernel, &buf, &hsv, &rgb) == false)
+            return 1;
+        strcat(checked, " ");
+        strcat(checked, KERNEL_NAME[kernel]);
+    }
+
+    if(checked[0] == 0)
+        printf("imgproc kernels: only the scalar kernel on this CPU\n");
+    else
+        printf("imgproc kernels:%s identical to scalar (%d colours, %d YUYV frames, runs of 1 to %d pixels)\n",
+               checked, NUMBER_OF_COLORS, NUMBER_OF_YUV_FRAMES, MAX_RUN);
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ *   LegIKBenchmark.cpp
+ *   Throughput of LegIK against the Matrix3D based solver it replaced in Walking.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "Vector.h"
+#include "Matrix.h"
+#include "Kinematics.h"
+#include "LegIK.h"
+
+using namespace Robot;
+
+
+#define PI (3.14159265)
+
+static const int NUMBER_OF_POSES = 4096;
+static const int REPEAT = 200;
+
+// The former Walking::computeIK(), kept as the reference
+static bool MatrixLegIK(double *out, double x, double y, double z, double a, double b, double c)
+{
+    Matrix3D Tad, Tda, Tcd, Tdc, Tac;
+    Vector3D vec;
+    double _Rac, _Acos, _Atan, _k, _l, _m, _n, _s, _c, _theta;
+    double LEG_LENGTH = Kinematics::LEG_LENGTH;
+    double THIGH_LENGTH = Kinematics::THIGH_LENGTH;
+    double CALF_LENGTH = Kinematics::CALF_LENGTH;
+    double ANKLE_LENGTH = Kinematics::ANKLE_LENGTH;
+
+    Tad.SetTransform(Point3D(x, y, z - LEG_LENGTH), Vector3D(a * 180.0 / PI, b * 180.0 / PI, c * 180.0 / PI));
+
+    vec.X = x + Tad.m[2] * ANKLE_LENGTH;
+    vec.Y = y + Tad.m[6] * ANKLE_LENGTH;
+    vec.Z = (z - LEG_LENGTH) + Tad.m[10] * ANKLE_LENGTH;
+
+    // Get Knee
+    _Rac = vec.Length();
+    _Acos = acos((_Rac * _Rac - THIGH_LENGTH * THIGH_LENGTH - CALF_LENGTH * CALF_LENGTH) / (2 * THIGH_LENGTH * CALF_LENGTH));
+    if(isnan(_Acos) == 1)
+        return false;
+    *(out + 3) = _Acos;
+
+    // Get Ankle Roll
+    Tda = Tad;
+    if(Tda.Inverse() == false)
+        return false;
+    _k = sqrt(Tda.m[7] * Tda.m[7] + Tda.m[11] * Tda.m[11]);
+    _l = sqrt(Tda.m[7] * Tda.m[7] + (Tda.m[11] - ANKLE_LENGTH) * (Tda.m[11] - ANKLE_LENGTH));
+    _m = (_k * _k - _l * _l - ANKLE_LENGTH * ANKLE_LENGTH) / (2 * _l * ANKLE_LENGTH);
+    if(_m > 1.0)
+        _m = 1.0;
+    else if(_m < -1.0)
+        _m = -1.0;
+    _Acos = acos(_m);
+    if(isnan(_Acos) == 1)
+        return false;
+    if(Tda.m[7] < 0.0)
+        *(out + 5) = -_Acos;
+    else
+        *(out + 5) = _Acos;
+
+    // Get Hip Yaw
+    Tcd.SetTransform(Point3D(0, 0, -ANKLE_LENGTH), Vector3D(*(out + 5) * 180.0 / PI, 0, 0));
+    Tdc = Tcd;
+    if(Tdc.Inverse() == false)
+        return false;
+    Tac = Tad * Tdc;
+    _Atan = atan2(-Tac.m[1] , Tac.m[5]);
+    if(isinf(_Atan) == 1)
+        return false;
+    *(out) = _Atan;
+
+    // Get Hip Roll
+    _Atan = atan2(Tac.m[9], -Tac.m[1] * sin(*(out)) + Tac.m[5] * cos(*(out)));
+    if(isinf(_Atan) == 1)
+        return false;
+    *(out + 1) = _Atan;
+
+    // Get Hip Pitch and Ankle Pitch
+    _Atan = atan2(Tac.m[2] * cos(*(out)) + Tac.m[6] * sin(*(out)), Tac.m[0] * cos(*(out)) + Tac.m[4] * sin(*(out)));
+    if(isinf(_Atan) == 1)
+        return false;
+    _theta = _Atan;
+    _k = sin(*(out + 3)) * CALF_LENGTH;
+    _l = -THIGH_LENGTH - cos(*(out + 3)) * CALF_LENGTH;
+    _m = cos(*(out)) * vec.X + sin(*(out)) * vec.Y;
+    _n = cos(*(out + 1)) * vec.Z + sin(*(out)) * sin(*(out + 1)) * vec.X - cos(*(out)) * sin(*(out + 1)) * vec.Y;
+    _s = (_k * _n + _l * _m) / (_k * _k + _l * _l);
+    _c = (_n - _k * _s) / _l;
+    _Atan = atan2(_s, _c);
+    if(isinf(_Atan) == 1)
+        return false;
+    *(out + 2) = _Atan;
+    *(out + 4) = _theta - *(out + 3) - *(out + 2);
+
+    return true;
+}
+
+static double GetTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000.0 + now.tv_nsec;
+}
+
+int main()
+{
+    static double pose[NUMBER_OF_POSES][LegIK::NUMBER_OF_LEGS * LegIK::POSE_SIZE];
+    double out[LegIK::NUMBER_OF_LEGS * LegIK::POSE_SIZE];
+    double max_error = 0, sum = 0;
+    int mismatch = 0;
+
+    // foot poses around the walking range
+    srand(1);
+    for(int i = 0; i < NUMBER_OF_POSES; i++)
+    {
+        for(int j = 0; j < LegIK::NUMBER_OF_LEGS * LegIK::POSE_SIZE; j += LegIK::POSE_SIZE)
+        {
+            pose[i][j + 0] = rand() % 1000 / 10.0 - 50.0;
+            pose[i][j + 1] = rand() % 1000 / 10.0 - 50.0;
+            pose[i][j + 2] = rand() % 1000 / 20.0 + 10.0;
+            pose[i][j + 3] = rand() % 1000 / 5000.0 - 0.1;
+            pose[i][j + 4] = rand() % 1000 / 5000.0 - 0.1;
+            pose[i][j + 5] = rand() % 1000 / 2500.0 - 0.2;
+        }
+    }
+
+    for(int i = 0; i < NUMBER_OF_POSES; i++)
+    {
+        double ref[LegIK::NUMBER_OF_LEGS * LegIK::POSE_SIZE];
+        double *p = pose[i];
+        bool ref_ok = MatrixLegIK(&ref[0], p[0], p[1], p[2], p[3], p[4], p[5])
+                      && MatrixLegIK(&ref[6], p[6], p[7], p[8], p[9], p[10], p[11]);
+        bool ok = LegIK::Compute(out, p);
+
+        if(ok != ref_ok)
+            mismatch++;
+        else if(ok == true)
+        {
+            for(int j = 0; j < LegIK::NUMBER_OF_LEGS * LegIK::POSE_SIZE; j++)
+            {
+                if(fabs(out[j] - ref[j]) > max_error)
+                    max_error = fabs(out[j] - ref[j]);
+            }
+        }
+    }
+
+    double start = GetTime();
+    for(int r = 0; r < REPEAT; r++)
+    {
+        for(int i = 0; i < NUMBER_OF_POSES; i++)
+        {
+            double *p = pose[i];
+            MatrixLegIK(&out[0], p[0], p[1], p[2], p[3], p[4], p[5]);
+            MatrixLegIK(&out[6], p[6], p[7], p[8], p[9], p[10], p[11]);
+            sum += out[2];
+        }
+    }
+    double matrix_ns = (GetTime() - start) / REPEAT / NUMBER_OF_POSES;
+
+    start = GetTime();
+    for(int r = 0; r < REPEAT; r++)
+    {
+        for(int i = 0; i < NUMBER_OF_POSES; i++)
+        {
+            LegIK::Compute(out, pose[i]);
+            sum += out[2];
+        }
+    }
+    double leg_ik_ns = (GetTime() - start) / REPEAT / NUMBER_OF_POSES;
+
+    printf("Matrix3D solver : %8.1f ns per pair of legs\n", matrix_ns);
+    printf("LegIK           : %8.1f ns per pair of legs (x%.1f)\n", leg_ik_ns, matrix_ns / leg_ik_ns);
+    printf("max difference  : %g rad, %d reachability mismatch (checksum %g)\n", max_error, mismatch, sum);
+
+    return (mismatch == 0 && max_error < 1e-6) ? 0 : 1;
+}
@@ -0,0 +1,247 @@
+/*
+ *   MaskMorphologyCheck.cpp
+ *   The packed erosion and dilation must give the same masks as the window of
+ *   size x size pixels evaluated pixel by pixel, with every kernel packing and
+ *   unpacking the rows, in place or not, and from several threads at once.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "Image.h"
+#include "ImgProcess.h"
+
+using namespace Robot;
+
+
+static const int NUMBER_OF_KERNELS = 4;
+static const int NUMBER_OF_MASKS = 3000;
+static const int NUMBER_OF_ROWS = 20000;
+static const int NUMBER_OF_THREADS = 4;
+static const int THREAD_RUNS = 200;
+static const int THREAD_WIDTH = 640;
+static const int THREAD_HEIGHT = 480;
+
+static unsigned int g_Random = 1;
+static int Random(int max)
+{
+    g_Random = g_Random * 1103515245 + 12345;
+    return (g_Random >> 8) % max;
+}
+
+static unsigned long long RandomWord()
+{
+    unsigned long long word = 0;
+    for(int i = 0; i < 4; i++)
+        word = (word << 16) ^ Random(0x10000);
+    return word;
+}
+
+// the definition: the window must fit in the mask, then all (erosion) or any (dilation) of its pixels
+static int Window(const unsigned char *mask, int width, int height, int x, int y, int size, bool erosion)
+{
+    int radius = size / 2;
+    if(x < radius || x >= width - radius || y < radius || y >= height - radius)
+        return 0;
+
+    for(int dy = -radius; dy <= radius; dy++)
+    {
+        for(int dx = -radius; dx <= radius; dx++)
+        {
+            if((mask[(y + dy) * width + x + dx] != 0) != erosion)
+                return erosion ? 0 : 1;
+        }
+    }
+    return erosion ? 1 : 0;
+}
+
+static bool CheckMask(int kernel, int width, int height, int size, bool erosion)
+{
+    const char *name = erosion ? "erosion" : "dilation";
+    int words = ImgProcess::GetMaskWords(width);
+    unsigned char *mask = new unsigned char[width * height];
+    unsigned char *row = new unsigned char[width];
+    unsigned long long *reference = new unsigned long long[words * height];
+    unsigned long long *bits = new unsigned long long[2 * words * height];
+    Image image(width, height, 1);
+    bool ok = true;
+
+    // set pixels are any value but 0
+    for(int i = 0; i < width * height; i++)
+        mask[i] = Random(100) < 80 ? Random(255) + 1 : 0;
+    memcpy(image.m_ImageData, mask, width * height);
+
+    ImgProcess::SetKernel(ImgProcess::KERNEL_SCALAR);
+    for(int y = 0; y < height; y++)
+        ImgProcess::PackMask(&mask[y * width], &reference[y * words], width);
+    ImgProcess::SetKernel(kernel);
+    for(int y = 0; y < height; y++)
+        ImgProcess::PackMask(&mask[y * width], &bits[y * words], width);
+    if(memcmp(reference, bits, words * height * sizeof(unsigned long long)) != 0)
+    {
+        fprintf(stderr, "kernel %d: PackMask differs from the scalar one, width %d\n", kernel, width);
+        ok = false;
+    }
+
+    if(erosion == true)
+    {
+        ImgProcess::Erosion(bits, &bits[words * height], width, height, size);
+        ImgProcess::Erosion(&image, size);
+    }
+    else
+    {
+        ImgProcess::Dilation(bits, &bits[words * height], width, height, size);
+        ImgProcess::Dilation(&image, size);
+    }
+
+    for(int y = 0; y < height && ok == true; y++)
+    {
+        ImgProcess::UnpackMask(&bits[y * words], row, width);
+        for(int x = 0; x < width; x++)
+        {
+            int expected = Window(mask, width, height, x, y, size, erosion);
+            int bit = (bits[y * words + x / 64] >> (x % 64)) & 1;
+            if(bit != expected || row[x] != expected || image.m_ImageData[y * width + x] != expected)
+            {
+                fprintf(stderr, "kernel %d: %s of %dx%d, size %d, pixel %d,%d is %d (unpacked %d, image %d) instead of %d\n",
+                        kernel, name, width, height, size, x, y, bit, row[x], image.m_ImageData[y * width + x], expected);
+                ok = false;
+                break;
+            }
+        }
+        if(width % 64 != 0 && (bits[y * words + words - 1] >> (width % 64)) != 0)
+        {
+            fprintf(stderr, "kernel %d: %s of %dx%d, size %d, bits set past the end of row %d\n",
+                    kernel, name, width, height, size, y);
+            ok = false;
+        }
+    }
+
+    delete[] mask;
+    delete[] row;
+    delete[] reference;
+    delete[] bits;
+    return ok;
+}
+
+// a row done in place must give the same as into another row
+static bool CheckRows()
+{
+    unsigned long long src[8], dest[8], in_place[8];
+
+    for(int i = 0; i < NUMBER_OF_ROWS; i++)
+    {
+        int width = 1 + Random(8 * 64);
+        int size = 1 + Random(i % 2 ? 140 : 9);
+        bool erosion = Random(2) == 0;
+        for(int w = 0; w < ImgProcess::GetMaskWords(width); w++)
+            src[w] = in_place[w] = RandomWord();
+
+        if(erosion == true)
+        {
+            ImgProcess::ErosionRow(src, dest, width, size);
+            ImgProcess::ErosionRow(in_place, in_place, width, size);
+        }
+        else
+        {
+            ImgProcess::DilationRow(src, dest, width, size);
+            ImgProcess::DilationRow(in_place, in_place, width, size);
+        }
+        if(memcmp(dest, in_place, ImgProcess::GetMaskWords(width) * sizeof(unsigned long long)) != 0)
+        {
+            fprintf(stderr, "%s of a row of %d pixels, size %d, differs in place\n",
+                    erosion ? "erosion" : "dilation", width, size);
+            return false;
+        }
+    }
+    return true;
+}
+
+static const int THREAD_WORDS = (THREAD_WIDTH + 63) / 64;
+static unsigned char g_ThreadMask[THREAD_WIDTH * THREAD_HEIGHT];
+static unsigned char g_ThreadReference[THREAD_WIDTH * THREAD_HEIGHT];
+static volatile int g_ThreadErrors = 0;
+
+// every thread with its own packed mask and scratch, and the Image wrappers with theirs
+static void *ThreadProc(void *param)
+{
+    unsigned long long *bits = new unsigned long long[2 * THREAD_WORDS * THREAD_HEIGHT];
+    unsigned char *row = new unsigned char[THREAD_WIDTH];
+    Image image(THREAD_WIDTH, THREAD_HEIGHT, 1);
+
+    for(int run = 0; run < THREAD_RUNS; run++)
+    {
+        for(int y = 0; y < THREAD_HEIGHT; y++)
+            ImgProcess::PackMask(&g_ThreadMask[y * THREAD_WIDTH], &bits[y * THREAD_WORDS], THREAD_WIDTH);
+        ImgProcess::Erosion(bits, &bits[THREAD_WORDS * THREAD_HEIGHT], THREAD_WIDTH, THREAD_HEIGHT, 3);
+        ImgProcess::Dilation(bits, &bits[THREAD_WORDS * THREAD_HEIGHT], THREAD_WIDTH, THREAD_HEIGHT, 5);
+
+        memcpy(image.m_ImageData, g_ThreadMask, THREAD_WIDTH * THREAD_HEIGHT);
+        ImgProcess::Erosion(&image, 3);
+        ImgProcess::Dilation(&image, 5);
+
+        for(int y = 0; y < THREAD_HEIGHT; y++)
+        {
+            ImgProcess::UnpackMask(&bits[y * THREAD_WORDS], row, THREAD_WIDTH);
+            if(memcmp(row, &g_ThreadReference[y * THREAD_WIDTH], THREAD_WIDTH) != 0)
+                __sync_fetch_and_add(&g_ThreadErrors, 1);
+        }
+        if(memcmp(image.m_ImageData, g_ThreadReference, THREAD_WIDTH * THREAD_HEIGHT) != 0)
+            __sync_fetch_and_add(&g_ThreadErrors, 1);
+    }
+
+    delete[] bits;
+    delete[] row;
+    return 0;
+}
+
+static bool CheckThreads()
+{
+    Image image(THREAD_WIDTH, THREAD_HEIGHT, 1);
+    pthread_t threads[NUMBER_OF_THREADS];
+
+    for(int i = 0; i < THREAD_WIDTH * THREAD_HEIGHT; i++)
+        g_ThreadMask[i] = Random(100) < 70 ? 255 : 0;
+    memcpy(image.m_ImageData, g_ThreadMask, THREAD_WIDTH * THREAD_HEIGHT);
+    ImgProcess::Erosion(&image, 3);
+    ImgProcess::Dilation(&image, 5);
+    memcpy(g_ThreadReference, image.m_ImageData, THREAD_WIDTH * THREAD_HEIGHT);
+
+    for(int i = 0; i < NUMBER_OF_THREADS; i++)
+        pthread_create(&threads[i], 0, ThreadProc, 0);
+    for(int i = 0; i < NUMBER_OF_THREADS; i++)
+        pthread_join(threads[i], 0);
+
+    if(g_ThreadErrors != 0)
+    {
+        fprintf(stderr, "%d masks differ when %d threads run at once\n", g_ThreadErrors, NUMBER_OF_THREADS);
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    int kernels = 0;
+
+    for(int kernel = 0; kernel < NUMBER_OF_KERNELS; kernel++)
+    {
+        if(ImgProcess::SetKernel(kernel) == false)
+            continue;
+        kernels++;
+
+        // mostly small windows, the ones of ColorFinder, and some wider than a word
+        for(int i = 0; i < NUMBER_OF_MASKS; i++)
+        {
+            if(CheckMask(kernel, 1 + Random(300), 1 + Random(30), 1 + Random(i % 3 == 0 ? 150 : 9), Random(2) == 0) == false)
+                return 1;
+        }
+    }
+    if(CheckRows() == false || CheckThreads() == false)
+        return 1;
+
+    printf("mask morphology: %d masks with %d kernels, %d rows in place and %d threads identical\n",
+           NUMBER_OF_MASKS, kernels, NUMBER_OF_ROWS, NUMBER_OF_THREADS);
+    return 0;
+}
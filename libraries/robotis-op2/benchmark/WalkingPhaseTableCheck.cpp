@@ -0,0 +1,158 @@
+/*
+ *   WalkingPhaseTableCheck.cpp
+ *   Walking with the phase table must give the same joints as the direct evaluation,
+ *   bit for bit, whatever the parameters and wherever in the period they change.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "Walking.h"
+#include "MotionStatus.h"
+
+using namespace Robot;
+
+
+static const int NUMBER_OF_RUNS = 400;
+static const int TICKS_PER_RUN = 3000;
+
+static unsigned int g_Random = 1;
+static double Random(double min, double max)
+{
+    g_Random = g_Random * 1103515245 + 12345;
+    return min + (max - min) * ((g_Random >> 8) & 0xFFFF) / 65535.0;
+}
+
+// the same random value for both walkers
+static void SetParameter(Walking *table, Walking *direct, double Walking::*parameter, double min, double max)
+{
+    double value = Random(min, max);
+    table->*parameter = value;
+    direct->*parameter = value;
+}
+
+static void ChangeParameters(Walking *table, Walking *direct)
+{
+    switch((int)Random(0, 12))
+    {
+    case 0:
+        SetParameter(table, direct, &Walking::PERIOD_TIME, 300, 1200);
+        break;
+    case 1:
+        SetParameter(table, direct, &Walking::DSP_RATIO, 0.0, 0.6);
+        break;
+    case 2:
+        SetParameter(table, direct, &Walking::X_MOVE_AMPLITUDE, -40, 40);
+        break;
+    case 3:
+        SetParameter(table, direct, &Walking::Y_MOVE_AMPLITUDE, -30, 30);
+        break;
+    case 4:
+        SetParameter(table, direct, &Walking::A_MOVE_AMPLITUDE, -30, 30);
+        break;
+    case 5:
+        SetParameter(table, direct, &Walking::Z_MOVE_AMPLITUDE, 10, 60);
+        break;
+    case 6:
+        SetParameter(table, direct, &Walking::Y_SWAP_AMPLITUDE, 0, 40);
+        SetParameter(table, direct, &Walking::Z_SWAP_AMPLITUDE, 0, 20);
+        break;
+    case 7:
+        SetParameter(table, direct, &Walking::STEP_FB_RATIO, 0, 0.5);
+        SetParameter(table, direct, &Walking::ARM_SWING_GAIN, 0, 3);
+        break;
+    case 8:
+        SetParameter(table, direct, &Walking::PELVIS_OFFSET, 0, 6);
+        SetParameter(table, direct, &Walking::HIP_PITCH_OFFSET, 0, 20);
+        break;
+    case 9:
+        table->A_MOVE_AIM_ON = direct->A_MOVE_AIM_ON = !table->A_MOVE_AIM_ON;
+        break;
+    case 10:
+        table->BALANCE_ENABLE = direct->BALANCE_ENABLE = !table->BALANCE_ENABLE;
+        break;
+    default:
+        if(table->IsRunning() == true && Random(0, 1) < 0.5)
+        {
+            table->Stop();
+            direct->Stop();
+        }
+        else
+        {
+            table->Start();
+            direct->Start();
+        }
+        break;
+    }
+}
+
+static bool Same(double a, double b)
+{
+    return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+static bool Compare(Walking *table, Walking *direct, int run, int tick)
+{
+    for(int id = 1; id < JointData::NUMBER_OF_JOINTS; id++)
+    {
+        if(table->m_Joint.GetValue(id) != direct->m_Joint.GetValue(id)
+            || Same(table->m_Joint.GetAngle(id), direct->m_Joint.GetAngle(id)) == false)
+        {
+            fprintf(stderr, "run %d tick %d: joint %d is %d (%.17g) with the table, %d (%.17g) without\n",
+                    run, tick, id, table->m_Joint.GetValue(id), table->m_Joint.GetAngle(id),
+                    direct->m_Joint.GetValue(id), direct->m_Joint.GetAngle(id));
+            return false;
+        }
+    }
+
+    if(table->GetCurrentPhase() != direct->GetCurrentPhase() || table->IsRunning() != direct->IsRunning()
+        || Same(table->GetBodySwingY(), direct->GetBodySwingY()) == false
+        || Same(table->GetBodySwingZ(), direct->GetBodySwingZ()) == false)
+    {
+        fprintf(stderr, "run %d tick %d: the phase or the body swing differs\n", run, tick);
+        return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    Walking table, direct;
+    table.PHASE_TABLE_ENABLE = true;
+    direct.PHASE_TABLE_ENABLE = false;
+
+    for(int run = 0; run < NUMBER_OF_RUNS; run++)
+    {
+        SetParameter(&table, &direct, &Walking::PERIOD_TIME, 300, 1200);
+        SetParameter(&table, &direct, &Walking::DSP_RATIO, 0.0, 0.6);
+        table.Initialize();
+        direct.Initialize();
+        SetParameter(&table, &direct, &Walking::X_MOVE_AMPLITUDE, -40, 40);
+        SetParameter(&table, &direct, &Walking::A_MOVE_AMPLITUDE, -30, 30);
+        table.Start();
+        direct.Start();
+
+        // the parameters mostly change between periods, sometimes mid-period
+        int next_change = (int)Random(1, 200);
+        for(int tick = 0; tick < TICKS_PER_RUN; tick++)
+        {
+            if(--next_change == 0)
+            {
+                ChangeParameters(&table, &direct);
+                next_change = (int)Random(1, 200);
+            }
+
+            MotionStatus::FB_GYRO = (int)Random(-100, 100);
+            MotionStatus::RL_GYRO = (int)Random(-100, 100);
+
+            table.Process();
+            direct.Process();
+            if(Compare(&table, &direct, run, tick) == false)
+                return 1;
+        }
+    }
+
+    printf("walking phase table: %d runs of %d ticks, identical\n", NUMBER_OF_RUNS, TICKS_PER_RUN);
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ *   CM730Emulator.cpp
+ *   Presents a SimulatedCM730 on a pseudo-terminal, so that a program using
+ *   LinuxCM730 talks to it through the real serial port code.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "SimulatedCM730.h"
+
+using namespace Robot;
+
+
+static volatile sig_atomic_t g_Quit = 0;
+
+static void SignalHandler(int signal)
+{
+    g_Quit = 1;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  -l path   symbolic link to the serial port (default /tmp/ttyCM730)\n");
+    fprintf(stderr, "  -t file   trace of every transfer\n");
+    fprintf(stderr, "  -b baud   emulated baud rate (default 1000000)\n");
+    fprintf(stderr, "  -d usec   return delay time of every device (default 0)\n");
+    fprintf(stderr, "  -u msec   USB latency added to every status packet (default 0)\n");
+    fprintf(stderr, "  -D rate   dropped status bytes, 0 to 1\n");
+    fprintf(stderr, "  -C rate   status packets with a wrong checksum, 0 to 1\n");
+    fprintf(stderr, "  -T rate   devices not answering, 0 to 1\n");
+    fprintf(stderr, "  -s seed   seed of the faults\n");
+    fprintf(stderr, "  -x ids    comma separated MX28 ids to unplug\n");
+}
+
+// One line per transfer: msec since start, direction and bytes
+static void Trace(FILE *trace, double time, const char *direction, unsigned char *data, int length)
+{
+    if(trace == 0 || length <= 0)
+        return;
+
+    fprintf(trace, "%12.3f %s", time, direction);
+    for(int i = 0; i < length; i++)
+        fprintf(trace, " %.2X", data[i]);
+    fprintf(trace, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *link_name = "/tmp/ttyCM730";
+    const char *trace_name = 0;
+    int baud = 1000000;
+    int return_delay = 0;
+    char *unplug = 0;
+    int opt;
+
+    static SimulatedCM730 cm730;
+    cm730.REAL_TIME = true;
+
+    while((opt = getopt(argc, argv, "l:t:b:d:u:D:C:T:s:x:h")) != -1)
+    {
+        switch(opt)
+        {
+        case 'l': link_name = optarg; break;
+        case 't': trace_name = optarg; break;
+        case 'b': baud = atoi(optarg); break;
+        case 'd': return_delay = atoi(optarg); break;
+        case 'u': cm730.LATENCY_TIME = atof(optarg); break;
+        case 'D': cm730.DROP_BYTE_RATE = atof(optarg); break;
+        case 'C': cm730.CORRUPT_RATE = atof(optarg); break;
+        case 'T': cm730.TIMEOUT_RATE = atof(optarg); break;
+        case 's': cm730.SetSeed((unsigned int)strtoul(optarg, 0, 0)); break;
+        case 'x': unplug = optarg; break;
+        default:
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(cm730.SetBaud(baud) == false)
+    {
+        fprintf(stderr, "Invalid baud rate %d\n", baud);
+        return 1;
+    }
+
+    // the register is in 2 usec units
+    cm730.SetByte(CM730::ID_CM, CM730::P_RETURN_DELAY_TIME, return_delay / 2);
+    for(int id = 1; id < JointData::NUMBER_OF_JOINTS; id++)
+        cm730.SetByte(id, MX28::P_RETURN_DELAY_TIME, return_delay / 2);
+
+    for(char *id = (unplug != 0) ? strtok(unplug, ",") : 0; id != 0; id = strtok(0, ","))
+        cm730.SetPresent(atoi(id), false);
+
+    FILE *trace = 0;
+    if(trace_name != 0 && (trace = fopen(trace_name, "w")) == 0)
+    {
+        fprintf(stderr, "Fail to open %s: %s\n", trace_name, strerror(errno));
+        return 1;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        fprintf(stderr, "Fail to create a pseudo-terminal: %s\n", strerror(errno));
+        return 1;
+    }
+
+    // raw bytes both ways until the client sets the port up itself
+    struct termios tio;
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+
+    // keep the slave side open, the master reports a hang up while no one has it open
+    const char *slave_name = ptsname(master);
+    int slave = open(slave_name, O_RDWR | O_NOCTTY);
+
+    unlink(link_name);
+    if(symlink(slave_name, link_name) != 0)
+    {
+        fprintf(stderr, "Fail to link %s to %s: %s\n", link_name, slave_name, strerror(errno));
+        return 1;
+    }
+
+    signal(SIGINT, SignalHandler);
+    signal(SIGTERM, SignalHandler);
+
+    cm730.OpenPort();
+    fprintf(stderr, "CM-730 emulator on %s (%s), %d bps\n", link_name, slave_name, baud);
+
+    unsigned char buffer[MAXNUM_RXPARAM + 10];
+    while(g_Quit == 0)
+    {
+        // sleep until the next status byte is due or the client writes
+        struct pollfd pfd;
+        pfd.fd = master;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        struct timespec timeout, *ptimeout = 0;
+        double next = cm730.GetNextRxTime();
+        if(next >= 0.0)
+        {
+            double wait = next - cm730.GetTime();
+            if(wait < 0.0)
+                wait = 0.0;
+            timeout.tv_sec = (time_t)(wait / 1000.0);
+            timeout.tv_nsec = (long)((wait - timeout.tv_sec * 1000.0) * 1000000.0);
+            ptimeout = &timeout;
+        }
+
+        if(ppoll(&pfd, 1, ptimeout, 0) < 0 && errno != EINTR)
+            break;
+
+        if(pfd.revents & POLLIN)
+        {
+            int length = read(master, buffer, sizeof(buffer));
+            if(length > 0)
+            {
+                Trace(trace, cm730.GetTime(), "TX", buffer, length);
+                cm730.WritePort(buffer, length);
+            }
+        }
+
+        int length = cm730.ReadPort(buffer, sizeof(buffer));
+        if(length > 0)
+        {
+            Trace(trace, cm730.GetTime(), "RX", buffer, length);
+            if(write(master, buffer, length) != length)
+                fprintf(stderr, "Fail to write %d bytes\n", length);
+        }
+    }
+
+    fprintf(stderr, "%d instructions, %d faults\n", cm730.GetInstructionCount(), cm730.GetFaultCount());
+
+    unlink(link_name);
+    if(trace != 0)
+        fclose(trace);
+    close(slave);
+    close(master);
+
+    return 0;
+}
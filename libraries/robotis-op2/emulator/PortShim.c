@@ -0,0 +1,97 @@
+/*
+ *   PortShim.c
+ *   Preloaded into an unmodified program that uses LinuxCM730, so that it can
+ *   open the emulator's pseudo-terminal:
+ *   - opening /dev/ttyUSB* opens $CM730_PORT instead, when it is set
+ *   - TIOCGSERIAL / TIOCSSERIAL, which LinuxCM730 needs for the 1 Mbps divisor,
+ *     succeed on a terminal that does not support them (the rate is the emulator's)
+ *
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+
+static const char *PortName(const char *path)
+{
+    const char *port = getenv("CM730_PORT");
+
+    if(port != 0 && strncmp(path, "/dev/ttyUSB", 11) == 0)
+        return port;
+    return path;
+}
+
+int open(const char *path, int flags, ...)
+{
+    static int (*real_open)(const char *, int, ...) = 0;
+    mode_t mode = 0;
+
+    if(real_open == 0)
+        real_open = (int (*)(const char *, int, ...))dlsym(RTLD_NEXT, "open");
+
+    if(flags & O_CREAT)
+    {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+
+    return real_open(PortName(path), flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+    static int (*real_open64)(const char *, int, ...) = 0;
+    mode_t mode = 0;
+
+    if(real_open64 == 0)
+        real_open64 = (int (*)(const char *, int, ...))dlsym(RTLD_NEXT, "open64");
+
+    if(flags & O_CREAT)
+    {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+
+    return real_open64(PortName(path), flags, mode);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    static int (*real_ioctl)(int, unsigned long, ...) = 0;
+    void *arg;
+    int res;
+
+    if(real_ioctl == 0)
+        real_ioctl = (int (*)(int, unsigned long, ...))dlsym(RTLD_NEXT, "ioctl");
+
+    va_list args;
+    va_start(args, request);
+    arg = va_arg(args, void *);
+    va_end(args);
+
+    res = real_ioctl(fd, request, arg);
+    if(res < 0 && errno == ENOTTY)
+    {
+        if(request == TIOCGSERIAL)
+        {
+            memset(arg, 0, sizeof(struct serial_struct));
+            ((struct serial_struct *)arg)->baud_base = 1000000;
+            return 0;
+        }
+        if(request == TIOCSSERIAL)
+            return 0;
+    }
+
+    return res;
+}
@@ -9,6 +9,7 @@
 #define _ACTION_MODULE_H_
 
 #include <stdio.h>
+#include <vector>
 #include "MotionModule.h"
 #include "JointData.h"
 
@@ -72,10 +73,65 @@ namespace Robot
 		} PAGE;
 
 	private:
+		enum
+		{
+			NAME_INDEX_SIZE = 512,	// power of 2, twice the number of pages
+			MAXNUM_KEYFRAME = 4096	// about 32 s of motion
+		};
+
+		enum { PRE_SECTION, MAIN_SECTION, POST_SECTION, PAUSE_SECTION };
+		enum { ZERO_FINISH, NONE_ZERO_FINISH };
+
+		typedef struct // Everything Process() carries from one tick to the next
+		{
+			const PAGE *play_page;
+			const PAGE *next_play_page;
+			int index_playing_page;
+			int page_step_count;
+			bool playing;
+			bool first_driving_start;
+			bool stop_playing;
+			bool playing_finished;
+			unsigned short start_angle1024[JointData::NUMBER_OF_JOINTS];
+			unsigned short target_angle1024[JointData::NUMBER_OF_JOINTS];
+			short int moving_angle1024[JointData::NUMBER_OF_JOINTS];
+			short int main_angle1024[JointData::NUMBER_OF_JOINTS];
+			short int accel_angle1024[JointData::NUMBER_OF_JOINTS];
+			short int main_speed1024[JointData::NUMBER_OF_JOINTS];
+			short int last_out_speed1024[JointData::NUMBER_OF_JOINTS];
+			short int goal_speed1024[JointData::NUMBER_OF_JOINTS];
+			unsigned char finish_type[JointData::NUMBER_OF_JOINTS];
+			unsigned short unit_time_count;
+			unsigned short unit_time_num;
+			unsigned short pause_time;
+			unsigned short unit_time_total_num;
+			unsigned short accel_step;
+			unsigned char section;
+			unsigned char play_repeat_count;
+			unsigned short next_play_page_index;
+			int value[JointData::NUMBER_OF_JOINTS];
+			int p_gain[JointData::NUMBER_OF_JOINTS];
+		} PLAYSTATE;
+
+		typedef struct // One tick of a compiled page chain
+		{
+			int value[JointData::NUMBER_OF_JOINTS];
+			int p_gain[JointData::NUMBER_OF_JOINTS];
+			short int speed1024[JointData::NUMBER_OF_JOINTS];	// 0 in a pause
+			int page;
+			int step;
+			int checkpoint;		// index in m_Checkpoints if the next page is picked on this tick, -1 otherwise
+		} KEYFRAME;
+
 		static Action* m_UniqueInstance;
 		FILE* m_ActionFile;
-		PAGE m_PlayPage;
-		PAGE m_NextPlayPage;
+		PAGE *m_PageData;			// the whole action file, read in memory
+		const PAGE *m_PageTable[MAXNUM_PAGE];	// checksum verified pages, m_EmptyPage for the others
+		PAGE m_EmptyPage;
+		unsigned char m_NameIndex[NAME_INDEX_SIZE];	// page index by name hash, 0 for a free slot
+		PAGE m_StartPage;			// copy of the page given to Start(index, pPage)
+		const PAGE *m_PlayPage;
+		const PAGE *m_NextPlayPage;
 		STEP m_CurrentStep;
 
 		int m_IndexPlayingPage;
@@ -84,15 +140,66 @@ namespace Robot
 		bool m_Playing;
 		bool m_StopPlaying;
 		bool m_PlayingFinished;
-		
-		Action();
 
-		bool VerifyChecksum( PAGE *pPage );
+		// interpolation state of Process(), per joint and for the page being played
+		unsigned short m_StartAngle1024[JointData::NUMBER_OF_JOINTS];
+		unsigned short m_TargetAngle1024[JointData::NUMBER_OF_JOINTS];
+		short int m_MovingAngle1024[JointData::NUMBER_OF_JOINTS];
+		short int m_MainAngle1024[JointData::NUMBER_OF_JOINTS];
+		short int m_AccelAngle1024[JointData::NUMBER_OF_JOINTS];
+		short int m_MainSpeed1024[JointData::NUMBER_OF_JOINTS];
+		short int m_LastOutSpeed1024[JointData::NUMBER_OF_JOINTS];
+		short int m_GoalSpeed1024[JointData::NUMBER_OF_JOINTS];
+		unsigned char m_FinishType[JointData::NUMBER_OF_JOINTS];
+		unsigned short m_UnitTimeCount;
+		unsigned short m_UnitTimeNum;
+		unsigned short m_PauseTime;
+		unsigned short m_UnitTimeTotalNum;
+		unsigned short m_AccelStep;
+		unsigned char m_Section;
+		unsigned char m_PlayRepeatCount;
+		unsigned short m_NextPlayPageIndex;
+
+		// The page chain compiled by Start(): Process() plays m_Keyframes instead of running
+		// the interpolation, and only goes back to it to follow an exit link after Stop()
+		std::vector<KEYFRAME> m_Keyframes;
+		std::vector<PLAYSTATE> m_Checkpoints;	// state before the ticks picking the next page
+		PLAYSTATE m_EndState;		// state after the last keyframe
+		int m_KeyframeIndex;		// next keyframe to play, -1 when interpreting
+		int m_LoopKeyframe;			// where the chain cycles back to, -1 if it does not
+		unsigned int m_CompiledMask;
+		int m_CompiledPose[JointData::NUMBER_OF_JOINTS];
+
+		// Pages asked for while playing. They are set from any thread and taken by
+		// Process() between two ticks with an atomic exchange, so none is lost.
+		volatile int m_QueuedPage;	// played when the chain ends, 0 for none
+		volatile int m_PreemptPage;	// played from the current pose and speed, 0 for none
+		unsigned short m_BlendTicks;	// duration of the first step of a preempting page, motion thread only
+
+		bool VerifyChecksum( const PAGE *pPage );
 		void SetChecksum( PAGE *pPage );		
+		bool OpenPages( FILE *file );
+		void ClosePages();
+		void BuildPageTable();
+		void BuildNameIndex();
+		bool StartPage(int index, const PAGE *pPage);
+		void SaveState(PLAYSTATE *pState);
+		void RestoreState(const PLAYSTATE *pState);
+		bool Compile(int index, const PAGE *pPage);
+		void PlayKeyframe();
+		void TakePreemptPage(int index);
+		void Interpret();
+		bool CheckRequest(int iPage);
 		
 	public:
 		bool DEBUG_PRINT;
+		// Compile the page chain when it starts. It is compiled from the enabled joints and the
+		// current pose at Start(): if they change before the first Process(), the chain is
+		// interpreted instead, which gives the same joints, only without the speedup.
+		bool COMPILE_ENABLE;
+		double BLEND_TIME;		// msec, time a preempting page takes to reach its first step, 0 for the step time
 		
+		Action();
 		~Action();
 
 		static Action* GetInstance() { return m_UniqueInstance; }
@@ -104,12 +211,20 @@ namespace Robot
 		bool Start(int iPage);
 		bool Start(char* namePage);
 		bool Start(int index, PAGE *pPage);
+		// While a page is playing, Queue() plays iPage in place of the end of the chain
+		// and Preempt() switches to iPage on the next tick without stopping the joints.
+		// Both start iPage right away when nothing is playing.
+		bool Queue(int iPage);
+		bool Preempt(int iPage);
 		void Stop();
 		void Brake();
 		bool IsRunning();
 		bool IsRunning(int *iPage, int *iStep);
+		bool IsCompiled()	{ return m_KeyframeIndex >= 0; }	// the next tick comes from the compiled chain
 		bool LoadPage(int index, PAGE *pPage);
-		bool SavePage(int index, PAGE *pPage);
+		bool SavePage(int index, PAGE *pPage);	// fails while a page is playing
+		const PAGE *GetPage(int index);	// no copy, valid until the next LoadFile()/CreateFile()
+		int FindPage(const char *namePage);	// -1 if no page has this name
 		void ResetPage(PAGE *pPage);
 	};
 }
@@ -9,12 +9,15 @@
 #define _CM_730_H_
 
 #include "MX28.h"
+#include "JointData.h"
 
 #define MAXNUM_TXPARAM      (256)
 #define MAXNUM_RXPARAM      (1024)
 
 namespace Robot
 {
+    class CM730Async;
+
     class BulkReadData
     {
     public:
@@ -22,12 +25,79 @@ namespace Robot
         int length;
         int error;
         unsigned char table[MX28::MAXNUM_ADDRESS];
+        // BulkRead that last received each register, 0 if none did: the registers are kept
+        // between reads of different rates, the sequence tells how old they are
+        unsigned int sequence[MX28::MAXNUM_ADDRESS];
 
         BulkReadData();
         virtual ~BulkReadData() {}
 
         int ReadByte(int address);
         int ReadWord(int address);
+        unsigned int GetSequence(int address, int length);  // of the oldest of the bytes, 0 if one never came
+    };
+
+/*
+BulkReadParser
+
+Incremental Dynamixel 1.0 status packet decoder used by BulkRead.
+Bytes are fed as they come off the port; every complete packet with a valid checksum is
+written to its BulkReadData entry right away. A corrupt one is dropped and its bytes are
+scanned again from the one after its first header byte, so that a packet whose header it
+swallowed (a byte dropped in the corrupt one) is not lost.
+*/
+    class BulkReadParser
+    {
+    private:
+        enum
+        {
+            HEADER_0,
+            HEADER_1,
+            PACKET_ID,
+            PACKET_LENGTH,
+            PACKET_ERRBIT,
+            PACKET_PARAMETER,
+            PACKET_CHECKSUM
+        };
+
+        BulkReadData *m_Data;
+        unsigned int m_Sequence;
+        bool m_Pending[256];
+        int m_Remaining;
+        int m_Corrupt;
+
+        int m_State;
+        int m_ID;
+        int m_Length;
+        int m_Count;
+        int m_ErrBit;
+        unsigned char m_Checksum;
+        unsigned char m_Packet[MX28::MAXNUM_ADDRESS + 6];  // the bytes from the header on
+        int m_PacketLength;
+
+        bool Step(unsigned char data);  // false on a corrupt packet
+
+    public:
+        // The registers decoded are stamped with sequence, not 0
+        BulkReadParser(BulkReadData *data, unsigned int sequence);
+
+        // The id must already have its start_address and length set
+        void Expect(int id);
+        void Parse(unsigned char *buffer, int length);
+
+        int GetRemaining()  { return m_Remaining; }
+        int GetCorrupt()    { return m_Corrupt; }
+    };
+
+    // Where a caller of BulkRead is in the multi-rate schedule. Every thread that sends
+    // BulkReads keeps its own: CM730 one for BulkRead(), CM730Async one for its transactions.
+    class BulkReadSchedule
+    {
+    public:
+        unsigned int tick;
+        int slow_cursor;    // first servo in line for the slow registers
+
+        BulkReadSchedule() : tick(0), slow_cursor(1) {}
     };
 
 
@@ -67,10 +137,16 @@ For instance, LinuxCM730 is a concretisation of this class.
 
 		virtual void Sleep(double msec) = 0;
 		//////////////////////////////////////////////////////////////////////////////
+
+		// Optional: block until the port has data to read or the packet timeout expires.
+		// The default returns at once, which makes TxRxPacket poll the port.
+		virtual void WaitPort() {}
 	};
 
 	class CM730
 	{
+		friend class CM730Async;
+
 	public:
 		enum
 		{
@@ -164,15 +240,59 @@ For instance, LinuxCM730 is a concretisation of this class.
 			ID_BROADCAST				= 254
 		};
 
+		// MX28 register groups a BulkRead can fetch, see SetBulkReadRegisters()
+		enum
+		{
+			READ_POSITION			= 1,	// P_PRESENT_POSITION_L/H
+			READ_SPEED				= 2,	// P_PRESENT_SPEED_L/H
+			READ_LOAD				= 4,	// P_PRESENT_LOAD_L/H
+			READ_VOLTAGE			= 8,	// P_PRESENT_VOLTAGE
+			READ_TEMPERATURE		= 16,	// P_PRESENT_TEMPERATURE
+			NUMBER_OF_READ_GROUPS	= 5
+		};
+
+		// Rate of a register group: read every n-th BulkRead, or round-robin within the slow byte budget
+		enum
+		{
+			RATE_SLOW				= 0,
+			RATE_EVERY_TICK			= 1
+		};
+
 	private:
 		PlatformCM730 *m_Platform;
+		CM730Async * volatile m_Bus;	// bus owner thread, set while it runs
 		static const int RefreshTime = 6; //msec
 		unsigned char m_ControlTable[MAXNUM_ADDRESS];
 
-		unsigned char m_BulkReadTxPacket[MAXNUM_TXPARAM + 10];
+		unsigned char m_BulkReadTxPacket[MAXNUM_TXPARAM + 10];	// as made by MakeBulkReadPacket(), 0 length before
+
+		// BulkRead plan: devices found by MakeBulkReadPacket() and the registers wanted per joint
+		bool m_BulkReadCM;
+		bool m_BulkReadLeftFSR;
+		bool m_BulkReadRightFSR;
+		int m_BulkReadRegisters[JointData::NUMBER_OF_JOINTS];
+		int m_BulkReadDefault;
+		JointData *m_BulkReadJoints;
+
+		// Multi-rate schedule, each BulkRead is planned in the caller's packet
+		int m_BulkReadRate[NUMBER_OF_READ_GROUPS];
+		BulkReadSchedule m_BulkReadSchedule;	// of BulkRead()
+		int m_BulkReadSlowBytes;
+		unsigned int m_BulkReadSequence;	// of the last BulkRead, 0 before the first one
+		volatile unsigned int m_DirectWriteCount;
+
+		void PlanBulkReadPacket(unsigned char *txpacket, BulkReadSchedule *schedule);
+		static void GetBulkReadWindow(int registers, int *start_addr, int *length);
 
 		int TxRxPacket(unsigned char *txpacket, unsigned char *rxpacket, int priority);
-		unsigned char CalculateChecksum(unsigned char *packet);
+		int TransferPacket(unsigned char *txpacket, unsigned char *rxpacket);
+		void GetPacketLength(unsigned char *txpacket, int *tx_length, int *rx_length);	// rx: expected status bytes
+
+		// Packet helpers shared by the blocking calls and CM730Async
+		void MakeSyncWritePacket(unsigned char *txpacket, int start_addr, int each_length, int number, int *pParam);
+		void MakeReadPacket(unsigned char *txpacket, int id, int start_addr, int length);
+		void GetReadData(unsigned char *rxpacket, int start_addr, int length, unsigned char *table, int *error);
+		bool GetBulkReadPacket(unsigned char *txpacket, BulkReadSchedule *schedule);
 
 	public:
 		bool DEBUG_PRINT;
@@ -208,14 +328,39 @@ For instance, LinuxCM730 is a concretisation of this class.
 		void MakeBulkReadPacket();
 		int BulkRead();
 
+		// Registers read for one joint on top of the default set used for the joints enabled
+		// in SetBulkReadJoints(), MotionStatus::m_CurrentJoints unless the MotionManager driving
+		// this CM730 has a state of its own. Each servo is read as the smallest address window
+		// covering the registers due in the current tick.
+		void SetBulkReadRegisters(int id, int registers);
+		void SetBulkReadDefaultRegisters(int registers);
+		void SetBulkReadJoints(JointData *joints)	{ m_BulkReadJoints = joints; }
+
+		// Position and speed are read every tick, load every 2nd tick and voltage/temperature
+		// round-robin: the RATE_SLOW groups never add more than SetBulkReadSlowBytes() bytes
+		// to a single BulkRead. The alarm bits come for free in every status packet error byte.
+		void SetBulkReadRate(int registers, int rate);
+		void SetBulkReadSlowBytes(int bytes)	{ m_BulkReadSlowBytes = bytes; }
+
+		// BulkReads since the length bytes at address of id were last received: 0 if by the last
+		// BulkRead, -1 if never. A register that stops coming keeps its value in m_BulkReadData.
+		unsigned int GetBulkReadSequence()		{ return m_BulkReadSequence; }
+		int GetBulkReadAge(int id, int address, int length);
+
+		// Writes, register writes and resets sent to a servo or broadcast so far. A SyncWriteCache
+		// given this CM730 forgets everything when it changes.
+		unsigned int GetDirectWriteCount()		{ return m_DirectWriteCount; }
+
 		// Utility
 		static int MakeWord(int lowbyte, int highbyte);
 		static int GetLowByte(int word);
 		static int GetHighByte(int word);
 		static int MakeColor(int red, int green, int blue);
+		static unsigned char CalculateChecksum(unsigned char *packet);	// of a Dynamixel 1.0 packet
 
 		// ***   WEBOTS PART  *** //
 
+		// CM730 from P_DXL_POWER, then 6 bytes from P_PRESENT_POSITION_L of each joint, every BulkRead
 		void MakeBulkReadPacketWb();
 	};
 }
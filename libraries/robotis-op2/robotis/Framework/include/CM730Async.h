@@ -0,0 +1,143 @@
+/*
+ *   CM730Async.h
+ *   Queues CM730 transactions and runs them on a dedicated bus I/O thread,
+ *   so the caller can keep computing while a packet is on the wire.
+ *
+ */
+
+#ifndef _CM_730_ASYNC_H_
+#define _CM_730_ASYNC_H_
+
+#include <pthread.h>
+#include <semaphore.h>
+#include "CM730.h"
+
+namespace Robot
+{
+	class CM730Async;
+
+	/*
+	A CM730Transaction is owned by the caller and must stay alive until it is done.
+	It can be reused as soon as IsDone() returns true.
+	*/
+	class CM730Transaction
+	{
+		friend class CM730Async;
+
+	public:
+		enum
+		{
+			SYNC_WRITE,
+			BULK_READ,
+			READ,
+			PACKET		// any packet built by CM730, see CM730Async::Execute()
+		};
+
+		typedef void (*Callback)(CM730Transaction *transaction, void *param);
+
+		int type;
+		int priority;
+		int result;	// CM730::SUCCESS, CM730::TX_FAIL, ...
+		int error;	// error byte of the status packet (READ only)
+
+		// READ only: received bytes are copied to table[start_address ...]
+		int start_address;
+		int length;
+		unsigned char *table;
+
+		// called from the I/O thread once the transaction is complete
+		Callback callback;
+		void *param;
+
+		unsigned char txpacket[MAXNUM_TXPARAM + 10];
+		unsigned char rxpacket[MAXNUM_RXPARAM + 10];
+
+		CM730Transaction();
+
+		bool IsDone();
+		int Wait();	// blocks until done and returns the result
+
+	private:
+		CM730Async *m_Owner;
+		CM730Transaction * volatile m_Next;
+		volatile bool m_Done;
+	};
+
+	/*
+	While it runs, the I/O thread is the only one talking to the CM730: every blocking
+	CM730 call made from another thread is queued too (see CM730::TxRxPacket()).
+	There is one lock-free multi-producer queue per priority, 0 being the motion traffic.
+	A queued transaction of priority 0 always goes first; the others only go out in the
+	gap before the next motion frame when SetFramePeriod() is set.
+	*/
+	class CM730Async
+	{
+		friend class CM730Transaction;
+
+	public:
+		enum
+		{
+			PRIORITY_MOTION,	// SyncWrite and BulkRead of the motion loop
+			PRIORITY_READ,		// ReadTable()
+			PRIORITY_USER,		// any other blocking CM730 call
+			NUMBER_OF_PRIORITIES
+		};
+
+	private:
+		CM730 *m_CM730;
+		BulkReadSchedule m_BulkReadSchedule;	// of the BulkRead transactions
+		pthread_t m_Thread;
+		pthread_mutex_t m_Mutex;	// only guards the completion of a transaction
+		pthread_cond_t m_DoneCond;	// broadcast when a transaction completes
+		sem_t m_QueueSem;			// posted when a transaction is queued, once until the I/O thread looks
+		volatile int m_WakePosted;	// 1 while a post of m_QueueSem is not looked at
+
+		// Producers exchange m_Head, the I/O thread alone pops from m_Tail
+		CM730Transaction * volatile m_Head[NUMBER_OF_PRIORITIES];
+		CM730Transaction *m_Tail[NUMBER_OF_PRIORITIES];
+		CM730Transaction m_Stub[NUMBER_OF_PRIORITIES];
+		CM730Transaction *m_Deferred;	// popped but waiting for a gap
+
+		volatile int m_Submitting;
+		volatile bool m_Running;
+		volatile bool m_Finish;
+
+		double m_FramePeriod;
+		double m_FrameTime;
+
+		static void *ThreadProc(void *param);
+		static double GetTime();
+
+		void Push(int priority, CM730Transaction *transaction);
+		CM730Transaction *Pop(int priority);
+		double GetGapWait(CM730Transaction *transaction);
+		void Complete(CM730Transaction *transaction, int result);
+
+	public:
+		bool DEBUG_PRINT;
+
+		CM730Async(CM730 *cm730);
+		~CM730Async();
+
+		bool Start();
+		void Stop();
+		bool IsRunning()	{ return m_Running; }
+		bool IsOwnerThread();
+
+		// Period of the motion loop in msec, 0 lets the other priorities go at any time
+		void SetFramePeriod(double msec)	{ m_FramePeriod = msec; }
+
+		// Queue a transaction built by one of the methods below.
+		// Returns false if the engine is stopped or the transaction is still pending.
+		bool Submit(CM730Transaction *transaction);
+
+		bool SyncWrite(CM730Transaction *transaction, int start_addr, int each_length, int number, int *pParam);
+		bool BulkRead(CM730Transaction *transaction);
+		bool ReadTable(CM730Transaction *transaction, int id, int start_addr, int end_addr, unsigned char *table);
+
+		// Queue a packet and wait for it, used by CM730 for the calls made outside the I/O thread
+		int Execute(unsigned char *txpacket, unsigned char *rxpacket, int priority);
+	};
+}
+
+#endif
@@ -10,6 +10,7 @@
 #define COLORFINDER_H_
 
 #include <string>
+#include <vector>
 
 #include "Point.h"
 #include "Image.h"
@@ -20,15 +21,81 @@
 
 namespace Robot
 {
-
-
+    class ColorTable;
+
+	/*
+	A set of pixels of a mask connected through their 8 neighbours
+	*/
+	struct Blob
+	{
+		int area;                       /* pixels */
+		int left, top, right, bottom;   /* bounding box, inclusive */
+		double x, y;                    /* center */
+		double xx, yy, xy;              /* second moments of the pixels about the center, per pixel */
+		double score;                   /* 0 ~ 1, 1 for a filled disc, lower for an elongated or hollow shape */
+	};
+
+	/*
+	Labels the blobs of a packed mask given row by row from the top in a single pass:
+	the runs of a row join the labels of the runs they touch in the row above (union-find)
+	and the moments are summed per label, then merged per blob by Finish.
+	*/
+	class BlobFinder
+	{
+	public:
+		static const int MAXNUM_BLOBS = 16;
+
+	private:
+		struct Run { int start, end, label; };   /* pixels start to end - 1 */
+		struct Sums { double n, x, y, xx, yy, xy; int left, top, right, bottom; };
+
+		int m_Width;
+		std::vector<Run> m_Runs;           /* of the last row */
+		std::vector<Run> m_PreviousRuns;   /* of the row above it */
+		std::vector<int> m_Parents;
+		std::vector<Sums> m_Sums;
+
+		int Find(int label);
+		int Union(int label1, int label2);
+
+	public:
+		BlobFinder();
+
+		void Start(int width);
+
+		/* row y of the mask, as ImgProcess::PackMask gives it */
+		void AddRow(const unsigned long long* bits, int y);
+
+		/* blobs receives up to MAXNUM_BLOBS blobs of more than min_area and at most max_area pixels, ball first:
+		   the highest area * score */
+		void Finish(std::vector<Blob>& blobs, double min_area, double max_area);
+	};
 
     class ColorFinder
     {
     private:
+        friend class ColorTable;
+
         Point2D m_center_point;
 
+        int m_row_width;                     /* scratch rows of GetPositionBGRA */
+        unsigned char* m_hsv_row;
+        unsigned long long* m_mask_rows;     /* the last 3 rows of the mask, packed */
+        unsigned long long* m_erosion_rows;  /* the last 3 rows of its erosion, packed */
+        unsigned char* m_temp_row;
+        unsigned long long* m_temp_bits;
+
+        unsigned long long* m_mask_bits;     /* the packed mask of GetPosition, then the scratch of its morphology */
+        int m_mask_bits_size;
+
+        ColorTable* m_table;            /* of this color only, for m_table_bits */
+        BlobFinder m_blob_finder;
+
         void Filtering(Image* img);
+        void HueRange(int &h_min, int &h_max);
+        bool IsInRange(const unsigned char* hsv, int h_min, int h_max);
+        void AllocateRows(int width);
+        void SetCenter(int sum_x, int sum_y, int count, int pixels);
 
     public:
         int m_hue;             /* 0 ~ 360 */
@@ -40,6 +107,11 @@ namespace Robot
         double m_min_percent;  /* 0.0 ~ 100.0 */
         double m_max_percent;  /* 0.0 ~ 100.0 */
 
+        int m_table_bits;      /* 0: HSV test, 4 ~ 8: GetPositionBGRA looks the pixels up in a ColorTable of that many bits per channel */
+        bool m_find_blobs;     /* false: the center of all the pixels found, true: the center of the first blob of m_blobs */
+
+        std::vector<Blob> m_blobs;  /* of the last image, when m_find_blobs */
+
         std::string color_section; /*TODO: ?*/
 
         Image*  m_result;
@@ -71,10 +143,67 @@ namespace Robot
 		/*
 		input: an image hsv_img
 		output: the average point where the color is found, or (-1, -1) if the color is not found 
-		effects: modify m_result via Filtering
+		        (with m_find_blobs, the center of the blob most like a ball)
+		effects: modify m_result via Filtering, and m_blobs
 		*/
 		Point2D& GetPosition(Image* hsv_img);
+
+// ***   WEBOTS PART  *** //
+
+		/*
+		input: a BGRA image bgra_img
+		output: the same point as GetPosition on the HSV version of bgra_img
+		effects: none on m_result, the image is read once, row by row, without an HSV frame; modify m_blobs
+		*/
+		Point2D& GetPositionBGRA(Image* bgra_img);
     };
+
+
+
+	/*
+	A color cube quantized to m_Bits bits per channel, giving the classes of a pixel in
+	one lookup: bit k of an entry is set if the center of its cell is of the k-th color added.
+	The entries are computed again when a parameter of one of the ColorFinder has changed.
+	*/
+	class ColorTable
+	{
+	public:
+		static const int MAXNUM_CLASSES = 8;
+
+	private:
+		int m_Bits;
+		unsigned char* m_Table;
+		int m_NumberOfClasses;
+		bool m_IsUpToDate;                     /* false until the entries of the last class added are computed */
+		ColorFinder* m_Finders[MAXNUM_CLASSES];
+		int m_Parameters[MAXNUM_CLASSES][6];   /* of each ColorFinder when the entries were computed */
+
+	public:
+		ColorTable(int bits);
+		virtual ~ColorTable();
+
+		int GetBits() { return m_Bits; }
+
+		/* returns the class number of the color, -1 if there are MAXNUM_CLASSES already */
+		int AddClass(ColorFinder* finder);
+
+		/* computes the entries if a color has changed, returns true if it did */
+		bool Update();
+
+		/* the classes of a pixel, Update must have been called */
+		unsigned char GetClasses(unsigned char r, unsigned char g, unsigned char b)
+		{
+			int shift = 8 - m_Bits;
+			return m_Table[((r >> shift) << (2 * m_Bits)) | ((g >> shift) << m_Bits) | (b >> shift)];
+		}
+
+		/*
+		input: an RGB (3 bytes per pixel) or BGRA (4 bytes per pixel) image img
+		effects: classes, of 1 byte per pixel, receives the classes of each pixel of img
+		*/
+		void Classify(Image* img, Image* classes);
+		void Classify(const unsigned char* bgra, unsigned char* classes, int pixels);	// a run of BGRA pixels
+	};
 }
 
 #endif /* COLORFINDER_H_ */
@@ -0,0 +1,89 @@
+/*
+ *   GaitGenerator.h
+ *   Renders whole walking cycles offline, e.g. to evaluate many gait parameter sets.
+ *
+ */
+
+#ifndef _GAIT_GENERATOR_H_
+#define _GAIT_GENERATOR_H_
+
+#include <string>
+
+#include "minIni.h"
+#include "Walking.h"
+
+namespace Robot
+{
+	/*
+	The [Walking Config] fields and the walking command, with the same names and
+	meaning as in Walking. The default values are the ones of Walking.
+	*/
+	class GaitParameters
+	{
+	public:
+		double X_OFFSET;
+		double Y_OFFSET;
+		double Z_OFFSET;
+		double A_OFFSET;
+		double P_OFFSET;
+		double R_OFFSET;
+		double HIP_PITCH_OFFSET;
+
+		double PERIOD_TIME;
+		double DSP_RATIO;
+		double STEP_FB_RATIO;
+		double Z_MOVE_AMPLITUDE;
+		double Y_SWAP_AMPLITUDE;
+		double Z_SWAP_AMPLITUDE;
+		double PELVIS_OFFSET;
+		double ARM_SWING_GAIN;
+
+		double BALANCE_KNEE_GAIN;
+		double BALANCE_ANKLE_PITCH_GAIN;
+		double BALANCE_HIP_ROLL_GAIN;
+		double BALANCE_ANKLE_ROLL_GAIN;
+
+		int    P_GAIN;
+		int    I_GAIN;
+		int    D_GAIN;
+
+		double X_MOVE_AMPLITUDE;
+		double Y_MOVE_AMPLITUDE;
+		double A_MOVE_AMPLITUDE;
+		bool   A_MOVE_AIM_ON;
+
+		GaitParameters();
+
+		void Get(const Walking *walking);	// copy the parameters of a walking engine
+		void Set(Walking *walking) const;	// and the other way around
+
+		void LoadINISettings(minIni* ini);
+		void LoadINISettings(minIni* ini, const std::string &section);
+	};
+
+	/*
+	Each generator runs its own Walking engine, so generators can be used from
+	different threads at once. The robot starts from the stand pose like on the
+	real robot, so the first half period is the transition into the walk.
+	The balance control is off since there is no gyro.
+	*/
+	class GaitGenerator
+	{
+	private:
+		Walking m_Walking;
+
+	public:
+		GaitGenerator();
+		~GaitGenerator();
+
+		// Upper bound of the number of ticks (TIME_UNIT) that Render() writes for cycles periods
+		static int GetMaxTicks(const GaitParameters &param, int cycles);
+
+		// Renders cycles walking periods, one row of JointData::NUMBER_OF_JOINTS values
+		// (indexed by joint id, like JointData::GetValue()) per tick, at most max_ticks rows.
+		// Returns the number of rows written.
+		int Render(const GaitParameters &param, int cycles, int *buffer, int max_ticks);
+	};
+}
+
+#endif
@@ -40,12 +40,12 @@ namespace Robot
 		double m_PanAngle;
 		double m_TiltAngle;
 		
-		Head();
 		void CheckLimit();
 
 	public:
 		static Head* GetInstance() { return m_UniqueInstance; }
 		
+		Head();
 		~Head();
 
 		void Initialize();
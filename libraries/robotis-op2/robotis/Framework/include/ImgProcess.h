@@ -15,6 +15,18 @@ namespace Robot
 	class ImgProcess
 	{
 	public:
+		// kernels of the color conversions, the fastest one the CPU supports is used by default
+		enum
+		{
+			KERNEL_SCALAR,
+			KERNEL_SSE41,
+			KERNEL_AVX2,
+			KERNEL_NEON
+		};
+
+		static int GetKernel();
+		static bool SetKernel(int kernel);	// false if the CPU does not support it, every kernel gives the same bytes
+
 		static void YUVtoRGB(FrameBuffer *buf);
 		static void RGBtoHSV(FrameBuffer *buf);
 
@@ -23,12 +35,28 @@ namespace Robot
 		static void Dilation(Image* img);
         static void Dilation(Image* src, Image* dest);
 
+		// binary masks: a pixel not 0 is set, the result is 0 or 1
+		// square of size x size pixels, size/2 on each side, the border where it does not fit is 0
+		static void Erosion(Image* img, int size);
+		static void Dilation(Image* img, int size);
+
+		// masks packed 64 pixels per word, pixel x of a row is bit x%64 of its word x/64
+		static int GetMaskWords(int width) { return (width + 63) / 64; }
+		static void PackMask(const unsigned char *mask, unsigned long long *bits, int width);	// a row
+		static void UnpackMask(const unsigned long long *bits, unsigned char *mask, int width);	// a row, 0 or 1
+		static void ErosionRow(const unsigned long long *src, unsigned long long *dest, int width, int size);	// the horizontal pass
+		static void DilationRow(const unsigned long long *src, unsigned long long *dest, int width, int size);
+		// scratch is the caller's, as many words as bits: the same calls can run in several threads
+		static void Erosion(unsigned long long *bits, unsigned long long *scratch, int width, int height, int size);
+		static void Dilation(unsigned long long *bits, unsigned long long *scratch, int width, int height, int size);
+
         static void HFlipYUV(Image* img);
         static void VFlipYUV(Image* img);
 
 // ***   WEBOTS PART  *** //
 
 		static void BGRAtoHSV(FrameBuffer *buf);
+		static void BGRAtoHSV(const unsigned char *bgra, unsigned char *hsv, int pixels);	// a run of pixels, 4 bytes of HSV each
 	};
 }
 
@@ -8,9 +8,10 @@
 #ifndef _JOINT_DATA_H_
 #define _JOINT_DATA_H_
 
-
 namespace Robot
 {	
+	class MotionManager;
+
 	class JointData  
 	{
 	public:
@@ -47,10 +48,12 @@ namespace Robot
 		};
 
 	private:		
+		friend class MotionManager;
+		MotionManager *m_Manager;	// the manager the module is added to, 0 for the default one
 
 	protected:
-	/*the values*/
-		bool m_Enable[NUMBER_OF_JOINTS];
+	/*the values, one array per field so that the batch operations below run over contiguous memory*/
+		unsigned int m_EnableMask;	// bit id is set when joint id is enabled
 		int m_Value[NUMBER_OF_JOINTS];
 		double m_Angle[NUMBER_OF_JOINTS];
 		int m_PGain[NUMBER_OF_JOINTS];
@@ -83,6 +86,7 @@ namespace Robot
 		void SetEnableBody(bool enable);
 		void SetEnableBody(bool enable, bool exclusive);
 		bool GetEnable(int id);
+		unsigned int GetEnableMask()	{ return m_EnableMask; }
 
 		void SetValue(int id, int value);
 		int GetValue(int id);
@@ -100,6 +104,15 @@ namespace Robot
 		int  GetIGain(int id)            { return m_IGain[id]; }
 		void SetDGain(int id, int dgain) { m_DGain[id] = dgain; }
 		int  GetDGain(int id)            { return m_DGain[id]; }
+
+		/*batch operations*/
+		// Copy value, angle and gains of every joint enabled in joints (or only of those in mask),
+		// as SetValue() and the gain setters would
+		void Merge(JointData &joints);
+		void Merge(JointData &joints, unsigned int mask);
+		// SyncWrite parameters from P_D_GAIN (id, D, I, P, 0, goal L, goal H) of every enabled joint,
+		// offset[id] being added to the goal. Returns the number of joints written to param.
+		int MakeSyncWriteParam(int *param, int *offset);
 	};
 }
 
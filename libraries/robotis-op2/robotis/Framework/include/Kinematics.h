@@ -17,7 +17,6 @@ namespace Robot
 	{
 	private:
 		static Kinematics* m_UniqueInstance;
-		Kinematics();
 
 	protected:
 
@@ -67,6 +66,7 @@ namespace Robot
 		static const double CW_LIMIT_HEAD_TILT; // degree
 		static const double CCW_LIMIT_HEAD_TILT; // degree
 
+		Kinematics();
 		~Kinematics();
 
 		static Kinematics* GetInstance()			{ return m_UniqueInstance; }
@@ -0,0 +1,151 @@
+/*
+ *   LegIK.h
+ *   Closed-form inverse kinematics of the legs, used by the walking engine.
+ *
+ */
+
+#ifndef _LEG_IK_H_
+#define _LEG_IK_H_
+
+#include <math.h>
+#include "Kinematics.h"
+
+namespace Robot
+{
+	/*
+	A pose is the foot position (x, y, z in mm) and orientation (roll a, pitch b,
+	yaw c in rad) relative to the hip. The result is, in rad:
+	hip yaw, hip roll, hip pitch, knee, ankle pitch, ankle roll.
+
+	Same solution as the Matrix3D based Walking::computeIK() it replaces, but the
+	transforms are rigid: they are inverted by transposing the rotation, and the
+	sine and cosine of every angle are only computed once. Each step runs over
+	all the legs at a time so that the compiler can vectorize it.
+	*/
+	class LegIK
+	{
+	public:
+		enum
+		{
+			NUMBER_OF_LEGS = 2,
+			POSE_SIZE = 6
+		};
+
+		// pose and out hold NUMBER_OF_LEGS * POSE_SIZE values, the right leg first.
+		// Returns false if a foot is out of reach, out is then partly written.
+		static bool Compute(double *out, const double *pose)
+		{
+			return Solve(out, pose, NUMBER_OF_LEGS);
+		}
+
+		static bool Compute(double *out, double x, double y, double z, double a, double b, double c)
+		{
+			double pose[POSE_SIZE] = { x, y, z, a, b, c };
+			return Solve(out, pose, 1);
+		}
+
+	private:
+		static bool Solve(double *out, const double *pose, int legs)
+		{
+			const double THIGH = Kinematics::THIGH_LENGTH;
+			const double CALF = Kinematics::CALF_LENGTH;
+			const double ANKLE = Kinematics::ANKLE_LENGTH;
+			const double LEG = Kinematics::LEG_LENGTH;
+
+			double r0[NUMBER_OF_LEGS], r1[NUMBER_OF_LEGS], r2[NUMBER_OF_LEGS];
+			double r4[NUMBER_OF_LEGS], r5[NUMBER_OF_LEGS], r6[NUMBER_OF_LEGS];
+			double r9[NUMBER_OF_LEGS], r10[NUMBER_OF_LEGS];
+			double px[NUMBER_OF_LEGS], py[NUMBER_OF_LEGS], pz[NUMBER_OF_LEGS];
+			double vx[NUMBER_OF_LEGS], vy[NUMBER_OF_LEGS], vz[NUMBER_OF_LEGS];
+			double knee_c[NUMBER_OF_LEGS];
+			int i;
+
+			// Foot rotation (same convention as Matrix3D::SetTransform) and ankle position
+			for(i = 0; i < legs; i++)
+			{
+				const double *p = &pose[i * POSE_SIZE];
+				double sx = sin(p[3]), cx = cos(p[3]);
+				double sy = sin(p[4]), cy = cos(p[4]);
+				double sz = sin(p[5]), cz = cos(p[5]);
+
+				r0[i] = cz * cy;
+				r1[i] = cz * sy * sx - sz * cx;
+				r2[i] = cz * sy * cx + sz * sx;
+				r4[i] = sz * cy;
+				r5[i] = sz * sy * sx + cz * cx;
+				r6[i] = sz * sy * cx - cz * sx;
+				r9[i] = cy * sx;
+				r10[i] = cy * cx;
+
+				px[i] = p[0];
+				py[i] = p[1];
+				pz[i] = p[2] - LEG;
+				vx[i] = px[i] + r2[i] * ANKLE;
+				vy[i] = py[i] + r6[i] * ANKLE;
+				vz[i] = pz[i] + r10[i] * ANKLE;
+
+				knee_c[i] = (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i] - THIGH * THIGH - CALF * CALF) / (2 * THIGH * CALF);
+			}
+
+			// Knee
+			for(i = 0; i < legs; i++)
+			{
+				if(!(knee_c[i] >= -1.0 && knee_c[i] <= 1.0))
+					return false;
+			}
+
+			for(i = 0; i < legs; i++)
+			{
+				double *o = &out[i * POSE_SIZE];
+				double s, c, h;
+
+				o[3] = acos(knee_c[i]);
+				double knee_s = sqrt(1.0 - knee_c[i] * knee_c[i]);
+
+				// Ankle roll: the hip seen from the ankle, R^T * -p
+				double hy = -(r1[i] * px[i] + r5[i] * py[i] + r9[i] * pz[i]);
+				double hz = -(r2[i] * px[i] + r6[i] * py[i] + r10[i] * pz[i]) - ANKLE;
+				h = sqrt(hy * hy + hz * hz);
+				o[5] = atan2(hy, hz);
+				s = (h > 0) ? hy / h : 0;
+				c = (h > 0) ? hz / h : 1;
+
+				// Hip rotation = foot rotation * ankle roll^T. Matrix3D::operator*() starts from
+				// the identity, so the old solver saw 1 added to the diagonal; the gait is tuned with it.
+				double m0 = r0[i] + 1;
+				double m1 = r1[i] * c - r2[i] * s;
+				double m2 = r1[i] * s + r2[i] * c;
+				double m5 = r5[i] * c - r6[i] * s + 1;
+				double m6 = r5[i] * s + r6[i] * c;
+				double m9 = r9[i] * c - r10[i] * s;
+
+				// Hip yaw
+				double yaw_h = sqrt(m1 * m1 + m5 * m5);
+				o[0] = atan2(-m1, m5);
+				double yaw_s = (yaw_h > 0) ? -m1 / yaw_h : 0;
+				double yaw_c = (yaw_h > 0) ? m5 / yaw_h : 1;
+
+				// Hip roll, -m1 * sin(yaw) + m5 * cos(yaw) is yaw_h
+				o[1] = atan2(m9, yaw_h);
+				h = sqrt(m9 * m9 + yaw_h * yaw_h);
+				double roll_s = (h > 0) ? m9 / h : 0;
+				double roll_c = (h > 0) ? yaw_h / h : 1;
+
+				// Hip pitch and ankle pitch
+				double theta = atan2(m2 * yaw_c + m6 * yaw_s, m0 * yaw_c + r4[i] * yaw_s);
+				double k = knee_s * CALF;
+				double l = -THIGH - knee_c[i] * CALF;
+				double m = yaw_c * vx[i] + yaw_s * vy[i];
+				double n = roll_c * vz[i] + yaw_s * roll_s * vx[i] - yaw_c * roll_s * vy[i];
+				s = (k * n + l * m) / (k * k + l * l);
+				c = (n - k * s) / l;
+				o[2] = atan2(s, c);
+				o[4] = theta - o[3] - o[2];
+			}
+
+			return true;
+		}
+	};
+}
+
+#endif
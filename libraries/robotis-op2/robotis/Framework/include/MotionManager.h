@@ -14,6 +14,7 @@
 #include "MotionStatus.h"
 #include "MotionModule.h"
 #include "CM730.h"
+#include "SyncWriteCache.h"
 #include "minIni.h"
 
 #define OFFSET_SECTION "Offset"
@@ -21,17 +22,50 @@
 
 namespace Robot
 {
+	class CM730Async;
+	class CM730Transaction;
+
 	class MotionManager
 	{
 	private:
+		// A module with the joints it drives: the highest priority module enabling a joint
+		// owns it, on equal priority the module added last
+		class ModuleEntry
+		{
+		public:
+			MotionModule *module;
+			int priority;
+			unsigned int enable_mask;	// m_Joint enable mask the ownership was resolved with
+			unsigned int owned_mask;
+		};
+
+		enum
+		{
+			GYRO_WINDOW_SIZE = 100,
+			ACCEL_WINDOW_SIZE = 30
+		};
+
 		static MotionManager* m_UniqueInstance;
-		std::list<MotionModule*> m_Modules;
+		std::list<ModuleEntry> m_Modules;
+		MotionModule *m_JointOwner[JointData::NUMBER_OF_JOINTS];
+		bool m_OwnershipChanged;
+		MotionState m_OwnStatus;
+		MotionState *m_Status;	// m_OwnStatus unless the constructor was given one
 		CM730 *m_CM730;
+		CM730Async *m_Bus;
+		CM730Transaction *m_SyncWriteTransaction;
+		CM730Transaction *m_BulkReadTransaction;
+		SyncWriteCache m_SyncWriteCache;
 		bool m_ProcessEnable;
 		bool m_Enabled;
 		int m_FBGyroCenter;
 		int m_RLGyroCenter;
 		int m_CalibrationStatus;
+		int m_FBGyroWindow[GYRO_WINDOW_SIZE];
+		int m_RLGyroWindow[GYRO_WINDOW_SIZE];
+		int m_GyroWindowIndex;
+		int m_FBAccelWindow[ACCEL_WINDOW_SIZE];
+		int m_AccelWindowIndex;
 
 		bool m_IsRunning;
 		bool m_IsThreadRunning;
@@ -39,7 +73,8 @@ namespace Robot
 
 		std::ofstream m_LogFileStream;
 
-        MotionManager();
+		void ProcessBulkReadData();
+		void ResolveOwnership();
 
 	protected:
 
@@ -47,9 +82,13 @@ namespace Robot
 		bool DEBUG_PRINT;
         int m_Offset[JointData::NUMBER_OF_JOINTS];
 
+		// GetInstance() is the manager of the robot and drives MotionStatus. The others, e.g. on
+		// a simulated CM730, drive the given state or one of their own, which their modules read.
+		MotionManager(MotionState *status = 0);
 		~MotionManager();
 
 		static MotionManager* GetInstance() { return m_UniqueInstance; }
+		MotionState *GetStatus()		{ return m_Status; }
 
 		bool Initialize(CM730 *cm730);
 		bool Reinitialize();
@@ -57,7 +96,19 @@ namespace Robot
 		void SetEnable(bool enable);
 		bool GetEnable()				{ return m_Enabled; }
 		void AddModule(MotionModule *module);
+		void AddModule(MotionModule *module, int priority);
 		void RemoveModule(MotionModule *module);
+		void SetModulePriority(MotionModule *module, int priority);
+
+		// Ownership is resolved again only when a module is added, removed or changes its
+		// enabled joints. A module owning no joint is not processed at all.
+		MotionModule *GetJointOwner(int id)	{ return (id >= 0 && id < JointData::NUMBER_OF_JOINTS) ? m_JointOwner[id] : 0; }
+		unsigned int GetOwnedJoints(MotionModule *module);	// bit id set for each joint id
+
+		// Hand the bus traffic to a CM730Async I/O thread: Process() then returns as soon
+		// as its SyncWrite/BulkRead are queued and collects the BulkRead on the next tick.
+		bool SetPipelineEnable(bool enable);
+		bool GetPipelineEnable()		{ return m_Bus != 0; }
 
 		void ResetGyroCalibration() { m_CalibrationStatus = 0; m_FBGyroCenter = 512; m_RLGyroCenter = 512; }
 		int GetCalibrationStatus() { return m_CalibrationStatus; }
@@ -9,6 +9,7 @@
 #define _MOTION_MODULE_H_
 
 #include "JointData.h"
+#include "MotionStatus.h"
 
 namespace Robot
 {
@@ -19,8 +20,11 @@ namespace Robot
 	class MotionModule
 	{
 	private:
+		friend class MotionManager;
 
 	protected:
+		// current joints and sensors of the manager the module is added to, MotionStatus otherwise
+		MotionState *m_Status;
 
 	public:
 	/*state of all the articulations (the motors MX-28)*/
@@ -28,6 +32,8 @@ namespace Robot
 
 		static const int TIME_UNIT = 8; //msec 
 
+		MotionModule() : m_Status(MotionStatus::GetDefault()) {}
+
 		virtual void Initialize() = 0;
 		virtual void Process() = 0;
 	};
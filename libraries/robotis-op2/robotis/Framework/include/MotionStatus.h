@@ -19,23 +19,77 @@ namespace Robot
         FORWARD     = 1
     };
 
+	// A consistent copy of a MotionState, published once per MotionManager::Process() tick
+	class MotionStatusSnapshot
+	{
+	public:
+		unsigned long tick;
+		double time;	// msec, CLOCK_MONOTONIC on Linux
+
+		JointData joints;
+		int FB_GYRO;
+		int RL_GYRO;
+		int FB_ACCEL;
+		int RL_ACCEL;
+
+		int BUTTON;
+		int FALLEN;
+
+		MotionStatusSnapshot();
+	};
+
+	// The joints a MotionManager sends and the sensors it reads, one per manager
+	class MotionState
+	{
+	private:
+		// seqlock: odd while the motion thread writes m_Snapshot
+		volatile unsigned int m_Sequence;
+		MotionStatusSnapshot m_Snapshot;
+
+	public:
+		JointData m_CurrentJoints;
+		int FB_GYRO;
+		int RL_GYRO;
+		int FB_ACCEL;
+		int RL_ACCEL;
+
+		int BUTTON;
+		int FALLEN;
+
+		MotionState();
+
+		// Called by the motion thread only, it never waits for the readers
+		void Publish(double time);
+
+		// Any thread; never blocks the motion thread, only retries if a publish overlapped the copy.
+		// Before the first publish (tick 0) the live values are copied.
+		void GetSnapshot(MotionStatusSnapshot *snapshot);
+	};
+
+	// The MotionState of MotionManager::GetInstance(), and of the modules added to no manager
 	class MotionStatus
 	{
 	private:
+		static MotionState m_Default;
 
 	public:
 	    static const int FALLEN_F_LIMIT     = 390;
 	    static const int FALLEN_B_LIMIT     = 580;
 	    static const int FALLEN_MAX_COUNT   = 30;
 
-		static JointData m_CurrentJoints;
-		static int FB_GYRO;
-		static int RL_GYRO;
-		static int FB_ACCEL;
-		static int RL_ACCEL;
+		static JointData &m_CurrentJoints;
+		static int &FB_GYRO;
+		static int &RL_GYRO;
+		static int &FB_ACCEL;
+		static int &RL_ACCEL;
+
+		static int &BUTTON;
+		static int &FALLEN;
+
+		static MotionState *GetDefault()	{ return &m_Default; }
 
-		static int BUTTON;
-		static int FALLEN;
+		static void Publish(double time)	{ m_Default.Publish(time); }
+		static void GetSnapshot(MotionStatusSnapshot *snapshot)	{ m_Default.GetSnapshot(snapshot); }
 	};
 }
 
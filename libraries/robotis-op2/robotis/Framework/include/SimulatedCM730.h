@@ -0,0 +1,151 @@
+/*
+ *   SimulatedCM730.h
+ *   A PlatformCM730 without a robot: the CM730 and the 20 MX28 are emulated
+ *   in the process, behind the same Dynamixel 1.0 packets as on the real bus.
+ *
+ */
+
+#ifndef _SIMULATED_CM730_H_
+#define _SIMULATED_CM730_H_
+
+#include <semaphore.h>
+#include "CM730.h"
+
+
+namespace Robot
+{
+	/*
+	Every packet written to the port is decoded and executed on the emulated control
+	tables, the status packets are queued with the time their last bit would arrive
+	at the configured baud rate. The clock is simulated unless REAL_TIME is set:
+	it only moves forward in Sleep() and while TxRxPacket() waits for the port,
+	so a BulkRead costs its bus time on the clock but nothing on the CPU.
+	The servos follow their goal position at their moving speed, integrated in
+	fixed steps of STEP_TIME on that clock.
+
+	Nothing is allocated after construction. The fault rates are probabilities
+	drawn from a seeded generator, so a run with faults can be reproduced.
+	*/
+	class SimulatedCM730 : public PlatformCM730
+	{
+	private:
+		enum
+		{
+			MAXNUM_PACKET		= MAXNUM_TXPARAM + 10,
+			MAXNUM_RX_BUFFER	= MAXNUM_RXPARAM * 4
+		};
+
+		static const double STEP_TIME;		// msec
+
+		bool m_Open;
+		int m_Baud;
+		double m_ByteTransferTime;
+		double m_StartTime;
+		double m_Clock;
+		double m_StepTime;					// servo state is integrated up to here
+		double m_BusFreeTime;				// the last queued status byte arrives here
+
+		double m_PacketStartTime;
+		double m_PacketWaitTime;
+		double m_UpdateStartTime;
+		double m_UpdateWaitTime;
+
+		// emulated devices, m_Table[id] is the MX28 id (1 to 20)
+		unsigned char m_CMTable[CM730::MAXNUM_ADDRESS];
+		unsigned char m_Table[JointData::NUMBER_OF_JOINTS][MX28::MAXNUM_ADDRESS];
+		double m_Position[JointData::NUMBER_OF_JOINTS];
+		bool m_Present[JointData::NUMBER_OF_JOINTS];
+
+		// instruction packet being written, it may come in several WritePort() calls
+		unsigned char m_TxPacket[MAXNUM_PACKET];
+		int m_TxLength;
+
+		// status bytes not read yet and when they arrive
+		unsigned char m_RxBuffer[MAXNUM_RX_BUFFER];
+		double m_RxTime[MAXNUM_RX_BUFFER];
+		int m_RxHead;
+		int m_RxTail;
+
+		unsigned int m_Random;
+		int m_InstructionCount;
+		int m_FaultCount;
+
+		sem_t m_LowSemID;
+		sem_t m_MidSemID;
+		sem_t m_HighSemID;
+
+		double GetCurrentTime();
+		bool Fault(double rate);
+
+		void ResetDevice(int id);
+		unsigned char *GetTable(int id, int *size);
+		bool IsReachable(int id);
+		void Update();
+
+		void ParsePacket();
+		void ExecutePacket(unsigned char *packet);
+		bool WriteTable(int id, int address, unsigned char *data, int length);
+		// Queues the status packet of id, false if the device did not answer
+		bool Answer(int id, int instruction, int error, unsigned char *param, int length);
+
+	public:
+		bool REAL_TIME;			// follow the wall clock instead of the simulated one
+		double LATENCY_TIME;	// msec, USB turnaround added to every status packet
+
+		// Fault injection, 0 (never) to 1 (always)
+		double DROP_BYTE_RATE;	// a status byte is lost
+		double CORRUPT_RATE;	// a status packet has a wrong checksum
+		double TIMEOUT_RATE;	// a device does not answer, nor the ones after it in a BulkRead
+
+		SimulatedCM730();
+		~SimulatedCM730();
+
+		void SetSeed(unsigned int seed)		{ m_Random = seed; }
+
+		// A servo that is not present never answers, like an unplugged one
+		void SetPresent(int id, bool present);
+		bool GetPresent(int id);
+
+		// Direct access to the control tables (id CM730::ID_CM or 1 to 20), without bus time
+		int GetByte(int id, int address);
+		int GetWord(int id, int address);
+		void SetByte(int id, int address, int value);
+		void SetWord(int id, int address, int value);
+
+		double GetTime()					{ return GetCurrentTime(); }	// msec since construction
+		int GetInstructionCount()			{ return m_InstructionCount; }
+		int GetFaultCount()					{ return m_FaultCount; }
+		// When the next status byte arrives (GetTime() msec), -1 if none is queued
+		double GetNextRxTime();
+
+		///////////////// Platform Porting //////////////////////
+		bool OpenPort();
+		bool SetBaud(int baud);
+		void ClosePort();
+		void ClearPort();
+		int WritePort(unsigned char* packet, int numPacket);
+		int ReadPort(unsigned char* packet, int numPacket);
+
+		void LowPriorityWait();
+		void MidPriorityWait();
+		void HighPriorityWait();
+		void LowPriorityRelease();
+		void MidPriorityRelease();
+		void HighPriorityRelease();
+
+		void SetPacketTimeout(int lenPacket);
+		bool IsPacketTimeout();
+		double GetPacketTime();
+		void SetUpdateTimeout(int msec);
+		bool IsUpdateTimeout();
+		double GetUpdateTime();
+
+		void Sleep(double msec);
+
+		// Skips to the arrival of the status bytes in flight, or to the packet timeout if none is coming
+		void WaitPort();
+		////////////////////////////////////////////////////////
+	};
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ *   SyncWriteCache.h
+ *   Remembers what was last sent to every servo and strips the
+ *   unchanged joints and registers out of a SyncWrite.
+ *
+ */
+
+#ifndef _SYNC_WRITE_CACHE_H_
+#define _SYNC_WRITE_CACHE_H_
+
+#include "MX28.h"
+#include "CM730.h"
+
+namespace Robot
+{
+	/*
+	Filter() takes the parameters of a full CM730::SyncWrite (each_length values per joint,
+	the id first) and rewrites them in place: only the joints with at least one changed
+	byte are kept, with the narrowest address window covering the changes of all of them.
+	A joint missing from a call is forgotten, since someone else may write it meanwhile,
+	and everything is sent again every GetRefreshPeriod() calls in case a packet was lost.
+	Given the CM730 it filters for, it also forgets everything after any write to a servo
+	that did not go through it, e.g. the moving speed broadcast of MotionManager::SetEnable().
+	*/
+	class SyncWriteCache
+	{
+	private:
+		enum { MAXNUM_ID = 254 };
+
+		unsigned char m_Table[MAXNUM_ID][MX28::MAXNUM_ADDRESS];
+		bool m_Valid[MAXNUM_ID][MX28::MAXNUM_ADDRESS];
+		int m_RefreshPeriod;
+		int m_Count;
+		CM730 *m_CM730;
+		unsigned int m_DirectWriteCount;	// of m_CM730 when it was last looked at
+
+	public:
+		SyncWriteCache();
+
+		void SetCM730(CM730 *cm730);
+
+		// Returns the number of joints left in pParam, nothing has to be sent if 0
+		int Filter(int *start_addr, int *each_length, int number, int *pParam);
+
+		// Forget what was sent, e.g. after a failed write or a direct WriteByte()
+		void Invalidate();
+		void Invalidate(int id);
+
+		void SetRefreshPeriod(int period)	{ m_RefreshPeriod = period; }
+		int GetRefreshPeriod()				{ return m_RefreshPeriod; }
+	};
+}
+
+#endif
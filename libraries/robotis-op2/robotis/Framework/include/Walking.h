@@ -30,6 +30,20 @@ namespace Robot
 		};
 
 	private:
+		/*
+		Unit sines of one tick of the gait, the amplitudes are applied in Process().
+		They only depend on the tick time and on the timing parameters.
+		*/
+		struct PhaseSample
+		{
+			double time;
+			double x_swap, y_swap, z_swap;
+			double x_move, y_move, z_move_l, z_move_r, a_move;
+			double pelvis;
+			int    pelvis_side;	// 0: no pelvis offset, 1: left single support, 2: right single support
+			double arm;
+		};
+
 		static Walking* m_UniqueInstance;
 
 		double m_PeriodTime;
@@ -93,13 +107,21 @@ namespace Robot
 		double m_Body_Swing_Y;
 		double m_Body_Swing_Z;
 
-        	Walking();
+		static const unsigned int MAX_PHASE_SAMPLES = 1024;	// 8 sec periods, filled without allocating on the motion thread
+		PhaseSample m_PhaseTable[MAX_PHASE_SAMPLES];
+		unsigned int m_PhaseTable_Count;
+		double m_PhaseTable_PeriodTime;
+		double m_PhaseTable_DSP_Ratio;
+		unsigned int m_PhaseTable_Cursor;
 
-		double wsin(double time, double period, double period_shift, double mag, double mag_shift);
-		bool computeIK(double *out, double x, double y, double z, double a, double b, double c);
+		double wsin(double time, double period, double period_shift);
+		double wamp(double sample, double mag, double mag_shift)	{ return mag * sample + mag_shift; }
 		void update_param_time();
 		void update_param_move();
 		void update_param_balance();
+		void compute_phase_sample(double time, PhaseSample *sample);
+		void build_phase_table();
+		const PhaseSample* find_phase_sample(double time);
 
 	public:
 		// Walking initial pose
@@ -136,10 +158,14 @@ namespace Robot
 		int    I_GAIN;
 		int    D_GAIN;
 
+		// Take the sines of a tick from a table rebuilt when the timing parameters change
+		bool   PHASE_TABLE_ENABLE;
+
 		int GetCurrentPhase()		{ return m_Phase; }
 		double GetBodySwingY()		{ return m_Body_Swing_Y; }
 		double GetBodySwingZ()		{ return m_Body_Swing_Z; }
 
+		Walking();
 		virtual ~Walking();
 
 		static Walking* GetInstance() { return m_UniqueInstance; }
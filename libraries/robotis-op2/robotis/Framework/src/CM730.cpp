@@ -5,8 +5,10 @@
  *
  */
 #include <stdio.h>
+#include <string.h>
 #include "FSR.h"
 #include "CM730.h"
+#include "CM730Async.h"
 #include "MotionStatus.h"
 #include "Kinematics.h"
 
@@ -36,12 +38,15 @@ BulkReadData::BulkReadData() :
         error(-1)
 {
     for(int i = 0; i < MX28::MAXNUM_ADDRESS; i++)
+    {
         table[i] = 0;
+        sequence[i] = 0;
+    }
 }
 
 int BulkReadData::ReadByte(int address)
 {
-    if(address >= start_address && address < (start_address + length))
+    if(GetSequence(address, 1) != 0)
         return (int)table[address];
 
     return 0;
@@ -49,20 +54,201 @@ int BulkReadData::ReadByte(int address)
 
 int BulkReadData::ReadWord(int address)
 {
-    if(address >= start_address && address < (start_address + length))
+    if(GetSequence(address, 2) != 0)
         return CM730::MakeWord(table[address], table[address+1]);
 
     return 0;
 }
 
+unsigned int BulkReadData::GetSequence(int address, int length)
+{
+    if(address < 0 || length <= 0 || address + length > MX28::MAXNUM_ADDRESS)
+        return 0;
+
+    unsigned int oldest = sequence[address];
+    for(int i = 1; i < length; i++)
+    {
+        if(sequence[address + i] < oldest)
+            oldest = sequence[address + i];
+    }
+
+    return oldest;
+}
+
+
+BulkReadParser::BulkReadParser(BulkReadData *data, unsigned int sequence) :
+        m_Data(data),
+        m_Sequence(sequence),
+        m_Remaining(0),
+        m_Corrupt(0),
+        m_State(HEADER_0),
+        m_ID(0),
+        m_Length(0),
+        m_Count(0),
+        m_ErrBit(0),
+        m_Checksum(0),
+        m_PacketLength(0)
+{
+    for(int i = 0; i < 256; i++)
+        m_Pending[i] = false;
+}
+
+void BulkReadParser::Expect(int id)
+{
+    if(id < 0 || id >= CM730::ID_BROADCAST || m_Pending[id] == true)
+        return;
+
+    m_Data[id].error = -1;
+    if(m_Data[id].start_address + m_Data[id].length > MX28::MAXNUM_ADDRESS)
+        return;
+
+    m_Pending[id] = true;
+    m_Remaining++;
+}
+
+void BulkReadParser::Parse(unsigned char *buffer, int length)
+{
+    // the bytes of a corrupt packet after its first one, then the ones not scanned yet:
+    // they are a part of m_Packet and of the byte scanned, never more
+    unsigned char replay[MX28::MAXNUM_ADDRESS + 7];
+
+    for(int i = 0; i < length; i++)
+    {
+        int start = 0, end = 0;
+        replay[end++] = buffer[i];
+
+        while(start < end)
+        {
+            if(Step(replay[start++]) == true)
+                continue;
+
+            int n = m_PacketLength - 1;
+            memmove(&replay[n], &replay[start], end - start);
+            memcpy(replay, &m_Packet[1], n);
+            end = n + end - start;
+            start = 0;
+            m_State = HEADER_0;
+            m_PacketLength = 0;
+        }
+    }
+}
+
+bool BulkReadParser::Step(unsigned char data)
+{
+    if(m_State != HEADER_0)
+        m_Packet[m_PacketLength++] = data;
+
+    switch(m_State)
+    {
+    case HEADER_0:
+        if(data == 0xFF)
+        {
+            m_Packet[0] = data;
+            m_PacketLength = 1;
+            m_State = HEADER_1;
+        }
+        break;
+
+    case HEADER_1:
+        if(data == 0xFF)
+            m_State = PACKET_ID;
+        else
+            m_State = HEADER_0;
+        break;
+
+    case PACKET_ID:
+        if(data == 0xFF) // extra header byte, the packet starts at the last 2
+        {
+            m_PacketLength = 2;
+            break;
+        }
+        if(m_Pending[data] == false)
+        {
+            m_State = HEADER_0;
+            break;
+        }
+        m_ID = data;
+        m_Checksum = data;
+        m_State = PACKET_LENGTH;
+        break;
+
+    case PACKET_LENGTH:
+        if(data != m_Data[m_ID].length + 2)
+        {
+            m_Corrupt++;
+            return false;
+        }
+        m_Length = data - 2;
+        m_Checksum += data;
+        m_State = PACKET_ERRBIT;
+        break;
+
+    case PACKET_ERRBIT:
+        m_ErrBit = data;
+        m_Checksum += data;
+        m_Count = 0;
+        m_State = (m_Length > 0) ? PACKET_PARAMETER : PACKET_CHECKSUM;
+        break;
+
+    case PACKET_PARAMETER:
+        m_Count++;
+        m_Checksum += data;
+        if(m_Count == m_Length)
+            m_State = PACKET_CHECKSUM;
+        break;
+
+    case PACKET_CHECKSUM:
+        if((unsigned char)(~m_Checksum) == data)
+        {
+            BulkReadData *entry = &m_Data[m_ID];
+            for(int j = 0; j < m_Length; j++)
+            {
+                entry->table[entry->start_address + j] = m_Packet[PARAMETER + j];
+                entry->sequence[entry->start_address + j] = m_Sequence;
+            }
+            entry->error = m_ErrBit;
+
+            m_Pending[m_ID] = false;
+            m_Remaining--;
+        }
+        else
+        {
+            m_Corrupt++;
+            return false;
+        }
+        m_State = HEADER_0;
+        break;
+    }
+
+    return true;
+}
+
 
 CM730::CM730(PlatformCM730 *platform)
 {
 	m_Platform = platform;
+	m_Bus = 0;
 	DEBUG_PRINT = false;
     m_BulkReadTxPacket[LENGTH] = 0;
 	for(int i = 0; i < ID_BROADCAST; i++)
 	    m_BulkReadData[i] = BulkReadData();
+
+    m_BulkReadCM = false;
+    m_BulkReadLeftFSR = false;
+    m_BulkReadRightFSR = false;
+    for(int id = 0; id < JointData::NUMBER_OF_JOINTS; id++)
+        m_BulkReadRegisters[id] = 0;
+    m_BulkReadDefault = READ_POSITION | READ_VOLTAGE | READ_TEMPERATURE;
+    m_BulkReadJoints = &MotionStatus::m_CurrentJoints;
+
+    m_BulkReadRate[0] = RATE_EVERY_TICK;    // READ_POSITION
+    m_BulkReadRate[1] = RATE_EVERY_TICK;    // READ_SPEED
+    m_BulkReadRate[2] = 2;                  // READ_LOAD
+    m_BulkReadRate[3] = RATE_SLOW;          // READ_VOLTAGE
+    m_BulkReadRate[4] = RATE_SLOW;          // READ_TEMPERATURE
+    m_BulkReadSlowBytes = 12;
+    m_BulkReadSequence = 0;
+    m_DirectWriteCount = 0;
 }
 
 CM730::~CM730()
@@ -72,12 +258,46 @@ CM730::~CM730()
 
 int CM730::TxRxPacket(unsigned char *txpacket, unsigned char *rxpacket, int priority)
 {
+	// while a bus owner thread runs, every packet goes through its queue
+	if(m_Bus != 0 && m_Bus->IsOwnerThread() == false)
+		return m_Bus->Execute(txpacket, rxpacket, priority);
+
 	if(priority > 1)
 		m_Platform->LowPriorityWait();
 	if(priority > 0)
 		m_Platform->MidPriorityWait();
 	m_Platform->HighPriorityWait();
 
+	int res = TransferPacket(txpacket, rxpacket);
+
+	// written past the SyncWrite caches, see GetDirectWriteCount()
+	if(txpacket[ID] != ID_CM && (txpacket[INSTRUCTION] == INST_WRITE
+		|| txpacket[INSTRUCTION] == INST_REG_WRITE || txpacket[INSTRUCTION] == INST_RESET))
+		__sync_fetch_and_add(&m_DirectWriteCount, 1);
+
+	m_Platform->HighPriorityRelease();
+	if(priority > 0)
+		m_Platform->MidPriorityRelease();
+	if(priority > 1)
+		m_Platform->LowPriorityRelease();
+
+	return res;
+}
+
+void CM730::GetPacketLength(unsigned char *txpacket, int *tx_length, int *rx_length)
+{
+	*tx_length = txpacket[LENGTH] + 4;
+
+	if(txpacket[ID] == ID_BROADCAST)
+		*rx_length = 0;
+	else if(txpacket[INSTRUCTION] == INST_READ)
+		*rx_length = txpacket[PARAMETER+1] + 6;
+	else
+		*rx_length = 6;
+}
+
+int CM730::TransferPacket(unsigned char *txpacket, unsigned char *rxpacket)
+{
 	int res = TX_FAIL;
 	int length = txpacket[LENGTH] + 4;
 
@@ -155,6 +375,8 @@ int CM730::TxRxPacket(unsigned char *txpacket, unsigned char *rxpacket, int prio
 				while(1)
 				{
 					length = m_Platform->ReadPort(&rxpacket[get_length], to_length - get_length);
+					if(length < 0)
+						length = 0;
 					if(DEBUG_PRINT == true)
 					{
 						for(int n=0; n<length; n++)
@@ -206,11 +428,17 @@ int CM730::TxRxPacket(unsigned char *txpacket, unsigned char *rxpacket, int prio
 
 							break;
 						}
+
+						m_Platform->WaitPort();
 					}
 				}
 			}
 			else if(txpacket[INSTRUCTION] == INST_BULK_READ)
 			{
+                // 0 is kept for the registers never received
+                if(++m_BulkReadSequence == 0)
+                    m_BulkReadSequence = 1;
+                BulkReadParser parser(m_BulkReadData, m_BulkReadSequence);
                 int to_length = 0;
                 int num = (txpacket[LENGTH]-3) / 3;
 
@@ -223,6 +451,7 @@ int CM730::TxRxPacket(unsigned char *txpacket, unsigned char *rxpacket, int prio
                     to_length += _len + 6;
                     m_BulkReadData[_id].length = _len;
                     m_BulkReadData[_id].start_address = _addr;
+                    parser.Expect(_id);
                 }
 
                 m_Platform->SetPacketTimeout(to_length*1.5);
@@ -231,100 +460,45 @@ int CM730::TxRxPacket(unsigned char *txpacket, unsigned char *rxpacket, int prio
                 if(DEBUG_PRINT == true)
                     fprintf(stderr, "RX: ");
 
+                // status packets are decoded as they arrive, rxpacket only holds the last chunk
                 while(1)
                 {
-                    length = m_Platform->ReadPort(&rxpacket[get_length], to_length - get_length);
+                    length = m_Platform->ReadPort(rxpacket, to_length - get_length);
+                    if(length < 0)
+                        length = 0;
                     if(DEBUG_PRINT == true)
                     {
                         for(int n=0; n<length; n++)
-                            fprintf(stderr, "%.2X ", rxpacket[get_length + n]);
+                            fprintf(stderr, "%.2X ", rxpacket[n]);
                     }
+                    parser.Parse(rxpacket, length);
                     get_length += length;
 
-                    if(get_length == to_length)
+                    if(parser.GetRemaining() == 0)
                     {
                         res = SUCCESS;
                         break;
                     }
-                    else
-                    {
-                        if(m_Platform->IsPacketTimeout() == true)
-                        {
-                            if(get_length == 0)
-                                res = RX_TIMEOUT;
-                            else
-                                res = RX_CORRUPT;
-
-                            break;
-                        }
-                    }
-                }
-
-                for(int x = 0; x < num; x++)
-                {
-                    int _id = txpacket[PARAMETER+(3*x)+2];
-                    m_BulkReadData[_id].error = -1;
-                }
-
-                while(1)
-                {
-                    int i;
-                    for(i = 0; i < get_length - 1; i++)
+                    else if(get_length >= to_length)
                     {
-                        if(rxpacket[i] == 0xFF && rxpacket[i+1] == 0xFF)
-                            break;
-                        else if(i == (get_length - 2) && rxpacket[get_length - 1] == 0xFF)
-                            break;
+                        res = RX_CORRUPT;
+                        break;
                     }
-
-                    if(i == 0)
+                    else if(m_Platform->IsPacketTimeout() == true)
                     {
-                        // Check checksum
-                        unsigned char checksum = CalculateChecksum(rxpacket);
-                        if(DEBUG_PRINT == true)
-                            fprintf(stderr, "CHK:%.2X\n", checksum);
-
-                        if(rxpacket[LENGTH+rxpacket[LENGTH]] == checksum)
-                        {
-                            for(int j = 0; j < (rxpacket[LENGTH]-2); j++)
-                                m_BulkReadData[rxpacket[ID]].table[m_BulkReadData[rxpacket[ID]].start_address + j] = rxpacket[PARAMETER + j];
-
-                            m_BulkReadData[rxpacket[ID]].error = (int)rxpacket[ERRBIT];
-
-                            int cur_packet_length = LENGTH + 1 + rxpacket[LENGTH];
-                            to_length = get_length - cur_packet_length;
-                            for(int j = 0; j <= to_length; j++)
-                                rxpacket[j] = rxpacket[j+cur_packet_length];
-
-                            get_length = to_length;
-                            num--;
-                        }
+                        if(get_length == 0)
+                            res = RX_TIMEOUT;
                         else
-                        {
                             res = RX_CORRUPT;
 
-                            for(int j = 0; j <= get_length - 2; j++)
-                                rxpacket[j] = rxpacket[j+2];
-
-                            to_length = get_length -= 2;
-                        }
-
-                        if(num == 0)
-                            break;
-                        else if(get_length <= 6)
-                        {
-                            if(num != 0) res = RX_CORRUPT;
-                            break;
-                        }
-
-                    }
-                    else
-                    {
-                        for(int j = 0; j < (get_length - i); j++)
-                            rxpacket[j] = rxpacket[j+i];
-                        get_length -= i;
+                        break;
                     }
+
+                    m_Platform->WaitPort();
                 }
+
+                if(DEBUG_PRINT == true && parser.GetCorrupt() > 0)
+                    fprintf(stderr, "CORRUPT:%d ", parser.GetCorrupt());
 			}
 			else
 				res = SUCCESS;
@@ -371,12 +545,6 @@ int CM730::TxRxPacket(unsigned char *txpacket, unsigned char *rxpacket, int prio
 		}
 	}
 
-	m_Platform->HighPriorityRelease();
-    if(priority > 0)
-        m_Platform->MidPriorityRelease();
-    if(priority > 1)
-        m_Platform->LowPriorityRelease();
-
 	return res;
 }
 
@@ -389,57 +557,197 @@ unsigned char CM730::CalculateChecksum(unsigned char *packet)
 }
 
 void CM730::MakeBulkReadPacket()
+{
+    m_BulkReadCM = (Ping(CM730::ID_CM, 0) == SUCCESS);
+    m_BulkReadLeftFSR = (Ping(FSR::ID_L_FSR, 0) == SUCCESS);
+    m_BulkReadRightFSR = (Ping(FSR::ID_R_FSR, 0) == SUCCESS);
+
+    BulkReadSchedule schedule;
+    PlanBulkReadPacket(m_BulkReadTxPacket, &schedule);
+}
+
+void CM730::GetBulkReadWindow(int registers, int *start_addr, int *length)
+{
+    int first = MX28::MAXNUM_ADDRESS, last = -1;
+
+    if(registers & READ_POSITION)
+    {
+        if(MX28::P_PRESENT_POSITION_L < first) first = MX28::P_PRESENT_POSITION_L;
+        if(MX28::P_PRESENT_POSITION_H > last) last = MX28::P_PRESENT_POSITION_H;
+    }
+    if(registers & READ_SPEED)
+    {
+        if(MX28::P_PRESENT_SPEED_L < first) first = MX28::P_PRESENT_SPEED_L;
+        if(MX28::P_PRESENT_SPEED_H > last) last = MX28::P_PRESENT_SPEED_H;
+    }
+    if(registers & READ_LOAD)
+    {
+        if(MX28::P_PRESENT_LOAD_L < first) first = MX28::P_PRESENT_LOAD_L;
+        if(MX28::P_PRESENT_LOAD_H > last) last = MX28::P_PRESENT_LOAD_H;
+    }
+    if(registers & READ_VOLTAGE)
+    {
+        if(MX28::P_PRESENT_VOLTAGE < first) first = MX28::P_PRESENT_VOLTAGE;
+        if(MX28::P_PRESENT_VOLTAGE > last) last = MX28::P_PRESENT_VOLTAGE;
+    }
+    if(registers & READ_TEMPERATURE)
+    {
+        if(MX28::P_PRESENT_TEMPERATURE < first) first = MX28::P_PRESENT_TEMPERATURE;
+        if(MX28::P_PRESENT_TEMPERATURE > last) last = MX28::P_PRESENT_TEMPERATURE;
+    }
+
+    *start_addr = first;
+    *length = last - first + 1;
+}
+
+// Only reads the plan, so that callers in different threads can plan at the same time
+void CM730::PlanBulkReadPacket(unsigned char *txpacket, BulkReadSchedule *schedule)
 {
     int number = 0;
+    int registers[JointData::NUMBER_OF_JOINTS];
+    int due = 0, slow = 0;
+
+    // register groups due in this tick
+    for(int g = 0; g < NUMBER_OF_READ_GROUPS; g++)
+    {
+        if(m_BulkReadRate[g] == RATE_SLOW)
+            slow |= (1 << g);
+        else if((schedule->tick % m_BulkReadRate[g]) == 0)
+            due |= (1 << g);
+    }
+    schedule->tick++;
+
+    for(int id = 1; id < JointData::NUMBER_OF_JOINTS; id++)
+    {
+        registers[id] = m_BulkReadRegisters[id];
+        if(m_BulkReadJoints->GetEnable(id) == true)
+            registers[id] |= m_BulkReadDefault;
+    }
+
+    // slow groups go round-robin, as many servos as the byte budget allows
+    int budget = m_BulkReadSlowBytes;
+    int cursor = schedule->slow_cursor;
+    bool slow_now[JointData::NUMBER_OF_JOINTS] = {false, };
+    for(int n = 0; n < JointData::NUMBER_OF_JOINTS - 1; n++)
+    {
+        int id = (cursor - 1 + n) % (JointData::NUMBER_OF_JOINTS - 1) + 1;
+        if((registers[id] & slow) == 0)
+            continue;
+
+        int start_addr, length, cost;
+        GetBulkReadWindow((registers[id] & due) | (registers[id] & slow), &start_addr, &length);
+        cost = length;
+        if((registers[id] & due) != 0)
+        {
+            GetBulkReadWindow(registers[id] & due, &start_addr, &length);
+            cost -= length;
+        }
+        else
+            cost += 6; // one more status packet
+
+        if(cost > budget)
+        {
+            if(budget < m_BulkReadSlowBytes)
+                break; // this one is first in line next tick
+            continue;  // too big for any frame
+        }
+
+        budget -= cost;
+        slow_now[id] = true;
+        schedule->slow_cursor = id % (JointData::NUMBER_OF_JOINTS - 1) + 1;
+    }
 
-    m_BulkReadTxPacket[ID]              = (unsigned char)ID_BROADCAST;
-    m_BulkReadTxPacket[INSTRUCTION]     = INST_BULK_READ;
-    m_BulkReadTxPacket[PARAMETER]       = (unsigned char)0x0;
+    txpacket[ID]              = (unsigned char)ID_BROADCAST;
+    txpacket[INSTRUCTION]     = INST_BULK_READ;
+    txpacket[PARAMETER]       = (unsigned char)0x0;
 
-    if(Ping(CM730::ID_CM, 0) == SUCCESS)
+    if(m_BulkReadCM == true)
     {
-        m_BulkReadTxPacket[PARAMETER+3*number+1] = 30;
-        m_BulkReadTxPacket[PARAMETER+3*number+2] = CM730::ID_CM;
-        m_BulkReadTxPacket[PARAMETER+3*number+3] = CM730::P_DXL_POWER;
+        txpacket[PARAMETER+3*number+1] = 30;
+        txpacket[PARAMETER+3*number+2] = CM730::ID_CM;
+        txpacket[PARAMETER+3*number+3] = CM730::P_DXL_POWER;
         number++;
     }
 
-//    for(int id = 1; id < JointData::NUMBER_OF_JOINTS; id++)
-//    {
-//        if(MotionStatus::m_CurrentJoints.GetEnable(id))
-//        {
-//            m_BulkReadTxPacket[PARAMETER+3*number+1] = 2;   // length
-//            m_BulkReadTxPacket[PARAMETER+3*number+2] = id;  // id
-//            m_BulkReadTxPacket[PARAMETER+3*number+3] = MX28::P_PRESENT_POSITION_L; // start address
-//            number++;
-//        }
-//    }
-
-    if(Ping(FSR::ID_L_FSR, 0) == SUCCESS)
+    for(int id = 1; id < JointData::NUMBER_OF_JOINTS; id++)
     {
-        m_BulkReadTxPacket[PARAMETER+3*number+1] = 10;               // length
-        m_BulkReadTxPacket[PARAMETER+3*number+2] = FSR::ID_L_FSR;   // id
-        m_BulkReadTxPacket[PARAMETER+3*number+3] = FSR::P_FSR1_L;    // start address
+        int read = registers[id] & due;
+        if(slow_now[id] == true)
+            read |= registers[id] & slow;
+        if(read == 0)
+            continue;
+
+        int start_addr, length;
+        GetBulkReadWindow(read, &start_addr, &length);
+        txpacket[PARAMETER+3*number+1] = length;      // length
+        txpacket[PARAMETER+3*number+2] = id;          // id
+        txpacket[PARAMETER+3*number+3] = start_addr;  // start address
         number++;
     }
 
-    if(Ping(FSR::ID_R_FSR, 0) == SUCCESS)
+    if(m_BulkReadLeftFSR == true)
     {
-        m_BulkReadTxPacket[PARAMETER+3*number+1] = 10;               // length
-        m_BulkReadTxPacket[PARAMETER+3*number+2] = FSR::ID_R_FSR;   // id
-        m_BulkReadTxPacket[PARAMETER+3*number+3] = FSR::P_FSR1_L;    // start address
+        txpacket[PARAMETER+3*number+1] = 10;               // length
+        txpacket[PARAMETER+3*number+2] = FSR::ID_L_FSR;   // id
+        txpacket[PARAMETER+3*number+3] = FSR::P_FSR1_L;    // start address
         number++;
     }
 
-    m_BulkReadTxPacket[LENGTH]          = (number * 3) + 3;
+    if(m_BulkReadRightFSR == true)
+    {
+        txpacket[PARAMETER+3*number+1] = 10;               // length
+        txpacket[PARAMETER+3*number+2] = FSR::ID_R_FSR;   // id
+        txpacket[PARAMETER+3*number+3] = FSR::P_FSR1_L;    // start address
+        number++;
+    }
+
+    txpacket[LENGTH]          = (number * 3) + 3;
+}
+
+void CM730::SetBulkReadRegisters(int id, int registers)
+{
+    if(id <= 0 || id >= JointData::NUMBER_OF_JOINTS)
+        return;
+
+    m_BulkReadRegisters[id] = registers;
+}
+
+void CM730::SetBulkReadDefaultRegisters(int registers)
+{
+    m_BulkReadDefault = registers;
+}
+
+int CM730::GetBulkReadAge(int id, int address, int length)
+{
+    if(id < 0 || id >= ID_BROADCAST)
+        return -1;
+
+    unsigned int sequence = m_BulkReadData[id].GetSequence(address, length);
+    if(sequence == 0)
+        return -1;
+
+    return (int)(m_BulkReadSequence - sequence);
+}
+
+void CM730::SetBulkReadRate(int registers, int rate)
+{
+    for(int g = 0; g < NUMBER_OF_READ_GROUPS; g++)
+    {
+        if(registers & (1 << g))
+            m_BulkReadRate[g] = rate;
+    }
 }
 
 int CM730::BulkRead()
 {
+    unsigned char txpacket[MAXNUM_TXPARAM + 10] = {0, };
     unsigned char rxpacket[MAXNUM_RXPARAM + 10] = {0, };
 
     if(m_BulkReadTxPacket[LENGTH] != 0)
-        return TxRxPacket(m_BulkReadTxPacket, rxpacket, 0);
+    {
+        PlanBulkReadPacket(txpacket, &m_BulkReadSchedule);
+        return TxRxPacket(txpacket, rxpacket, 0);
+    }
     else
     {
         MakeBulkReadPacket();
@@ -447,10 +755,20 @@ int CM730::BulkRead()
     }
 }
 
-int CM730::SyncWrite(int start_addr, int each_length, int number, int *pParam)
+bool CM730::GetBulkReadPacket(unsigned char *txpacket, BulkReadSchedule *schedule)
+{
+    if(m_BulkReadTxPacket[LENGTH] == 0)
+    {
+        MakeBulkReadPacket();
+        return false;
+    }
+
+    PlanBulkReadPacket(txpacket, schedule);
+    return true;
+}
+
+void CM730::MakeSyncWritePacket(unsigned char *txpacket, int start_addr, int each_length, int number, int *pParam)
 {
-	unsigned char txpacket[MAXNUM_TXPARAM + 10] = {0, };
-	unsigned char rxpacket[MAXNUM_RXPARAM + 10] = {0, };
 	int n;
 
     txpacket[ID]                = (unsigned char)ID_BROADCAST;
@@ -460,6 +778,14 @@ int CM730::SyncWrite(int start_addr, int each_length, int number, int *pParam)
     for(n = 0; n < (number * each_length); n++)
         txpacket[PARAMETER + 2 + n]   = (unsigned char)pParam[n];
     txpacket[LENGTH]            = n + 4;
+}
+
+int CM730::SyncWrite(int start_addr, int each_length, int number, int *pParam)
+{
+	unsigned char txpacket[MAXNUM_TXPARAM + 10] = {0, };
+	unsigned char rxpacket[MAXNUM_RXPARAM + 10] = {0, };
+
+	MakeSyncWritePacket(txpacket, start_addr, each_length, number, pParam);
 
     return TxRxPacket(txpacket, rxpacket, 0);
 }
@@ -692,6 +1018,24 @@ int CM730::ReadWord(int id, int address, int *pValue, int *error)
 	return result;
 }
 
+void CM730::MakeReadPacket(unsigned char *txpacket, int id, int start_addr, int length)
+{
+    txpacket[ID]           = (unsigned char)id;
+    txpacket[INSTRUCTION]  = INST_READ;
+	txpacket[PARAMETER]    = (unsigned char)start_addr;
+    txpacket[PARAMETER+1]  = (unsigned char)length;
+    txpacket[LENGTH]       = 4;
+}
+
+void CM730::GetReadData(unsigned char *rxpacket, int start_addr, int length, unsigned char *table, int *error)
+{
+	for(int i=0; i<length; i++)
+		table[start_addr + i] = rxpacket[PARAMETER + i];
+
+	if(error != 0)
+		*error = (int)rxpacket[ERRBIT];
+}
+
 int CM730::ReadTable(int id, int start_addr, int end_addr, unsigned char *table, int *error)
 {
 	unsigned char txpacket[MAXNUM_TXPARAM + 10] = {0, };
@@ -699,21 +1043,11 @@ int CM730::ReadTable(int id, int start_addr, int end_addr, unsigned char *table,
 	int result;
 	int length = end_addr - start_addr + 1;
 
-    txpacket[ID]           = (unsigned char)id;
-    txpacket[INSTRUCTION]  = INST_READ;
-	txpacket[PARAMETER]    = (unsigned char)start_addr;
-    txpacket[PARAMETER+1]  = (unsigned char)length;
-    txpacket[LENGTH]       = 4;
+	MakeReadPacket(txpacket, id, start_addr, length);
 
 	result = TxRxPacket(txpacket, rxpacket, 1);
 	if(result == SUCCESS)
-	{
-		for(int i=0; i<length; i++)
-			table[start_addr + i] = rxpacket[PARAMETER + i];
-
-		if(error != 0)
-			*error = (int)rxpacket[ERRBIT];
-	}
+		GetReadData(rxpacket, start_addr, length, table, error);
 
 	return result;
 }
@@ -825,28 +1159,18 @@ int CM730::MakeColor(int red, int green, int blue)
 
 void CM730::MakeBulkReadPacketWb()
 {
-		int number = 0;
-
-		m_BulkReadTxPacket[ID] = (unsigned char)ID_BROADCAST;
-		m_BulkReadTxPacket[INSTRUCTION] = INST_BULK_READ;
-		m_BulkReadTxPacket[PARAMETER] = (unsigned char)0x0;
-
-		if(Ping(CM730::ID_CM, 0) == SUCCESS)
-		{
-				m_BulkReadTxPacket[PARAMETER+3*number+1] = 30;
-				m_BulkReadTxPacket[PARAMETER+3*number+2] = CM730::ID_CM;
-				m_BulkReadTxPacket[PARAMETER+3*number+3] = CM730::P_DXL_POWER;
-				number++;
-		}
+		// the CM730, then position, speed and load of every motor, whoever controls it,
+		// in every packet: the FSR and the slow registers are not read
+		m_BulkReadCM = (Ping(CM730::ID_CM, 0) == SUCCESS);
+		m_BulkReadLeftFSR = false;
+		m_BulkReadRightFSR = false;
 
+		m_BulkReadDefault = 0;
 		for(int id = 1; id < JointData::NUMBER_OF_JOINTS; id++)
-		{
-				m_BulkReadTxPacket[PARAMETER+3*number+1] = 6; // length (goal + speed + torque)
-				m_BulkReadTxPacket[PARAMETER+3*number+2] = id;	// id
-				m_BulkReadTxPacket[PARAMETER+3*number+3] = MX28::P_PRESENT_POSITION_L; // start address
-				number++;
-		}
+				m_BulkReadRegisters[id] = READ_POSITION | READ_SPEED | READ_LOAD;
+		SetBulkReadRate(READ_POSITION | READ_SPEED | READ_LOAD, RATE_EVERY_TICK);
 
-		m_BulkReadTxPacket[LENGTH] = (number * 3) + 3;
+		BulkReadSchedule schedule;
+		PlanBulkReadPacket(m_BulkReadTxPacket, &schedule);
 }
 
@@ -0,0 +1,397 @@
+/*
+ *   CM730Async.cpp
+ *   Queues CM730 transactions and runs them on a dedicated bus I/O thread.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include "CM730Async.h"
+
+using namespace Robot;
+
+
+// Estimated bus time of a packet: 10 bits per byte at 1 Mbps, plus the return delay
+// and the USB latency of the status packet
+static const double BYTE_TIME = 0.01;       // msec
+static const double TURNAROUND_TIME = 0.5;  // msec
+
+CM730Transaction::CM730Transaction() :
+        type(SYNC_WRITE),
+        priority(0),
+        result(CM730::SUCCESS),
+        error(0),
+        start_address(0),
+        length(0),
+        table(0),
+        callback(0),
+        param(0),
+        m_Owner(0),
+        m_Next(0),
+        m_Done(true)
+{
+}
+
+bool CM730Transaction::IsDone()
+{
+    if(m_Owner == 0)
+        return m_Done;
+
+    pthread_mutex_lock(&m_Owner->m_Mutex);
+    bool done = m_Done;
+    pthread_mutex_unlock(&m_Owner->m_Mutex);
+
+    return done;
+}
+
+int CM730Transaction::Wait()
+{
+    if(m_Owner == 0)
+        return result;
+
+    pthread_mutex_lock(&m_Owner->m_Mutex);
+    while(m_Done == false)
+        pthread_cond_wait(&m_Owner->m_DoneCond, &m_Owner->m_Mutex);
+    pthread_mutex_unlock(&m_Owner->m_Mutex);
+
+    return result;
+}
+
+
+CM730Async::CM730Async(CM730 *cm730) :
+        m_CM730(cm730),
+        m_WakePosted(0),
+        m_Deferred(0),
+        m_Submitting(0),
+        m_Running(false),
+        m_Finish(false),
+        m_FramePeriod(0),
+        m_FrameTime(0),
+        DEBUG_PRINT(false)
+{
+    pthread_mutex_init(&m_Mutex, 0);
+    pthread_cond_init(&m_DoneCond, 0);
+    sem_init(&m_QueueSem, 0, 0);
+
+    for(int p = 0; p < NUMBER_OF_PRIORITIES; p++)
+    {
+        m_Stub[p].m_Next = 0;
+        m_Head[p] = &m_Stub[p];
+        m_Tail[p] = &m_Stub[p];
+    }
+}
+
+CM730Async::~CM730Async()
+{
+    Stop();
+
+    sem_destroy(&m_QueueSem);
+    pthread_cond_destroy(&m_DoneCond);
+    pthread_mutex_destroy(&m_Mutex);
+}
+
+bool CM730Async::Start()
+{
+    if(m_Running == true)
+        return true;
+
+    m_Finish = false;
+
+    int error;
+    if((error = pthread_create(&m_Thread, 0, ThreadProc, this)) != 0)
+    {
+        if(DEBUG_PRINT == true)
+            fprintf(stderr, "Fail to create the CM730 I/O thread (%d)\n", error);
+        return false;
+    }
+
+    m_Running = true;
+    __sync_synchronize();
+    m_CM730->m_Bus = this;
+
+    return true;
+}
+
+void CM730Async::Stop()
+{
+    if(m_Running == false)
+        return;
+
+    // new blocking calls go straight to the port again
+    m_CM730->m_Bus = 0;
+
+    m_Finish = true;
+    __sync_synchronize();
+    sem_post(&m_QueueSem);
+
+    pthread_join(m_Thread, 0);
+
+    // a producer may still be between its check of m_Finish and its push
+    while(m_Submitting != 0)
+        sched_yield();
+    m_Running = false;
+
+    // fail whatever was still queued so that nobody waits forever
+    if(m_Deferred != 0)
+    {
+        Complete(m_Deferred, CM730::TX_FAIL);
+        m_Deferred = 0;
+    }
+    for(int p = 0; p < NUMBER_OF_PRIORITIES; p++)
+    {
+        CM730Transaction *transaction;
+        while((transaction = Pop(p)) != 0)
+            Complete(transaction, CM730::TX_FAIL);
+    }
+}
+
+bool CM730Async::IsOwnerThread()
+{
+    return m_Running == true && pthread_equal(pthread_self(), m_Thread) != 0;
+}
+
+double CM730Async::GetTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+void CM730Async::Push(int priority, CM730Transaction *transaction)
+{
+    transaction->m_Next = 0;
+    __sync_synchronize();
+
+    CM730Transaction *prev = __sync_lock_test_and_set(&m_Head[priority], transaction);
+    prev->m_Next = transaction;
+}
+
+CM730Transaction *CM730Async::Pop(int priority)
+{
+    CM730Transaction *stub = &m_Stub[priority];
+    CM730Transaction *tail = m_Tail[priority];
+    CM730Transaction *next = tail->m_Next;
+
+    if(tail == stub)
+    {
+        if(next == 0)
+            return 0;
+        m_Tail[priority] = next;
+        tail = next;
+        next = next->m_Next;
+    }
+
+    if(next != 0)
+    {
+        m_Tail[priority] = next;
+        return tail;
+    }
+
+    // a producer has swapped the head but not linked its transaction yet,
+    // its semaphore post will bring us back here
+    if(tail != m_Head[priority])
+        return 0;
+
+    Push(priority, stub);
+    next = tail->m_Next;
+    if(next != 0)
+    {
+        m_Tail[priority] = next;
+        return tail;
+    }
+
+    return 0;
+}
+
+double CM730Async::GetGapWait(CM730Transaction *transaction)
+{
+    if(m_FramePeriod <= 0 || m_FrameTime == 0)
+        return 0;
+
+    int tx_length, rx_length;
+    m_CM730->GetPacketLength(transaction->txpacket, &tx_length, &rx_length);
+
+    double now = GetTime();
+    double next = m_FrameTime + m_FramePeriod;
+    double cost = (tx_length + rx_length) * BYTE_TIME + TURNAROUND_TIME;
+
+    // it fits before the next motion frame, or the motion loop has stopped
+    if(now + cost <= next || now >= next + m_FramePeriod)
+        return 0;
+
+    return next + m_FramePeriod - now;
+}
+
+bool CM730Async::Submit(CM730Transaction *transaction)
+{
+    if(transaction->m_Done == false)
+        return false;
+
+    __sync_fetch_and_add(&m_Submitting, 1);
+    if(m_Running == false || m_Finish == true)
+    {
+        __sync_fetch_and_sub(&m_Submitting, 1);
+        return false;
+    }
+
+    int priority = transaction->priority;
+    if(priority < 0)
+        priority = 0;
+    else if(priority >= NUMBER_OF_PRIORITIES)
+        priority = NUMBER_OF_PRIORITIES - 1;
+
+    transaction->m_Owner = this;
+    transaction->m_Done = false;
+    transaction->result = CM730::TX_FAIL;
+
+    Push(priority, transaction);
+    if(__sync_bool_compare_and_swap(&m_WakePosted, 0, 1) == true)
+        sem_post(&m_QueueSem);
+
+    __sync_fetch_and_sub(&m_Submitting, 1);
+    return true;
+}
+
+bool CM730Async::SyncWrite(CM730Transaction *transaction, int start_addr, int each_length, int number, int *pParam)
+{
+    if(transaction->IsDone() == false)
+        return false;
+
+    transaction->type = CM730Transaction::SYNC_WRITE;
+    transaction->priority = PRIORITY_MOTION;
+    m_CM730->MakeSyncWritePacket(transaction->txpacket, start_addr, each_length, number, pParam);
+
+    return Submit(transaction);
+}
+
+bool CM730Async::BulkRead(CM730Transaction *transaction)
+{
+    if(transaction->IsDone() == false)
+        return false;
+
+    transaction->type = CM730Transaction::BULK_READ;
+    transaction->priority = PRIORITY_MOTION;
+    if(m_CM730->GetBulkReadPacket(transaction->txpacket, &m_BulkReadSchedule) == false)
+        return false;
+
+    return Submit(transaction);
+}
+
+bool CM730Async::ReadTable(CM730Transaction *transaction, int id, int start_addr, int end_addr, unsigned char *table)
+{
+    if(transaction->IsDone() == false)
+        return false;
+
+    transaction->type = CM730Transaction::READ;
+    transaction->priority = PRIORITY_READ;
+    transaction->start_address = start_addr;
+    transaction->length = end_addr - start_addr + 1;
+    transaction->table = table;
+    m_CM730->MakeReadPacket(transaction->txpacket, id, start_addr, transaction->length);
+
+    return Submit(transaction);
+}
+
+int CM730Async::Execute(unsigned char *txpacket, unsigned char *rxpacket, int priority)
+{
+    CM730Transaction transaction;
+    int tx_length, rx_length;
+
+    m_CM730->GetPacketLength(txpacket, &tx_length, &rx_length);
+    if(tx_length > (int)sizeof(transaction.txpacket))
+        return CM730::TX_CORRUPT;
+
+    transaction.type = CM730Transaction::PACKET;
+    transaction.priority = priority;
+    memcpy(transaction.txpacket, txpacket, tx_length);
+
+    if(Submit(&transaction) == false)
+        return CM730::TX_FAIL;
+
+    int result = transaction.Wait();
+    memcpy(rxpacket, transaction.rxpacket, sizeof(transaction.rxpacket));
+
+    return result;
+}
+
+void CM730Async::Complete(CM730Transaction *transaction, int result)
+{
+    transaction->result = result;
+    if(result == CM730::SUCCESS && transaction->type == CM730Transaction::READ && transaction->table != 0)
+        m_CM730->GetReadData(transaction->rxpacket, transaction->start_address, transaction->length, transaction->table, &transaction->error);
+
+    if(transaction->callback != 0)
+        transaction->callback(transaction, transaction->param);
+
+    pthread_mutex_lock(&m_Mutex);
+    transaction->m_Done = true;
+    pthread_cond_broadcast(&m_DoneCond);
+    pthread_mutex_unlock(&m_Mutex);
+}
+
+void *CM730Async::ThreadProc(void *param)
+{
+    CM730Async *bus = (CM730Async*)param;
+
+    while(bus->m_Finish == false)
+    {
+        // the wakes posted so far are for the transactions about to be looked at: without
+        // this, each one would be a turn of the loop instead of a sleep in the waits below.
+        // Drain before clearing, so that a post of a producer that sees the flag cleared
+        // is never drained before its transaction is looked at
+        while(sem_trywait(&bus->m_QueueSem) == 0)
+            ;
+        __sync_lock_test_and_set(&bus->m_WakePosted, 0);
+        __sync_synchronize();
+
+        // motion traffic has hard precedence
+        CM730Transaction *transaction = bus->Pop(PRIORITY_MOTION);
+        if(transaction != 0)
+        {
+            double now = GetTime();
+            if(now - bus->m_FrameTime > bus->m_FramePeriod / 2)
+                bus->m_FrameTime = now;
+        }
+        else
+        {
+            for(int p = PRIORITY_MOTION + 1; p < NUMBER_OF_PRIORITIES && bus->m_Deferred == 0; p++)
+                bus->m_Deferred = bus->Pop(p);
+
+            if(bus->m_Deferred != 0)
+            {
+                double wait = bus->GetGapWait(bus->m_Deferred);
+                if(wait > 0)
+                {
+                    // sleep until the motion frame shows up or the gap opens
+                    struct timespec until;
+                    clock_gettime(CLOCK_REALTIME, &until);
+                    long nsec = until.tv_nsec + (long)(wait * 1000000.0);
+                    until.tv_sec += nsec / 1000000000;
+                    until.tv_nsec = nsec % 1000000000;
+                    while(sem_timedwait(&bus->m_QueueSem, &until) != 0 && errno == EINTR)
+                        ;
+                    continue;
+                }
+
+                transaction = bus->m_Deferred;
+                bus->m_Deferred = 0;
+            }
+        }
+
+        if(transaction == 0)
+        {
+            sem_wait(&bus->m_QueueSem);
+            continue;
+        }
+
+        int result = bus->m_CM730->TxRxPacket(transaction->txpacket, transaction->rxpacket, transaction->priority);
+        bus->Complete(transaction, result);
+    }
+
+    pthread_exit(0);
+    return 0;
+}
@@ -0,0 +1,650 @@
+/*
+ *   SimulatedCM730.cpp
+ *   A PlatformCM730 without a robot: the CM730 and the 20 MX28 are emulated
+ *   in the process, behind the same Dynamixel 1.0 packets as on the real bus.
+ *
+ */
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "SimulatedCM730.h"
+
+using namespace Robot;
+
+
+// status error bits, INSTRUCTION is taken by the packet layout below
+static const int ERROR_RANGE        = CM730::RANGE;
+static const int ERROR_CHECKSUM     = CM730::CHECKSUM;
+static const int ERROR_INSTRUCTION  = CM730::INSTRUCTION;
+
+#define ID					(2)
+#define LENGTH				(3)
+#define INSTRUCTION			(4)
+#define ERRBIT				(4)
+#define PARAMETER			(5)
+
+#define INST_PING			(1)
+#define INST_READ			(2)
+#define INST_WRITE			(3)
+#define INST_RESET			(6)
+#define INST_SYNC_WRITE		(131)   // 0x83
+#define INST_BULK_READ      (146)   // 0x92
+
+#define MAX_SPEED_RPM		(55.0)	// MX28 at 12V without load
+#define SPEED_UNIT_RPM		(0.114)	// of P_MOVING_SPEED and P_PRESENT_SPEED
+
+const double SimulatedCM730::STEP_TIME = 1.0;
+
+static void SetTableWord(unsigned char *table, int address, int value)
+{
+    table[address]      = (unsigned char)(value & 0xFF);
+    table[address + 1]  = (unsigned char)((value >> 8) & 0xFF);
+}
+
+static int GetTableWord(unsigned char *table, int address)
+{
+    return (table[address + 1] << 8) | table[address];
+}
+
+static double GetMonotonicTime()
+{
+    struct timespec tv;
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return (double)tv.tv_sec * 1000.0 + (double)tv.tv_nsec / 1000000.0;
+}
+
+static unsigned char CalculateChecksum(unsigned char *packet)
+{
+	unsigned char checksum = 0x00;
+	for(int i=2; i<packet[LENGTH]+3; i++ )
+		checksum += packet[i];
+	return (~checksum);
+}
+
+
+SimulatedCM730::SimulatedCM730() :
+        m_Open(false),
+        m_Clock(0.0),
+        m_StepTime(0.0),
+        m_BusFreeTime(0.0),
+        m_PacketStartTime(0.0),
+        m_PacketWaitTime(0.0),
+        m_UpdateStartTime(0.0),
+        m_UpdateWaitTime(0.0),
+        m_TxLength(0),
+        m_RxHead(0),
+        m_RxTail(0),
+        m_Random(1),
+        m_InstructionCount(0),
+        m_FaultCount(0),
+        REAL_TIME(false),
+        LATENCY_TIME(0.0),
+        DROP_BYTE_RATE(0.0),
+        CORRUPT_RATE(0.0),
+        TIMEOUT_RATE(0.0)
+{
+    m_StartTime = GetMonotonicTime();
+
+    SetBaud(1000000);
+
+    ResetDevice(CM730::ID_CM);
+    for(int id = 1; id < JointData::NUMBER_OF_JOINTS; id++)
+    {
+        ResetDevice(id);
+        m_Present[id] = true;
+    }
+    m_Present[0] = false;
+
+    sem_init(&m_LowSemID, 0, 1);
+    sem_init(&m_MidSemID, 0, 1);
+    sem_init(&m_HighSemID, 0, 1);
+}
+
+SimulatedCM730::~SimulatedCM730()
+{
+    sem_destroy(&m_LowSemID);
+    sem_destroy(&m_MidSemID);
+    sem_destroy(&m_HighSemID);
+}
+
+double SimulatedCM730::GetCurrentTime()
+{
+    if(REAL_TIME == false)
+        return m_Clock;
+
+    return GetMonotonicTime() - m_StartTime;
+}
+
+bool SimulatedCM730::Fault(double rate)
+{
+    if(rate <= 0.0)
+        return false;
+
+    m_Random = m_Random * 1103515245 + 12345;
+    if((double)((m_Random >> 8) & 0xFFFFFF) / 16777216.0 >= rate)
+        return false;
+
+    m_FaultCount++;
+    return true;
+}
+
+void SimulatedCM730::ResetDevice(int id)
+{
+    if(id == CM730::ID_CM)
+    {
+        memset(m_CMTable, 0, sizeof(m_CMTable));
+        SetTableWord(m_CMTable, CM730::P_MODEL_NUMBER_L, 0x7300);
+        m_CMTable[CM730::P_VERSION]         = 0x11;
+        m_CMTable[CM730::P_ID]              = CM730::ID_CM;
+        m_CMTable[CM730::P_BAUD_RATE]       = 1;
+        m_CMTable[CM730::P_RETURN_LEVEL]    = 2;
+        // level and at rest
+        SetTableWord(m_CMTable, CM730::P_GYRO_Z_L, 512);
+        SetTableWord(m_CMTable, CM730::P_GYRO_Y_L, 512);
+        SetTableWord(m_CMTable, CM730::P_GYRO_X_L, 512);
+        SetTableWord(m_CMTable, CM730::P_ACCEL_X_L, 512);
+        SetTableWord(m_CMTable, CM730::P_ACCEL_Y_L, 512);
+        SetTableWord(m_CMTable, CM730::P_ACCEL_Z_L, 512);
+        m_CMTable[CM730::P_VOLTAGE]         = 120;
+        return;
+    }
+
+    unsigned char *table = m_Table[id];
+    memset(table, 0, MX28::MAXNUM_ADDRESS);
+    SetTableWord(table, MX28::P_MODEL_NUMBER_L, 29);
+    table[MX28::P_VERSION]                  = 32;
+    table[MX28::P_ID]                       = (unsigned char)id;
+    table[MX28::P_BAUD_RATE]                = 1;
+    SetTableWord(table, MX28::P_CCW_ANGLE_LIMIT_L, MX28::MAX_VALUE);
+    table[MX28::P_HIGH_LIMIT_TEMPERATURE]   = 80;
+    table[MX28::P_LOW_LIMIT_VOLTAGE]        = 60;
+    table[MX28::P_HIGH_LIMIT_VOLTAGE]       = 160;
+    SetTableWord(table, MX28::P_MAX_TORQUE_L, 1023);
+    table[MX28::P_RETURN_LEVEL]             = 2;
+    table[MX28::P_ALARM_LED]                = 36;
+    table[MX28::P_ALARM_SHUTDOWN]           = 36;
+    table[MX28::P_P_GAIN]                   = JointData::P_GAIN_DEFAULT;
+    SetTableWord(table, MX28::P_GOAL_POSITION_L, MX28::CENTER_VALUE);
+    SetTableWord(table, MX28::P_TORQUE_LIMIT_L, 1023);
+    SetTableWord(table, MX28::P_PRESENT_POSITION_L, MX28::CENTER_VALUE);
+    table[MX28::P_PRESENT_VOLTAGE]          = 120;
+    table[MX28::P_PRESENT_TEMPERATURE]      = 40;
+    m_Position[id] = MX28::CENTER_VALUE;
+}
+
+unsigned char *SimulatedCM730::GetTable(int id, int *size)
+{
+    if(id == CM730::ID_CM)
+    {
+        *size = CM730::MAXNUM_ADDRESS;
+        return m_CMTable;
+    }
+
+    if(id <= 0 || id >= JointData::NUMBER_OF_JOINTS)
+        return 0;
+
+    *size = MX28::MAXNUM_ADDRESS;
+    return m_Table[id];
+}
+
+bool SimulatedCM730::IsReachable(int id)
+{
+    if(id == CM730::ID_CM)
+        return true;
+
+    // the servos are behind the Dynamixel power switch of the CM730
+    if(id <= 0 || id >= JointData::NUMBER_OF_JOINTS || m_Present[id] == false)
+        return false;
+
+    return m_CMTable[CM730::P_DXL_POWER] != 0;
+}
+
+void SimulatedCM730::Update()
+{
+    int steps = (int)((GetCurrentTime() - m_StepTime) / STEP_TIME);
+    if(steps <= 0)
+        return;
+
+    double time = steps * STEP_TIME;
+    m_StepTime += time;
+
+    for(int id = 1; id < JointData::NUMBER_OF_JOINTS; id++)
+    {
+        unsigned char *table = m_Table[id];
+        double position = m_Position[id];
+
+        if(table[MX28::P_TORQUE_ENABLE] != 0)
+        {
+            int goal = GetTableWord(table, MX28::P_GOAL_POSITION_L);
+            int cw = GetTableWord(table, MX28::P_CW_ANGLE_LIMIT_L);
+            int ccw = GetTableWord(table, MX28::P_CCW_ANGLE_LIMIT_L);
+            if(cw < ccw)
+                goal = (goal < cw) ? cw : ((goal > ccw) ? ccw : goal);
+
+            // a constant speed per step, so the steps add up to one move
+            int speed = GetTableWord(table, MX28::P_MOVING_SPEED_L) & 0x3FF;
+            double rpm = (speed == 0) ? MAX_SPEED_RPM : speed * SPEED_UNIT_RPM;
+            double move = rpm * (MX28::MAX_VALUE + 1) / 60000.0 * time;
+            double diff = goal - position;
+            if(diff > move)
+                diff = move;
+            else if(diff < -move)
+                diff = -move;
+            position += diff;
+
+            table[MX28::P_MOVING] = (position != goal) ? 1 : 0;
+        }
+        else
+            table[MX28::P_MOVING] = 0;
+
+        // present speed: 0.114 rpm units, bit 10 set when turning clockwise
+        double rpm = (position - m_Position[id]) / time * 60000.0 / (MX28::MAX_VALUE + 1);
+        int speed = (int)((rpm < 0 ? -rpm : rpm) / SPEED_UNIT_RPM + 0.5);
+        if(speed > 1023)
+            speed = 1023;
+        if(rpm < 0 && speed != 0)
+            speed |= 0x400;
+
+        m_Position[id] = position;
+        SetTableWord(table, MX28::P_PRESENT_POSITION_L, (int)(position + 0.5));
+        SetTableWord(table, MX28::P_PRESENT_SPEED_L, speed);
+    }
+}
+
+void SimulatedCM730::SetPresent(int id, bool present)
+{
+    if(id > 0 && id < JointData::NUMBER_OF_JOINTS)
+        m_Present[id] = present;
+}
+
+bool SimulatedCM730::GetPresent(int id)
+{
+    if(id > 0 && id < JointData::NUMBER_OF_JOINTS)
+        return m_Present[id];
+    return id == CM730::ID_CM;
+}
+
+int SimulatedCM730::GetByte(int id, int address)
+{
+    int size;
+    unsigned char *table = GetTable(id, &size);
+    if(table == 0 || address < 0 || address >= size)
+        return 0;
+
+    Update();
+    return table[address];
+}
+
+int SimulatedCM730::GetWord(int id, int address)
+{
+    return (GetByte(id, address + 1) << 8) | GetByte(id, address);
+}
+
+void SimulatedCM730::SetByte(int id, int address, int value)
+{
+    unsigned char data = (unsigned char)value;
+    Update();
+    WriteTable(id, address, &data, 1);
+}
+
+void SimulatedCM730::SetWord(int id, int address, int value)
+{
+    unsigned char data[2] = { (unsigned char)(value & 0xFF), (unsigned char)((value >> 8) & 0xFF) };
+    Update();
+    WriteTable(id, address, data, 2);
+}
+
+bool SimulatedCM730::WriteTable(int id, int address, unsigned char *data, int length)
+{
+    int size;
+    unsigned char *table = GetTable(id, &size);
+    if(table == 0 || address < 0 || length < 0 || address + length > size)
+        return false;
+
+    memcpy(&table[address], data, length);
+
+    if(id == CM730::ID_CM)
+        return true;
+
+    // a goal position turns the torque on, as on the MX28
+    if(address <= MX28::P_GOAL_POSITION_H && address + length > MX28::P_GOAL_POSITION_L)
+        table[MX28::P_TORQUE_ENABLE] = 1;
+
+    // the present position is what Update() integrates
+    if(address <= MX28::P_PRESENT_POSITION_H && address + length > MX28::P_PRESENT_POSITION_L)
+        m_Position[id] = GetTableWord(table, MX28::P_PRESENT_POSITION_L);
+
+    return true;
+}
+
+bool SimulatedCM730::Answer(int id, int instruction, int error, unsigned char *param, int length)
+{
+    if(id == CM730::ID_BROADCAST || IsReachable(id) == false)
+        return false;
+
+    // status return level 0: only PING, 1: only the reads
+    int size;
+    int level = GetTable(id, &size)[MX28::P_RETURN_LEVEL];
+    if(instruction != INST_PING)
+    {
+        if(level == 0)
+            return true;
+        if(level == 1 && instruction != INST_READ && instruction != INST_BULK_READ)
+            return true;
+    }
+
+    if(Fault(TIMEOUT_RATE) == true)
+        return false;
+
+    unsigned char status[MAXNUM_PACKET] = {0, };
+    status[0]       = 0xFF;
+    status[1]       = 0xFF;
+    status[ID]      = (unsigned char)id;
+    status[LENGTH]  = (unsigned char)(length + 2);
+    status[ERRBIT]  = (unsigned char)error;
+    for(int i = 0; i < length; i++)
+        status[PARAMETER + i] = param[i];
+    status[length + 5] = CalculateChecksum(status);
+    if(Fault(CORRUPT_RATE) == true)
+        status[length + 5] = ~status[length + 5];
+
+    // half duplex: the device answers once the bus is free, after its return delay (2 usec units)
+    double time = m_BusFreeTime + GetTable(id, &size)[MX28::P_RETURN_DELAY_TIME] * 0.002;
+    for(int i = 0; i < length + 6; i++)
+    {
+        time += m_ByteTransferTime;
+        if(Fault(DROP_BYTE_RATE) == true || m_RxTail >= MAXNUM_RX_BUFFER)
+            continue;
+
+        m_RxBuffer[m_RxTail] = status[i];
+        m_RxTime[m_RxTail] = time + LATENCY_TIME;
+        m_RxTail++;
+    }
+    m_BusFreeTime = time;
+
+    return true;
+}
+
+void SimulatedCM730::ExecutePacket(unsigned char *packet)
+{
+    int id = packet[ID];
+    int instruction = packet[INSTRUCTION];
+    unsigned char *param = &packet[PARAMETER];
+    int num_param = packet[LENGTH] - 2;
+    int size = 0;
+    unsigned char *table = GetTable(id, &size);
+
+    m_InstructionCount++;
+    Update();
+
+    if(m_RxHead == m_RxTail)
+        m_RxHead = m_RxTail = 0;
+
+    // the instruction is on the bus once the previous answers are through
+    double now = GetCurrentTime();
+    if(m_BusFreeTime < now)
+        m_BusFreeTime = now;
+    m_BusFreeTime += (packet[LENGTH] + 4) * m_ByteTransferTime;
+
+    if(packet[packet[LENGTH] + 3] != CalculateChecksum(packet))
+    {
+        Answer(id, instruction, ERROR_CHECKSUM, 0, 0);
+        return;
+    }
+
+    switch(instruction)
+    {
+    case INST_PING:
+        Answer(id, instruction, 0, 0, 0);
+        break;
+
+    case INST_READ:
+        if(table == 0 || num_param != 2)
+            Answer(id, instruction, ERROR_INSTRUCTION, 0, 0);
+        else if(param[0] + param[1] > size)
+            Answer(id, instruction, ERROR_RANGE, 0, 0);
+        else
+            Answer(id, instruction, 0, &table[param[0]], param[1]);
+        break;
+
+    case INST_WRITE:
+        if(num_param < 2)
+            Answer(id, instruction, ERROR_INSTRUCTION, 0, 0);
+        else if(id == CM730::ID_BROADCAST)
+        {
+            for(int i = 1; i < JointData::NUMBER_OF_JOINTS; i++)
+            {
+                if(IsReachable(i) == true)
+                    WriteTable(i, param[0], &param[1], num_param - 1);
+            }
+        }
+        else if(IsReachable(id) == true)
+        {
+            if(WriteTable(id, param[0], &param[1], num_param - 1) == true)
+                Answer(id, instruction, 0, 0, 0);
+            else
+                Answer(id, instruction, ERROR_RANGE, 0, 0);
+        }
+        break;
+
+    case INST_SYNC_WRITE:
+        // start address, length - 1, then id and data of every device
+        if(num_param >= 2)
+        {
+            int each_length = param[1] + 1;
+            for(int n = 2; n + each_length <= num_param; n += each_length)
+            {
+                if(IsReachable(param[n]) == true)
+                    WriteTable(param[n], param[0], &param[n + 1], each_length - 1);
+            }
+        }
+        break;
+
+    case INST_BULK_READ:
+        // 0, then length, id and start address of every device. Each device answers
+        // after the one before it, so a missing answer silences the rest.
+        for(int n = 1; n + 3 <= num_param; n += 3)
+        {
+            int length = param[n];
+            int address = param[n + 2];
+            unsigned char *data = GetTable(param[n + 1], &size);
+
+            if(data == 0 || address + length > size)
+                break;
+            if(Answer(param[n + 1], instruction, 0, &data[address], length) == false)
+                break;
+        }
+        break;
+
+    case INST_RESET:
+        if(IsReachable(id) == true)
+        {
+            ResetDevice(id);
+            Answer(id, instruction, 0, 0, 0);
+        }
+        break;
+
+    default:
+        // REG_WRITE and ACTION are not emulated
+        Answer(id, instruction, ERROR_INSTRUCTION, 0, 0);
+        break;
+    }
+}
+
+void SimulatedCM730::ParsePacket()
+{
+    while(m_TxLength >= 4)
+    {
+        // re-synchronize on the next header
+        if(m_TxPacket[0] != 0xFF || m_TxPacket[1] != 0xFF || m_TxPacket[ID] == 0xFF || m_TxPacket[LENGTH] < 2)
+        {
+            memmove(m_TxPacket, &m_TxPacket[1], --m_TxLength);
+            continue;
+        }
+
+        int length = m_TxPacket[LENGTH] + 4;
+        if(length > MAXNUM_PACKET)
+        {
+            memmove(m_TxPacket, &m_TxPacket[1], --m_TxLength);
+            continue;
+        }
+        if(m_TxLength < length)
+            return;
+
+        ExecutePacket(m_TxPacket);
+        m_TxLength -= length;
+        memmove(m_TxPacket, &m_TxPacket[length], m_TxLength);
+    }
+}
+
+bool SimulatedCM730::OpenPort()
+{
+    m_Open = true;
+    ClearPort();
+    return true;
+}
+
+bool SimulatedCM730::SetBaud(int baud)
+{
+    if(baud <= 0)
+        return false;
+
+    // 8 data bits, a start and a stop bit
+    m_Baud = baud;
+    m_ByteTransferTime = 10.0 * 1000.0 / baud;
+    return true;
+}
+
+void SimulatedCM730::ClosePort()
+{
+    m_Open = false;
+}
+
+void SimulatedCM730::ClearPort()
+{
+    m_RxHead = m_RxTail = 0;
+    m_TxLength = 0;
+}
+
+int SimulatedCM730::WritePort(unsigned char* packet, int numPacket)
+{
+    if(m_Open == false)
+        return -1;
+
+    for(int i = 0; i < numPacket; i++)
+    {
+        if(m_TxLength == MAXNUM_PACKET)
+            m_TxLength = 0;
+        m_TxPacket[m_TxLength++] = packet[i];
+        ParsePacket();
+    }
+
+    return numPacket;
+}
+
+double SimulatedCM730::GetNextRxTime()
+{
+    if(m_RxHead == m_RxTail)
+        return -1.0;
+    return m_RxTime[m_RxHead];
+}
+
+int SimulatedCM730::ReadPort(unsigned char* packet, int numPacket)
+{
+    if(m_Open == false)
+        return -1;
+
+    double now = GetCurrentTime();
+    int n = 0;
+    while(n < numPacket && m_RxHead < m_RxTail && m_RxTime[m_RxHead] <= now)
+        packet[n++] = m_RxBuffer[m_RxHead++];
+
+    return n;
+}
+
+void SimulatedCM730::LowPriorityWait()
+{
+    sem_wait(&m_LowSemID);
+}
+
+void SimulatedCM730::MidPriorityWait()
+{
+    sem_wait(&m_MidSemID);
+}
+
+void SimulatedCM730::HighPriorityWait()
+{
+    sem_wait(&m_HighSemID);
+}
+
+void SimulatedCM730::LowPriorityRelease()
+{
+    sem_post(&m_LowSemID);
+}
+
+void SimulatedCM730::MidPriorityRelease()
+{
+    sem_post(&m_MidSemID);
+}
+
+void SimulatedCM730::HighPriorityRelease()
+{
+    sem_post(&m_HighSemID);
+}
+
+void SimulatedCM730::SetPacketTimeout(int lenPacket)
+{
+    m_PacketStartTime = GetCurrentTime();
+    m_PacketWaitTime = m_ByteTransferTime * lenPacket + 2.0 * LATENCY_TIME + 2.0;
+}
+
+bool SimulatedCM730::IsPacketTimeout()
+{
+    // same sum as in WaitPort(), which may have set the clock to it
+    return GetCurrentTime() >= m_PacketStartTime + m_PacketWaitTime;
+}
+
+double SimulatedCM730::GetPacketTime()
+{
+    return GetCurrentTime() - m_PacketStartTime;
+}
+
+void SimulatedCM730::SetUpdateTimeout(int msec)
+{
+    m_UpdateStartTime = GetCurrentTime();
+    m_UpdateWaitTime = msec;
+}
+
+bool SimulatedCM730::IsUpdateTimeout()
+{
+    return GetUpdateTime() >= m_UpdateWaitTime;
+}
+
+double SimulatedCM730::GetUpdateTime()
+{
+    return GetCurrentTime() - m_UpdateStartTime;
+}
+
+void SimulatedCM730::Sleep(double msec)
+{
+    if(msec <= 0.0)
+        return;
+
+    if(REAL_TIME == true)
+        usleep((useconds_t)(msec * 1000.0));
+    else
+        m_Clock += msec;
+}
+
+void SimulatedCM730::WaitPort()
+{
+    double time = m_PacketStartTime + m_PacketWaitTime;
+    if(m_RxHead < m_RxTail && m_RxTime[m_RxTail - 1] < time)
+        time = m_RxTime[m_RxTail - 1];
+
+    if(REAL_TIME == true)
+        Sleep(time - GetCurrentTime());
+    else if(m_Clock < time)
+        m_Clock = time;
+}
@@ -0,0 +1,116 @@
+/*
+ *   SyncWriteCache.cpp
+ *   Remembers what was last sent to every servo and strips the
+ *   unchanged joints and registers out of a SyncWrite.
+ *
+ */
+
+#include "SyncWriteCache.h"
+
+using namespace Robot;
+
+
+SyncWriteCache::SyncWriteCache() :
+        m_RefreshPeriod(125),
+        m_Count(0),
+        m_CM730(0),
+        m_DirectWriteCount(0)
+{
+    Invalidate();
+}
+
+void SyncWriteCache::SetCM730(CM730 *cm730)
+{
+    m_CM730 = cm730;
+    if(m_CM730 != 0)
+        m_DirectWriteCount = m_CM730->GetDirectWriteCount();
+    Invalidate();
+}
+
+void SyncWriteCache::Invalidate()
+{
+    for(int id = 0; id < MAXNUM_ID; id++)
+        Invalidate(id);
+}
+
+void SyncWriteCache::Invalidate(int id)
+{
+    for(int addr = 0; addr < MX28::MAXNUM_ADDRESS; addr++)
+        m_Valid[id][addr] = false;
+}
+
+int SyncWriteCache::Filter(int *start_addr, int *each_length, int number, int *pParam)
+{
+    bool present[MAXNUM_ID] = {false, };
+    bool changed[MAXNUM_ID] = {false, };
+    int first = MX28::MAXNUM_ADDRESS, last = -1;
+    int row = *each_length;
+
+    if(m_RefreshPeriod > 0 && ++m_Count >= m_RefreshPeriod)
+    {
+        m_Count = 0;
+        Invalidate();
+    }
+
+    // someone else wrote to the servos since the last call
+    if(m_CM730 != 0 && m_CM730->GetDirectWriteCount() != m_DirectWriteCount)
+    {
+        m_DirectWriteCount = m_CM730->GetDirectWriteCount();
+        Invalidate();
+    }
+
+    // which joints changed, and the window covering all of their changes
+    for(int i = 0; i < number; i++)
+    {
+        int *p = &pParam[i * row];
+        int id = p[0];
+
+        present[id] = true;
+        for(int j = 0; j < row - 1; j++)
+        {
+            int addr = *start_addr + j;
+            if(m_Valid[id][addr] == false || m_Table[id][addr] != (unsigned char)p[1 + j])
+            {
+                changed[id] = true;
+                if(addr < first) first = addr;
+                if(addr > last) last = addr;
+            }
+        }
+    }
+
+    for(int id = 0; id < MAXNUM_ID; id++)
+    {
+        if(present[id] == false && m_Valid[id][*start_addr] == true)
+            Invalidate(id);
+    }
+
+    if(last < 0)
+        return 0;
+
+    // compact in place, rows only get shorter so nothing is overwritten before it is read
+    int n = 0;
+    int joint_num = 0;
+    for(int i = 0; i < number; i++)
+    {
+        int *p = &pParam[i * row];
+        int id = p[0];
+
+        if(changed[id] == false)
+            continue;
+
+        pParam[n++] = id;
+        for(int addr = first; addr <= last; addr++)
+        {
+            int value = p[1 + addr - *start_addr];
+            pParam[n++] = value;
+            m_Table[id][addr] = (unsigned char)value;
+            m_Valid[id][addr] = true;
+        }
+        joint_num++;
+    }
+
+    *start_addr = first;
+    *each_length = last - first + 2;
+
+    return joint_num;
+}
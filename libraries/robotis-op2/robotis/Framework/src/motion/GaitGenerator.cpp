@@ -0,0 +1,153 @@
+/*
+ *   GaitGenerator.cpp
+ *   Renders whole walking cycles offline, e.g. to evaluate many gait parameter sets.
+ *
+ */
+
+#include "MotionModule.h"
+#include "GaitGenerator.h"
+
+using namespace Robot;
+
+
+GaitParameters::GaitParameters()
+{
+    Walking walking;
+    Get(&walking);
+}
+
+void GaitParameters::Get(const Walking *walking)
+{
+    X_OFFSET = walking->X_OFFSET;
+    Y_OFFSET = walking->Y_OFFSET;
+    Z_OFFSET = walking->Z_OFFSET;
+    A_OFFSET = walking->A_OFFSET;
+    P_OFFSET = walking->P_OFFSET;
+    R_OFFSET = walking->R_OFFSET;
+    HIP_PITCH_OFFSET = walking->HIP_PITCH_OFFSET;
+
+    PERIOD_TIME = walking->PERIOD_TIME;
+    DSP_RATIO = walking->DSP_RATIO;
+    STEP_FB_RATIO = walking->STEP_FB_RATIO;
+    Z_MOVE_AMPLITUDE = walking->Z_MOVE_AMPLITUDE;
+    Y_SWAP_AMPLITUDE = walking->Y_SWAP_AMPLITUDE;
+    Z_SWAP_AMPLITUDE = walking->Z_SWAP_AMPLITUDE;
+    PELVIS_OFFSET = walking->PELVIS_OFFSET;
+    ARM_SWING_GAIN = walking->ARM_SWING_GAIN;
+
+    BALANCE_KNEE_GAIN = walking->BALANCE_KNEE_GAIN;
+    BALANCE_ANKLE_PITCH_GAIN = walking->BALANCE_ANKLE_PITCH_GAIN;
+    BALANCE_HIP_ROLL_GAIN = walking->BALANCE_HIP_ROLL_GAIN;
+    BALANCE_ANKLE_ROLL_GAIN = walking->BALANCE_ANKLE_ROLL_GAIN;
+
+    P_GAIN = walking->P_GAIN;
+    I_GAIN = walking->I_GAIN;
+    D_GAIN = walking->D_GAIN;
+
+    X_MOVE_AMPLITUDE = walking->X_MOVE_AMPLITUDE;
+    Y_MOVE_AMPLITUDE = walking->Y_MOVE_AMPLITUDE;
+    A_MOVE_AMPLITUDE = walking->A_MOVE_AMPLITUDE;
+    A_MOVE_AIM_ON = walking->A_MOVE_AIM_ON;
+}
+
+void GaitParameters::Set(Walking *walking) const
+{
+    walking->X_OFFSET = X_OFFSET;
+    walking->Y_OFFSET = Y_OFFSET;
+    walking->Z_OFFSET = Z_OFFSET;
+    walking->A_OFFSET = A_OFFSET;
+    walking->P_OFFSET = P_OFFSET;
+    walking->R_OFFSET = R_OFFSET;
+    walking->HIP_PITCH_OFFSET = HIP_PITCH_OFFSET;
+
+    walking->PERIOD_TIME = PERIOD_TIME;
+    walking->DSP_RATIO = DSP_RATIO;
+    walking->STEP_FB_RATIO = STEP_FB_RATIO;
+    walking->Z_MOVE_AMPLITUDE = Z_MOVE_AMPLITUDE;
+    walking->Y_SWAP_AMPLITUDE = Y_SWAP_AMPLITUDE;
+    walking->Z_SWAP_AMPLITUDE = Z_SWAP_AMPLITUDE;
+    walking->PELVIS_OFFSET = PELVIS_OFFSET;
+    walking->ARM_SWING_GAIN = ARM_SWING_GAIN;
+
+    walking->BALANCE_KNEE_GAIN = BALANCE_KNEE_GAIN;
+    walking->BALANCE_ANKLE_PITCH_GAIN = BALANCE_ANKLE_PITCH_GAIN;
+    walking->BALANCE_HIP_ROLL_GAIN = BALANCE_HIP_ROLL_GAIN;
+    walking->BALANCE_ANKLE_ROLL_GAIN = BALANCE_ANKLE_ROLL_GAIN;
+
+    walking->P_GAIN = P_GAIN;
+    walking->I_GAIN = I_GAIN;
+    walking->D_GAIN = D_GAIN;
+
+    walking->X_MOVE_AMPLITUDE = X_MOVE_AMPLITUDE;
+    walking->Y_MOVE_AMPLITUDE = Y_MOVE_AMPLITUDE;
+    walking->A_MOVE_AMPLITUDE = A_MOVE_AMPLITUDE;
+    walking->A_MOVE_AIM_ON = A_MOVE_AIM_ON;
+}
+
+void GaitParameters::LoadINISettings(minIni* ini)
+{
+    LoadINISettings(ini, WALKING_SECTION);
+}
+
+void GaitParameters::LoadINISettings(minIni* ini, const std::string &section)
+{
+    Walking walking;
+
+    Set(&walking);
+    walking.LoadINISettings(ini, section);
+    Get(&walking);
+}
+
+
+GaitGenerator::GaitGenerator()
+{
+}
+
+GaitGenerator::~GaitGenerator()
+{
+}
+
+int GaitGenerator::GetMaxTicks(const GaitParameters &param, int cycles)
+{
+    // Process() jumps to the middle of the period once per cycle, hence the extra tick
+    return cycles * ((int)(param.PERIOD_TIME / MotionModule::TIME_UNIT) + 2);
+}
+
+int GaitGenerator::Render(const GaitParameters &param, int cycles, int *buffer, int max_ticks)
+{
+    int ticks = 0;
+    int cycle = 0;
+    int phase = Walking::PHASE0;
+
+    if(cycles <= 0)
+        return 0;
+
+    // Initialize() clears the walking command, it is set afterwards
+    param.Set(&m_Walking);
+    m_Walking.BALANCE_ENABLE = false;
+    m_Walking.Initialize();
+    m_Walking.X_MOVE_AMPLITUDE = param.X_MOVE_AMPLITUDE;
+    m_Walking.Y_MOVE_AMPLITUDE = param.Y_MOVE_AMPLITUDE;
+    m_Walking.A_MOVE_AMPLITUDE = param.A_MOVE_AMPLITUDE;
+    m_Walking.Start();
+
+    while(ticks < max_ticks)
+    {
+        m_Walking.Process();
+
+        // a new period starts when the phase wraps around
+        if(phase == Walking::PHASE3 && m_Walking.GetCurrentPhase() == Walking::PHASE0)
+        {
+            if(++cycle >= cycles)
+                break;
+        }
+        phase = m_Walking.GetCurrentPhase();
+
+        int *row = &buffer[ticks * JointData::NUMBER_OF_JOINTS];
+        for(int id = 0; id < JointData::NUMBER_OF_JOINTS; id++)
+            row[id] = m_Walking.m_Joint.GetValue(id);
+        ticks++;
+    }
+
+    return ticks;
+}
@@ -11,11 +11,12 @@
 
 using namespace Robot;
 
-JointData::JointData()
+JointData::JointData() :
+        m_Manager(0)
 {
+    m_EnableMask = (1 << NUMBER_OF_JOINTS) - 1;
     for(int i=0; i<NUMBER_OF_JOINTS; i++)
     {
-        m_Enable[i] = true;
         m_Value[i] = MX28::CENTER_VALUE;
         m_Angle[i] = 0.0;
         m_PGain[i] = P_GAIN_DEFAULT;
@@ -30,15 +31,22 @@ JointData::~JointData()
 
 void JointData::SetEnable(int id, bool enable)
 {
-    m_Enable[id] = enable;
+    if(enable == true)
+        m_EnableMask |= (1 << id);
+    else
+        m_EnableMask &= ~(1 << id);
 }
 
 void JointData::SetEnable(int id, bool enable, bool exclusive)
 {
 #ifndef WEBOTS // Because MotionManager is not included in the lite version of the Framework used in the simulation
-    if(enable && exclusive) MotionManager::GetInstance()->SetJointDisable(id);
+    if(enable && exclusive)
+    {
+        MotionManager *manager = (m_Manager != 0) ? m_Manager : MotionManager::GetInstance();
+        manager->SetJointDisable(id);
+    }
 #endif
-    m_Enable[id] = enable;
+    SetEnable(id, enable);
 }
 
 void JointData::SetEnableHeadOnly(bool enable)
@@ -154,7 +162,7 @@ void JointData::SetEnableBody(bool enable, bool exclusive)
 
 bool JointData::GetEnable(int id)
 {
-    return m_Enable[id];
+    return (m_EnableMask & (1 << id)) != 0;
 }
 
 void JointData::SetValue(int id, int value)
@@ -199,3 +207,51 @@ double JointData::GetRadian(int id)
     return GetAngle(id) * (180.0 / 3.141592);
 }
 
+void JointData::Merge(JointData &joints)
+{
+    Merge(joints, joints.m_EnableMask);
+}
+
+void JointData::Merge(JointData &joints, unsigned int mask)
+{
+    // branch-free selects over whole arrays, the compiler turns them into vector blends
+    for(int id = 1; id < NUMBER_OF_JOINTS; id++)
+    {
+        bool enable = (mask & (1 << id)) != 0;
+
+        int value = joints.m_Value[id];
+        value = (value < MX28::MIN_VALUE) ? MX28::MIN_VALUE : value;
+        value = (value >= MX28::MAX_VALUE) ? MX28::MAX_VALUE : value;
+
+        m_Value[id] = enable ? value : m_Value[id];
+        m_Angle[id] = enable ? MX28::Value2Angle(value) : m_Angle[id];
+        m_PGain[id] = enable ? joints.m_PGain[id] : m_PGain[id];
+        m_IGain[id] = enable ? joints.m_IGain[id] : m_IGain[id];
+        m_DGain[id] = enable ? joints.m_DGain[id] : m_DGain[id];
+    }
+}
+
+int JointData::MakeSyncWriteParam(int *param, int *offset)
+{
+    int n = 0;
+    int joint_num = 0;
+
+    for(int id = 1; id < NUMBER_OF_JOINTS; id++)
+    {
+        if((m_EnableMask & (1 << id)) == 0)
+            continue;
+
+        int value = m_Value[id] + offset[id];
+        param[n++] = id;
+        param[n++] = m_DGain[id];
+        param[n++] = m_IGain[id];
+        param[n++] = m_PGain[id];
+        param[n++] = 0;
+        param[n++] = value & 0xFF;
+        param[n++] = (value >> 8) & 0xFF;
+        joint_num++;
+    }
+
+    return joint_num;
+}
+
@@ -7,29 +7,50 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <unistd.h>
+#include <time.h>
 #include "FSR.h"
 #include "MX28.h"
 #include "MotionManager.h"
+#include "CM730Async.h"
 
 using namespace Robot;
 
-MotionManager* MotionManager::m_UniqueInstance = new MotionManager();
+MotionManager* MotionManager::m_UniqueInstance = new MotionManager(MotionStatus::GetDefault());
 
-MotionManager::MotionManager() :
+MotionManager::MotionManager(MotionState *status) :
+        m_OwnershipChanged(false),
+        m_Status((status != 0) ? status : &m_OwnStatus),
         m_CM730(0),
+        m_Bus(0),
+        m_SyncWriteTransaction(0),
+        m_BulkReadTransaction(0),
         m_ProcessEnable(false),
         m_Enabled(false),
+        m_GyroWindowIndex(0),
+        m_AccelWindowIndex(0),
         m_IsRunning(false),
         m_IsThreadRunning(false),
         m_IsLogging(false),
         DEBUG_PRINT(false)
 {
     for(int i = 0; i < JointData::NUMBER_OF_JOINTS; i++)
+    {
         m_Offset[i] = 0;
+        m_JointOwner[i] = 0;
+    }
+    for(int i = 0; i < GYRO_WINDOW_SIZE; i++)
+    {
+        m_FBGyroWindow[i] = (i == 0) ? 512 : 0;
+        m_RLGyroWindow[i] = (i == 0) ? 512 : 0;
+    }
+    for(int i = 0; i < ACCEL_WINDOW_SIZE; i++)
+        m_FBAccelWindow[i] = (i == 0) ? 512 : 0;
 }
 
 MotionManager::~MotionManager()
 {
+    SetPipelineEnable(false);
 }
 
 bool MotionManager::Initialize(CM730 *cm730)
@@ -37,6 +58,8 @@ bool MotionManager::Initialize(CM730 *cm730)
 	int value, error;
 
 	m_CM730 = cm730;
+	m_CM730->SetBulkReadJoints(&m_Status->m_CurrentJoints);
+	m_SyncWriteCache.SetCM730(m_CM730);
 	m_Enabled = false;
 	m_ProcessEnable = true;
 
@@ -54,15 +77,15 @@ bool MotionManager::Initialize(CM730 *cm730)
 		
 		if(m_CM730->ReadWord(id, MX28::P_PRESENT_POSITION_L, &value, &error) == CM730::SUCCESS)
 		{
-			MotionStatus::m_CurrentJoints.SetValue(id, value);
-			MotionStatus::m_CurrentJoints.SetEnable(id, true);
+			m_Status->m_CurrentJoints.SetValue(id, value);
+			m_Status->m_CurrentJoints.SetEnable(id, true);
 
 			if(DEBUG_PRINT == true)
 				fprintf(stderr, "[%d] Success\n", value);
 		}
 		else
 		{
-			MotionStatus::m_CurrentJoints.SetEnable(id, false);
+			m_Status->m_CurrentJoints.SetEnable(id, false);
 
 			if(DEBUG_PRINT == true)
 				fprintf(stderr, " Fail\n");
@@ -90,15 +113,15 @@ bool MotionManager::Reinitialize()
 		
 		if(m_CM730->ReadWord(id, MX28::P_PRESENT_POSITION_L, &value, &error) == CM730::SUCCESS)
 		{
-			MotionStatus::m_CurrentJoints.SetValue(id, value);
-			MotionStatus::m_CurrentJoints.SetEnable(id, true);
+			m_Status->m_CurrentJoints.SetValue(id, value);
+			m_Status->m_CurrentJoints.SetEnable(id, true);
 
 			if(DEBUG_PRINT == true)
 				fprintf(stderr, "[%d] Success\n", value);
 		}
 		else
 		{
-			MotionStatus::m_CurrentJoints.SetEnable(id, false);
+			m_Status->m_CurrentJoints.SetEnable(id, false);
 
 			if(DEBUG_PRINT == true)
 				fprintf(stderr, " Fail\n");
@@ -166,8 +189,6 @@ void MotionManager::SaveINISettings(minIni* ini, const std::string &section)
     }
 }
 
-#define GYRO_WINDOW_SIZE    100
-#define ACCEL_WINDOW_SIZE   30
 #define MARGIN_OF_SD        2.0
 void MotionManager::Process()
 {
@@ -176,12 +197,21 @@ void MotionManager::Process()
 
     m_IsRunning = true;
 
+    // the bulk read queued by the previous tick is collected here
+    if(m_Bus != 0)
+    {
+        if(m_SyncWriteTransaction->Wait() != CM730::SUCCESS)
+            m_SyncWriteCache.Invalidate();
+        m_BulkReadTransaction->Wait();
+        ProcessBulkReadData();
+    }
+
     // calibrate gyro sensor
     if(m_CalibrationStatus == 0 || m_CalibrationStatus == -1)
     {
-        static int fb_gyro_array[GYRO_WINDOW_SIZE] = {512,};
-        static int rl_gyro_array[GYRO_WINDOW_SIZE] = {512,};
-        static int buf_idx = 0;
+        int *fb_gyro_array = m_FBGyroWindow;
+        int *rl_gyro_array = m_RLGyroWindow;
+        int &buf_idx = m_GyroWindowIndex;
 
         if(buf_idx < GYRO_WINDOW_SIZE)
         {
@@ -239,15 +269,15 @@ void MotionManager::Process()
 
     if(m_CalibrationStatus == 1 && m_Enabled == true)
     {
-        static int fb_array[ACCEL_WINDOW_SIZE] = {512,};
-        static int buf_idx = 0;
+        int *fb_array = m_FBAccelWindow;
+        int &buf_idx = m_AccelWindowIndex;
         if(m_CM730->m_BulkReadData[CM730::ID_CM].error == 0)
         {
-            MotionStatus::FB_GYRO = m_CM730->m_BulkReadData[CM730::ID_CM].ReadWord(CM730::P_GYRO_Y_L) - m_FBGyroCenter;
-            MotionStatus::RL_GYRO = m_CM730->m_BulkReadData[CM730::ID_CM].ReadWord(CM730::P_GYRO_X_L) - m_RLGyroCenter;
-            MotionStatus::RL_ACCEL = m_CM730->m_BulkReadData[CM730::ID_CM].ReadWord(CM730::P_ACCEL_X_L);
-            MotionStatus::FB_ACCEL = m_CM730->m_BulkReadData[CM730::ID_CM].ReadWord(CM730::P_ACCEL_Y_L);
-            fb_array[buf_idx] = MotionStatus::FB_ACCEL;
+            m_Status->FB_GYRO = m_CM730->m_BulkReadData[CM730::ID_CM].ReadWord(CM730::P_GYRO_Y_L) - m_FBGyroCenter;
+            m_Status->RL_GYRO = m_CM730->m_BulkReadData[CM730::ID_CM].ReadWord(CM730::P_GYRO_X_L) - m_RLGyroCenter;
+            m_Status->RL_ACCEL = m_CM730->m_BulkReadData[CM730::ID_CM].ReadWord(CM730::P_ACCEL_X_L);
+            m_Status->FB_ACCEL = m_CM730->m_BulkReadData[CM730::ID_CM].ReadWord(CM730::P_ACCEL_Y_L);
+            fb_array[buf_idx] = m_Status->FB_ACCEL;
             if(++buf_idx >= ACCEL_WINDOW_SIZE) buf_idx = 0;
         }
 
@@ -257,62 +287,81 @@ void MotionManager::Process()
         avr = sum / ACCEL_WINDOW_SIZE;
 
         if(avr < MotionStatus::FALLEN_F_LIMIT)
-            MotionStatus::FALLEN = FORWARD;
+            m_Status->FALLEN = FORWARD;
         else if(avr > MotionStatus::FALLEN_B_LIMIT)
-            MotionStatus::FALLEN = BACKWARD;
+            m_Status->FALLEN = BACKWARD;
         else
-            MotionStatus::FALLEN = STANDUP;
+            m_Status->FALLEN = STANDUP;
 
         if(m_Modules.size() != 0)
         {
-            for(std::list<MotionModule*>::iterator i = m_Modules.begin(); i != m_Modules.end(); i++)
+            for(std::list<ModuleEntry>::iterator i = m_Modules.begin(); i != m_Modules.end(); i++)
             {
-                (*i)->Process();
-                for(int id=JointData::ID_R_SHOULDER_PITCH; id<JointData::NUMBER_OF_JOINTS; id++)
-                {
-                    if((*i)->m_Joint.GetEnable(id) == true)
-                    {
-                        MotionStatus::m_CurrentJoints.SetValue(id, (*i)->m_Joint.GetValue(id));
-
-                        MotionStatus::m_CurrentJoints.SetPGain(id, (*i)->m_Joint.GetPGain(id));
-                        MotionStatus::m_CurrentJoints.SetIGain(id, (*i)->m_Joint.GetIGain(id));
-                        MotionStatus::m_CurrentJoints.SetDGain(id, (*i)->m_Joint.GetDGain(id));
-                    }
-                }
+                if(i->module->m_Joint.GetEnableMask() != i->enable_mask)
+                    m_OwnershipChanged = true;
             }
-        }
+            if(m_OwnershipChanged == true)
+                ResolveOwnership();
 
-        int param[JointData::NUMBER_OF_JOINTS * MX28::PARAM_BYTES];
-        int n = 0;
-        int joint_num = 0;
-        for(int id=JointData::ID_R_SHOULDER_PITCH; id<JointData::NUMBER_OF_JOINTS; id++)
-        {
-            if(MotionStatus::m_CurrentJoints.GetEnable(id) == true)
+            for(std::list<ModuleEntry>::iterator i = m_Modules.begin(); i != m_Modules.end(); i++)
             {
-                param[n++] = id;
-                param[n++] = MotionStatus::m_CurrentJoints.GetDGain(id);
-                param[n++] = MotionStatus::m_CurrentJoints.GetIGain(id);
-                param[n++] = MotionStatus::m_CurrentJoints.GetPGain(id);
-                param[n++] = 0;
-                param[n++] = CM730::GetLowByte(MotionStatus::m_CurrentJoints.GetValue(id) + m_Offset[id]);
-                param[n++] = CM730::GetHighByte(MotionStatus::m_CurrentJoints.GetValue(id) + m_Offset[id]);
-                joint_num++;
+                if(i->owned_mask == 0)
+                    continue;
+
+                i->module->Process();
+                m_Status->m_CurrentJoints.Merge(i->module->m_Joint, i->owned_mask);
             }
+        }
 
-            if(DEBUG_PRINT == true)
-                fprintf(stderr, "ID[%d] : %d \n", id, MotionStatus::m_CurrentJoints.GetValue(id));
+        int param[JointData::NUMBER_OF_JOINTS * MX28::PARAM_BYTES];
+        int joint_num = m_Status->m_CurrentJoints.MakeSyncWriteParam(param, m_Offset);
+
+        if(DEBUG_PRINT == true)
+        {
+            for(int id=JointData::ID_R_SHOULDER_PITCH; id<JointData::NUMBER_OF_JOINTS; id++)
+                fprintf(stderr, "ID[%d] : %d \n", id, m_Status->m_CurrentJoints.GetValue(id));
         }
 
+        // only the joints and registers that changed since the last tick go on the bus
+        int start_addr = MX28::P_D_GAIN;
+        int each_length = MX28::PARAM_BYTES;
+        joint_num = m_SyncWriteCache.Filter(&start_addr, &each_length, joint_num, param);
+
         if(joint_num > 0)
-            m_CM730->SyncWrite(MX28::P_D_GAIN, MX28::PARAM_BYTES, joint_num, param);
+        {
+            bool sent;
+            if(m_Bus != 0)
+                sent = m_Bus->SyncWrite(m_SyncWriteTransaction, start_addr, each_length, joint_num, param);
+            else
+                sent = (m_CM730->SyncWrite(start_addr, each_length, joint_num, param) == CM730::SUCCESS);
+
+            if(sent == false)
+                m_SyncWriteCache.Invalidate();
+        }
+    }
+
+    if(m_Bus != 0)
+        m_Bus->BulkRead(m_BulkReadTransaction);
+    else
+    {
+        m_CM730->BulkRead();
+        ProcessBulkReadData();
     }
 
-    m_CM730->BulkRead();
+    // readers in other threads get this tick as one consistent snapshot
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    m_Status->Publish(now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0);
 
+    m_IsRunning = false;
+}
+
+void MotionManager::ProcessBulkReadData()
+{
     if(m_IsLogging)
     {
         for(int id = 1; id < JointData::NUMBER_OF_JOINTS; id++)
-            m_LogFileStream << MotionStatus::m_CurrentJoints.GetValue(id) << "," << m_CM730->m_BulkReadData[id].ReadWord(MX28::P_PRESENT_POSITION_L) << ",";
+            m_LogFileStream << m_Status->m_CurrentJoints.GetValue(id) << "," << m_CM730->m_BulkReadData[id].ReadWord(MX28::P_PRESENT_POSITION_L) << ",";
 
         m_LogFileStream << m_CM730->m_BulkReadData[CM730::ID_CM].ReadWord(CM730::P_GYRO_Y_L) << ",";
         m_LogFileStream << m_CM730->m_BulkReadData[CM730::ID_CM].ReadWord(CM730::P_GYRO_X_L) << ",";
@@ -326,9 +375,58 @@ void MotionManager::Process()
     }
 
     if(m_CM730->m_BulkReadData[CM730::ID_CM].error == 0)
-        MotionStatus::BUTTON = m_CM730->m_BulkReadData[CM730::ID_CM].ReadByte(CM730::P_BUTTON);
+        m_Status->BUTTON = m_CM730->m_BulkReadData[CM730::ID_CM].ReadByte(CM730::P_BUTTON);
+}
 
-    m_IsRunning = false;
+bool MotionManager::SetPipelineEnable(bool enable)
+{
+    if(enable == (m_Bus != 0))
+        return true;
+
+    if(enable == true && m_CM730 == 0)
+        return false;
+
+    // keep the timer out of Process() while the bus is switched
+    bool process_enable = m_ProcessEnable;
+    m_ProcessEnable = false;
+    while(m_IsRunning == true)
+        usleep(1000);
+
+    if(enable == true)
+    {
+        m_Bus = new CM730Async(m_CM730);
+        m_Bus->SetFramePeriod(MotionModule::TIME_UNIT);
+        m_SyncWriteTransaction = new CM730Transaction();
+        m_BulkReadTransaction = new CM730Transaction();
+        if(m_Bus->Start() == false)
+        {
+            if(DEBUG_PRINT == true)
+                fprintf(stderr, "Fail to start the CM730 I/O thread\n");
+            delete m_Bus;
+            delete m_SyncWriteTransaction;
+            delete m_BulkReadTransaction;
+            m_Bus = 0;
+            m_SyncWriteTransaction = 0;
+            m_BulkReadTransaction = 0;
+            m_ProcessEnable = process_enable;
+            return false;
+        }
+    }
+    else
+    {
+        m_SyncWriteTransaction->Wait();
+        m_BulkReadTransaction->Wait();
+        m_Bus->Stop();
+        delete m_Bus;
+        delete m_SyncWriteTransaction;
+        delete m_BulkReadTransaction;
+        m_Bus = 0;
+        m_SyncWriteTransaction = 0;
+        m_BulkReadTransaction = 0;
+    }
+
+    m_ProcessEnable = process_enable;
+    return true;
 }
 
 void MotionManager::SetEnable(bool enable)
@@ -340,20 +438,95 @@ void MotionManager::SetEnable(bool enable)
 
 void MotionManager::AddModule(MotionModule *module)
 {
+	AddModule(module, 0);
+}
+
+void MotionManager::AddModule(MotionModule *module, int priority)
+{
+	module->m_Status = m_Status;
 	module->Initialize();
-	m_Modules.push_back(module);
+
+	ModuleEntry entry;
+	entry.module = module;
+	entry.priority = priority;
+	entry.enable_mask = 0;
+	entry.owned_mask = 0;
+	m_Modules.push_back(entry);
+	module->m_Joint.m_Manager = this;
+	m_OwnershipChanged = true;
 }
 
 void MotionManager::RemoveModule(MotionModule *module)
 {
-	m_Modules.remove(module);
+	for(std::list<ModuleEntry>::iterator i = m_Modules.begin(); i != m_Modules.end(); )
+	{
+		if(i->module == module)
+		{
+			module->m_Joint.m_Manager = 0;
+			module->m_Status = MotionStatus::GetDefault();
+			i = m_Modules.erase(i);
+		}
+		else
+			i++;
+	}
+	m_OwnershipChanged = true;
+}
+
+void MotionManager::SetModulePriority(MotionModule *module, int priority)
+{
+	for(std::list<ModuleEntry>::iterator i = m_Modules.begin(); i != m_Modules.end(); i++)
+	{
+		if(i->module == module)
+			i->priority = priority;
+	}
+	m_OwnershipChanged = true;
+}
+
+unsigned int MotionManager::GetOwnedJoints(MotionModule *module)
+{
+	for(std::list<ModuleEntry>::iterator i = m_Modules.begin(); i != m_Modules.end(); i++)
+	{
+		if(i->module == module)
+			return i->owned_mask;
+	}
+	return 0;
+}
+
+void MotionManager::ResolveOwnership()
+{
+	ModuleEntry *owner[JointData::NUMBER_OF_JOINTS] = {0,};
+
+	// in the order the modules were added, so that on a tie the one added last takes the joint
+	for(std::list<ModuleEntry>::iterator i = m_Modules.begin(); i != m_Modules.end(); i++)
+	{
+		i->enable_mask = i->module->m_Joint.GetEnableMask();
+		i->owned_mask = 0;
+
+		for(int id = 1; id < JointData::NUMBER_OF_JOINTS; id++)
+		{
+			if((i->enable_mask & (1 << id)) && (owner[id] == 0 || i->priority >= owner[id]->priority))
+				owner[id] = &(*i);
+		}
+	}
+
+	for(int id = 0; id < JointData::NUMBER_OF_JOINTS; id++)
+	{
+		m_JointOwner[id] = 0;
+		if(owner[id] != 0)
+		{
+			owner[id]->owned_mask |= (1 << id);
+			m_JointOwner[id] = owner[id]->module;
+		}
+	}
+
+	m_OwnershipChanged = false;
 }
 
 void MotionManager::SetJointDisable(int index)
 {
     if(m_Modules.size() != 0)
     {
-        for(std::list<MotionModule*>::iterator i = m_Modules.begin(); i != m_Modules.end(); i++)
-            (*i)->m_Joint.SetEnable(index, false);
+        for(std::list<ModuleEntry>::iterator i = m_Modules.begin(); i != m_Modules.end(); i++)
+            i->module->m_Joint.SetEnable(index, false);
     }
 }
@@ -9,11 +9,85 @@
 
 using namespace Robot;
 
-JointData MotionStatus::m_CurrentJoints;
-int MotionStatus::FB_GYRO(0);
-int MotionStatus::RL_GYRO(0);
-int MotionStatus::FB_ACCEL(0);
-int MotionStatus::RL_ACCEL(0);
-
-int MotionStatus::BUTTON(0);
-int MotionStatus::FALLEN(0);
+MotionState MotionStatus::m_Default;
+
+JointData &MotionStatus::m_CurrentJoints(m_Default.m_CurrentJoints);
+int &MotionStatus::FB_GYRO(m_Default.FB_GYRO);
+int &MotionStatus::RL_GYRO(m_Default.RL_GYRO);
+int &MotionStatus::FB_ACCEL(m_Default.FB_ACCEL);
+int &MotionStatus::RL_ACCEL(m_Default.RL_ACCEL);
+
+int &MotionStatus::BUTTON(m_Default.BUTTON);
+int &MotionStatus::FALLEN(m_Default.FALLEN);
+
+
+MotionStatusSnapshot::MotionStatusSnapshot() :
+        tick(0),
+        time(0),
+        FB_GYRO(0),
+        RL_GYRO(0),
+        FB_ACCEL(0),
+        RL_ACCEL(0),
+        BUTTON(0),
+        FALLEN(0)
+{
+}
+
+MotionState::MotionState() :
+        m_Sequence(0),
+        FB_GYRO(0),
+        RL_GYRO(0),
+        FB_ACCEL(0),
+        RL_ACCEL(0),
+        BUTTON(0),
+        FALLEN(0)
+{
+}
+
+void MotionState::Publish(double time)
+{
+    m_Sequence++;
+    __sync_synchronize();
+
+    m_Snapshot.tick++;
+    m_Snapshot.time = time;
+    m_Snapshot.joints = m_CurrentJoints;
+    m_Snapshot.FB_GYRO = FB_GYRO;
+    m_Snapshot.RL_GYRO = RL_GYRO;
+    m_Snapshot.FB_ACCEL = FB_ACCEL;
+    m_Snapshot.RL_ACCEL = RL_ACCEL;
+    m_Snapshot.BUTTON = BUTTON;
+    m_Snapshot.FALLEN = FALLEN;
+
+    __sync_synchronize();
+    m_Sequence++;
+}
+
+void MotionState::GetSnapshot(MotionStatusSnapshot *snapshot)
+{
+    unsigned int sequence;
+
+    do
+    {
+        while((sequence = m_Sequence) & 1)
+            ;
+        __sync_synchronize();
+
+        *snapshot = m_Snapshot;
+
+        __sync_synchronize();
+    }
+    while(sequence != m_Sequence);
+
+    // nothing published yet: the motion thread is not running, the live values are all there is
+    if(snapshot->tick == 0)
+    {
+        snapshot->joints = m_CurrentJoints;
+        snapshot->FB_GYRO = FB_GYRO;
+        snapshot->RL_GYRO = RL_GYRO;
+        snapshot->FB_ACCEL = FB_ACCEL;
+        snapshot->RL_ACCEL = RL_ACCEL;
+        snapshot->BUTTON = BUTTON;
+        snapshot->FALLEN = FALLEN;
+    }
+}
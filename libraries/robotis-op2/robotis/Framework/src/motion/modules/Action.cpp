@@ -12,25 +12,80 @@
 using namespace Robot;
 
 
+static unsigned int HashName(const char *name)
+{
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+
+    for(int i = 0; i <= Action::MAXNUM_NAME && name[i] != 0; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static bool MatchName(const char *name, const Action::PAGE *pPage)
+{
+    return strncmp(name, (const char*)pPage->header.name, Action::MAXNUM_NAME + 1) == 0;
+}
+
 Action* Action::m_UniqueInstance = new Action();
 
 Action::Action()
 {
     DEBUG_PRINT = false;
     m_ActionFile = 0;
+    m_PageData = 0;
     m_Playing = false;
+    m_PlayPage = &m_StartPage;
+    m_NextPlayPage = &m_StartPage;
+
+    COMPILE_ENABLE = true;
+    BLEND_TIME = 0;
+    m_QueuedPage = 0;
+    m_PreemptPage = 0;
+    m_BlendTicks = 0;
+    m_KeyframeIndex = -1;
+    m_LoopKeyframe = -1;
+    m_CompiledMask = 0;
+    memset(m_CompiledPose, 0, sizeof(m_CompiledPose));
+    memset(&m_EndState, 0, sizeof(m_EndState));
+
+    ResetPage(&m_EmptyPage);
+    BuildPageTable();
+
+    memset(m_StartAngle1024, 0, sizeof(m_StartAngle1024));
+    memset(m_TargetAngle1024, 0, sizeof(m_TargetAngle1024));
+    memset(m_MovingAngle1024, 0, sizeof(m_MovingAngle1024));
+    memset(m_MainAngle1024, 0, sizeof(m_MainAngle1024));
+    memset(m_AccelAngle1024, 0, sizeof(m_AccelAngle1024));
+    memset(m_MainSpeed1024, 0, sizeof(m_MainSpeed1024));
+    memset(m_LastOutSpeed1024, 0, sizeof(m_LastOutSpeed1024));
+    memset(m_GoalSpeed1024, 0, sizeof(m_GoalSpeed1024));
+    memset(m_FinishType, 0, sizeof(m_FinishType));
+    m_UnitTimeCount = 0;
+    m_UnitTimeNum = 0;
+    m_PauseTime = 0;
+    m_UnitTimeTotalNum = 0;
+    m_AccelStep = 0;
+    m_Section = 0;
+    m_PlayRepeatCount = 0;
+    m_NextPlayPageIndex = 0;
 }
 
 Action::~Action()
 {
+    ClosePages();
     if(m_ActionFile != 0)
         fclose( m_ActionFile );
 }
 
-bool Action::VerifyChecksum( PAGE *pPage )
+bool Action::VerifyChecksum( const PAGE *pPage )
 {
     unsigned char checksum = 0x00;
-    unsigned char *pt = (unsigned char*)pPage;
+    const unsigned char *pt = (const unsigned char*)pPage;
 
     for(unsigned int i = 0; i < sizeof(PAGE); i++)
     {
@@ -90,12 +145,72 @@ void Action::ResetPage(PAGE *pPage)
     SetChecksum( pPage );
 }
 
+// The whole file is read once: a mapping would let page faults or another writer
+// of the file reach the motion thread
+bool Action::OpenPages( FILE *file )
+{
+    PAGE *pages = new PAGE[MAXNUM_PAGE];
+    if( fseek( file, 0, SEEK_SET ) != 0 || fread( pages, sizeof(PAGE), MAXNUM_PAGE, file ) != MAXNUM_PAGE )
+    {
+        delete[] pages;
+        return false;
+    }
+
+    m_PageData = pages;
+    return true;
+}
+
+void Action::ClosePages()
+{
+    if( m_PageData == 0 )
+        return;
+
+    delete[] m_PageData;
+    m_PageData = 0;
+    BuildPageTable();
+}
+
+// Pages are verified once here rather than on every read, a page with a wrong
+// checksum reads as an empty page
+void Action::BuildPageTable()
+{
+    for(int i=0; i<MAXNUM_PAGE; i++)
+    {
+        if( m_PageData != 0 && VerifyChecksum( &m_PageData[i] ) == true )
+            m_PageTable[i] = &m_PageData[i];
+        else
+            m_PageTable[i] = &m_EmptyPage;
+    }
+
+    BuildNameIndex();
+}
+
+void Action::BuildNameIndex()
+{
+    memset(m_NameIndex, 0, sizeof(m_NameIndex));
+
+    for(int index=1; index<MAXNUM_PAGE; index++)
+    {
+        const char *name = (const char*)m_PageTable[index]->header.name;
+        unsigned int slot = HashName(name) & (NAME_INDEX_SIZE - 1);
+
+        // linear probing, the first page with a name keeps it
+        while( m_NameIndex[slot] != 0 && MatchName(name, m_PageTable[m_NameIndex[slot]]) == false )
+            slot = (slot + 1) & (NAME_INDEX_SIZE - 1);
+
+        if( m_NameIndex[slot] == 0 )
+            m_NameIndex[slot] = (unsigned char)index;
+    }
+}
+
 void Action::Initialize()
 {
+    m_QueuedPage = 0;
+    m_PreemptPage = 0;
     m_Playing = false;
 
     for( int id=JointData::ID_R_SHOULDER_PITCH; id<JointData::NUMBER_OF_JOINTS; id++ )
-        m_Joint.SetValue(id, MotionStatus::m_CurrentJoints.GetValue(id));
+        m_Joint.SetValue(id, m_Status->m_CurrentJoints.GetValue(id));
 }
 
 bool Action::LoadFile( char* filename )
@@ -115,6 +230,15 @@ bool Action::LoadFile( char* filename )
         return false;
     }
 
+    // the page being played is one of the pages read from the file
+    if( m_Playing == true )
+    {
+        if(DEBUG_PRINT == true)
+            fprintf(stderr, "Can not load Action file.(Now playing)\n");
+        fclose( action );
+        return false;
+    }
+
     fseek( action, 0, SEEK_END );
     if( ftell(action) != (long)(sizeof(PAGE) * MAXNUM_PAGE) )
     {
@@ -124,15 +248,32 @@ bool Action::LoadFile( char* filename )
         return false;
     }
 
+    ClosePages();
+    if( OpenPages( action ) == false )
+    {
+        if(DEBUG_PRINT == true)
+            fprintf(stderr, "Can not read Action file!\n");
+        fclose( action );
+        return false;
+    }
+
     if(m_ActionFile != 0)
         fclose( m_ActionFile );
 
     m_ActionFile = action;
+    BuildPageTable();
     return true;
 }
 
 bool Action::CreateFile(char* filename)
 {
+    if( m_Playing == true )
+    {
+        if(DEBUG_PRINT == true)
+            fprintf(stderr, "Can not create Action file.(Now playing)\n");
+        return false;
+    }
+
     FILE *action = fopen( filename, "ab" );
     if( action == 0 )
     {
@@ -149,7 +290,14 @@ bool Action::CreateFile(char* filename)
     if(m_ActionFile != 0)
         fclose( m_ActionFile );
 
+    // the file is write only, its pages are kept in memory
+    ClosePages();
+    m_PageData = new PAGE[MAXNUM_PAGE];
+    for(int i=0; i<MAXNUM_PAGE; i++)
+        m_PageData[i] = page;
+
     m_ActionFile = action;
+    BuildPageTable();
     return true;
 }
 
@@ -162,28 +310,24 @@ bool Action::Start(int iPage)
         return false;
     }
 
-    PAGE page;
-    if( LoadPage(iPage, &page) == false )
+    if( m_PageData == 0 )
         return false;
 
-    return Start(iPage, &page);
+    return StartPage(iPage, m_PageTable[iPage]);
 }
 
 bool Action::Start(char* namePage)
 {
-    int index;
-    PAGE page;
+    int index = FindPage(namePage);
 
-    for(index=1; index<MAXNUM_PAGE; index++)
+    if( index < 0 )
     {
-        if(LoadPage(index, &page) == false)
-            return false;
-
-        if(strcmp(namePage, (char*)page.header.name) == 0)
-            break;
+        if(DEBUG_PRINT == true)
+            fprintf(stderr, "Can not play page.(no page named %s)\n", namePage);
+        return false;
     }
 
-    return Start(index, &page);
+    return StartPage(index, m_PageTable[index]);
 }
 
 bool Action::Start(int index, PAGE *pPage)
@@ -195,21 +339,81 @@ bool Action::Start(int index, PAGE *pPage)
         return false;
     }
 
-    m_PlayPage = *pPage;
+    m_StartPage = *pPage;
+
+    return StartPage(index, &m_StartPage);
+}
+
+bool Action::StartPage(int index, const PAGE *pPage)
+{
+    if(m_Playing == true)
+    {
+        if(DEBUG_PRINT == true)
+            fprintf(stderr, "Can not play page %d.(Now playing)\n", index);
+        return false;
+    }
 
-    if( m_PlayPage.header.repeat == 0 || m_PlayPage.header.stepnum == 0 )
+    if( pPage->header.repeat == 0 || pPage->header.stepnum == 0 )
     {
         if(DEBUG_PRINT == true)
             fprintf(stderr, "Page %d has no action\n", index);
         return false;
     }
 
+    m_KeyframeIndex = -1;
+    if( COMPILE_ENABLE == true && Compile(index, pPage) == true )
+        m_KeyframeIndex = 0;
+
+    m_PlayPage = pPage;
     m_IndexPlayingPage = index;
     m_FirstDrivingStart = true;    
     m_Playing = true;
     return true;
 }
 
+bool Action::CheckRequest(int iPage)
+{
+    if( iPage < 1 || iPage >= MAXNUM_PAGE || m_PageData == 0 )
+    {
+        if(DEBUG_PRINT == true)
+            fprintf(stderr, "Can not play page.(%d is invalid index)\n", iPage);
+        return false;
+    }
+
+    if( m_PageTable[iPage]->header.repeat == 0 || m_PageTable[iPage]->header.stepnum == 0 )
+    {
+        if(DEBUG_PRINT == true)
+            fprintf(stderr, "Page %d has no action\n", iPage);
+        return false;
+    }
+
+    return true;
+}
+
+bool Action::Queue(int iPage)
+{
+    if( CheckRequest(iPage) == false )
+        return false;
+
+    if( m_Playing == false )
+        return Start(iPage);
+
+    __sync_lock_test_and_set(&m_QueuedPage, iPage);
+    return true;
+}
+
+bool Action::Preempt(int iPage)
+{
+    if( CheckRequest(iPage) == false )
+        return false;
+
+    if( m_Playing == false )
+        return Start(iPage);
+
+    __sync_lock_test_and_set(&m_PreemptPage, iPage);
+    return true;
+}
+
 void Action::Stop()
 {
     m_StopPlaying = true;
@@ -217,12 +421,14 @@ void Action::Stop()
 
 void Action::Brake()
 {
+    __sync_lock_test_and_set(&m_QueuedPage, 0);
+    __sync_lock_test_and_set(&m_PreemptPage, 0);
     m_Playing = false;
 }
 
 bool Action::IsRunning()
 {
-    return m_Playing;
+    return m_Playing == true || m_QueuedPage != 0 || m_PreemptPage != 0;
 }
 
 bool Action::IsRunning(int *iPage, int *iStep)
@@ -238,17 +444,10 @@ bool Action::IsRunning(int *iPage, int *iStep)
 
 bool Action::LoadPage(int index, PAGE *pPage)
 {
-    long position = (long)(sizeof(PAGE)*index);
-
-    if( fseek( m_ActionFile, position, SEEK_SET ) != 0 )
-        return false;
-
-    if( fread( pPage, 1, sizeof(PAGE), m_ActionFile ) != sizeof(PAGE) )
+    if( m_PageData == 0 || index < 0 || index >= MAXNUM_PAGE )
         return false;
 
-    if( VerifyChecksum( pPage ) == false )
-        ResetPage( pPage );
-
+    *pPage = *m_PageTable[index];
     return true;
 }
 
@@ -256,6 +455,18 @@ bool Action::SavePage(int index, PAGE *pPage)
 {
     long position = (long)(sizeof(PAGE)*index);
 
+    if( m_PageData == 0 || index < 0 || index >= MAXNUM_PAGE )
+        return false;
+
+    // the motion thread reads the pages of the chain it plays, and a compiled chain
+    // was built from their content at Start()
+    if( m_Playing == true )
+    {
+        if(DEBUG_PRINT == true)
+            fprintf(stderr, "Can not save page.(Now playing)\n");
+        return false;
+    }
+
     if( VerifyChecksum(pPage) == false )
         SetChecksum(pPage);
 
@@ -264,11 +475,351 @@ bool Action::SavePage(int index, PAGE *pPage)
 
     if( fwrite( pPage, 1, sizeof(PAGE), m_ActionFile ) != sizeof(PAGE) )
         return false;
-    
+
+    fflush( m_ActionFile );
+    m_PageData[index] = *pPage;
+
+    m_PageTable[index] = &m_PageData[index];
+    BuildNameIndex();
     return true;
 }
 
+const Action::PAGE *Action::GetPage(int index)
+{
+    if( index < 0 || index >= MAXNUM_PAGE )
+        return 0;
+
+    return m_PageTable[index];
+}
+
+int Action::FindPage(const char *namePage)
+{
+    unsigned int slot = HashName(namePage) & (NAME_INDEX_SIZE - 1);
+
+    while( m_NameIndex[slot] != 0 )
+    {
+        if( MatchName(namePage, m_PageTable[m_NameIndex[slot]]) == true )
+            return m_NameIndex[slot];
+        slot = (slot + 1) & (NAME_INDEX_SIZE - 1);
+    }
+
+    return -1;
+}
+
+void Action::SaveState(PLAYSTATE *pState)
+{
+    memset(pState, 0, sizeof(PLAYSTATE));
+
+    pState->play_page = m_PlayPage;
+    pState->next_play_page = m_NextPlayPage;
+    pState->index_playing_page = m_IndexPlayingPage;
+    pState->page_step_count = m_PageStepCount;
+    pState->playing = m_Playing;
+    pState->first_driving_start = m_FirstDrivingStart;
+    pState->stop_playing = m_StopPlaying;
+    pState->playing_finished = m_PlayingFinished;
+    memcpy(pState->start_angle1024, m_StartAngle1024, sizeof(m_StartAngle1024));
+    memcpy(pState->target_angle1024, m_TargetAngle1024, sizeof(m_TargetAngle1024));
+    memcpy(pState->moving_angle1024, m_MovingAngle1024, sizeof(m_MovingAngle1024));
+    memcpy(pState->main_angle1024, m_MainAngle1024, sizeof(m_MainAngle1024));
+    memcpy(pState->accel_angle1024, m_AccelAngle1024, sizeof(m_AccelAngle1024));
+    memcpy(pState->main_speed1024, m_MainSpeed1024, sizeof(m_MainSpeed1024));
+    memcpy(pState->last_out_speed1024, m_LastOutSpeed1024, sizeof(m_LastOutSpeed1024));
+    memcpy(pState->goal_speed1024, m_GoalSpeed1024, sizeof(m_GoalSpeed1024));
+    memcpy(pState->finish_type, m_FinishType, sizeof(m_FinishType));
+    pState->unit_time_count = m_UnitTimeCount;
+    pState->unit_time_num = m_UnitTimeNum;
+    pState->pause_time = m_PauseTime;
+    pState->unit_time_total_num = m_UnitTimeTotalNum;
+    pState->accel_step = m_AccelStep;
+    pState->section = m_Section;
+    pState->play_repeat_count = m_PlayRepeatCount;
+    pState->next_play_page_index = m_NextPlayPageIndex;
+
+    for(int id=0; id<JointData::NUMBER_OF_JOINTS; id++)
+    {
+        pState->value[id] = m_Joint.GetValue(id);
+        pState->p_gain[id] = m_Joint.GetPGain(id);
+    }
+}
+
+void Action::RestoreState(const PLAYSTATE *pState)
+{
+    m_PlayPage = pState->play_page;
+    m_NextPlayPage = pState->next_play_page;
+    m_IndexPlayingPage = pState->index_playing_page;
+    m_PageStepCount = pState->page_step_count;
+    m_Playing = pState->playing;
+    m_FirstDrivingStart = pState->first_driving_start;
+    m_StopPlaying = pState->stop_playing;
+    m_PlayingFinished = pState->playing_finished;
+    memcpy(m_StartAngle1024, pState->start_angle1024, sizeof(m_StartAngle1024));
+    memcpy(m_TargetAngle1024, pState->target_angle1024, sizeof(m_TargetAngle1024));
+    memcpy(m_MovingAngle1024, pState->moving_angle1024, sizeof(m_MovingAngle1024));
+    memcpy(m_MainAngle1024, pState->main_angle1024, sizeof(m_MainAngle1024));
+    memcpy(m_AccelAngle1024, pState->accel_angle1024, sizeof(m_AccelAngle1024));
+    memcpy(m_MainSpeed1024, pState->main_speed1024, sizeof(m_MainSpeed1024));
+    memcpy(m_LastOutSpeed1024, pState->last_out_speed1024, sizeof(m_LastOutSpeed1024));
+    memcpy(m_GoalSpeed1024, pState->goal_speed1024, sizeof(m_GoalSpeed1024));
+    memcpy(m_FinishType, pState->finish_type, sizeof(m_FinishType));
+    m_UnitTimeCount = pState->unit_time_count;
+    m_UnitTimeNum = pState->unit_time_num;
+    m_PauseTime = pState->pause_time;
+    m_UnitTimeTotalNum = pState->unit_time_total_num;
+    m_AccelStep = pState->accel_step;
+    m_Section = pState->section;
+    m_PlayRepeatCount = pState->play_repeat_count;
+    m_NextPlayPageIndex = pState->next_play_page_index;
+
+    for(int id=JointData::ID_R_SHOULDER_PITCH; id<JointData::NUMBER_OF_JOINTS; id++)
+    {
+        if(m_Joint.GetEnable(id) == true)
+        {
+            m_Joint.SetValue(id, pState->value[id]);
+            m_Joint.SetPGain(id, pState->p_gain[id]);
+        }
+    }
+}
+
+// Runs the interpolation of a whole page chain ahead of time, on a scratch Action
+// sharing the pages of this one. The chain only depends on the pages, the enabled
+// joints and the pose it starts from, except for Stop() which changes the next page
+// picked at the last step of a page: the state before each of these ticks is kept
+// so that the interpolation can take over from there.
+bool Action::Compile(int index, const PAGE *pPage)
+{
+    Action compiler;
+    PLAYSTATE state;
+    std::vector<int> checkpoint_keyframe;
+
+    m_Keyframes.clear();
+    m_Checkpoints.clear();
+    m_LoopKeyframe = -1;
+
+    memcpy(compiler.m_PageTable, m_PageTable, sizeof(m_PageTable));
+    compiler.m_Joint = m_Joint;
+    compiler.m_Status = m_Status;
+    compiler.m_PlayPage = pPage;
+    compiler.m_IndexPlayingPage = index;
+    compiler.m_FirstDrivingStart = true;
+    compiler.m_Playing = true;
+    m_CompiledMask = m_Joint.GetEnableMask();
+
+    while( compiler.m_Playing == true )
+    {
+        if( m_Keyframes.size() == MAXNUM_KEYFRAME )
+        {
+            // too long, interpret the rest from the last checkpoint
+            if( m_Checkpoints.empty() == true )
+            {
+                m_Keyframes.clear();
+                return false;
+            }
+            m_Keyframes.resize(checkpoint_keyframe.back());
+            m_EndState = m_Checkpoints.back();
+            m_Checkpoints.pop_back();
+            return true;
+        }
+
+        compiler.SaveState(&state);
+        compiler.Interpret();
+
+        // the first tick reads the pose to start from
+        if( m_Keyframes.empty() == true )
+        {
+            for(int id=0; id<JointData::NUMBER_OF_JOINTS; id++)
+                m_CompiledPose[id] = compiler.m_StartAngle1024[id];
+        }
+
+        KEYFRAME frame;
+        frame.checkpoint = -1;
+
+        // the next page has been picked on this tick
+        if( compiler.m_Playing == true && compiler.m_Section == PRE_SECTION && compiler.m_UnitTimeCount == 0
+            && compiler.m_PageStepCount == compiler.m_PlayPage->header.stepnum )
+        {
+            // the same state as on an earlier pick, the chain cycles from there
+            for(unsigned int i=0; i<m_Checkpoints.size(); i++)
+            {
+                if( memcmp(&state, &m_Checkpoints[i], sizeof(PLAYSTATE)) == 0 )
+                {
+                    m_LoopKeyframe = checkpoint_keyframe[i];
+                    return true;
+                }
+            }
+
+            frame.checkpoint = m_Checkpoints.size();
+            m_Checkpoints.push_back(state);
+            checkpoint_keyframe.push_back(m_Keyframes.size());
+        }
+
+        for(int id=0; id<JointData::NUMBER_OF_JOINTS; id++)
+        {
+            frame.value[id] = compiler.m_Joint.GetValue(id);
+            frame.p_gain[id] = compiler.m_Joint.GetPGain(id);
+            frame.speed1024[id] = (compiler.m_Section == PAUSE_SECTION) ? 0 : compiler.m_GoalSpeed1024[id];
+        }
+        frame.page = compiler.m_IndexPlayingPage;
+        frame.step = compiler.m_PageStepCount;
+        m_Keyframes.push_back(frame);
+    }
+
+    compiler.SaveState(&m_EndState);
+    return true;
+}
+
+void Action::PlayKeyframe()
+{
+    if( m_FirstDrivingStart == true )
+    {
+        // the chain was compiled for the joints and the pose at Start(), if they have changed
+        // since then the interpreter starts the chain from the current pose instead
+        bool same_pose = (m_Joint.GetEnableMask() == m_CompiledMask);
+        for(int id=JointData::ID_R_SHOULDER_PITCH; id<JointData::NUMBER_OF_JOINTS && same_pose == true; id++)
+        {
+            if(m_Joint.GetEnable(id) == true && m_Status->m_CurrentJoints.GetValue(id) != m_CompiledPose[id])
+                same_pose = false;
+        }
+
+        if( same_pose == false )
+        {
+            m_KeyframeIndex = -1;
+            Interpret();
+            return;
+        }
+
+        m_FirstDrivingStart = false;
+        m_PlayingFinished = false;
+        m_StopPlaying = false;
+    }
+
+    if( m_KeyframeIndex >= (int)m_Keyframes.size() )
+    {
+        if( m_LoopKeyframe >= 0 )
+            m_KeyframeIndex = m_LoopKeyframe;
+        else
+        {
+            RestoreState(&m_EndState);
+            m_KeyframeIndex = -1;
+            Interpret();
+            return;
+        }
+    }
+
+    const KEYFRAME *frame = &m_Keyframes[m_KeyframeIndex];
+    if( (m_StopPlaying == true || m_QueuedPage != 0) && frame->checkpoint >= 0 )
+    {
+        // neither the exit links nor the queued page are compiled
+        bool stop = m_StopPlaying;
+        RestoreState(&m_Checkpoints[frame->checkpoint]);
+        m_StopPlaying = stop;
+        m_KeyframeIndex = -1;
+        Interpret();
+        return;
+    }
+
+    for(int id=JointData::ID_R_SHOULDER_PITCH; id<JointData::NUMBER_OF_JOINTS; id++)
+    {
+        if(m_CompiledMask & (1 << id))
+        {
+            m_Joint.SetValue(id, frame->value[id]);
+            m_Joint.SetPGain(id, frame->p_gain[id]);
+        }
+    }
+    m_IndexPlayingPage = frame->page;
+    m_PageStepCount = frame->step;
+
+    m_KeyframeIndex++;
+    if( m_KeyframeIndex == (int)m_Keyframes.size() && m_LoopKeyframe < 0 && m_EndState.playing == false )
+    {
+        RestoreState(&m_EndState);
+        m_KeyframeIndex = -1;
+    }
+}
+
+// Goes on from the current pose and joint speeds as if the current step had just
+// ended, the first step of the new page then starts without stopping the joints
+void Action::TakePreemptPage(int index)
+{
+    m_PlayPage = m_PageTable[index];
+    m_IndexPlayingPage = index;
+
+    if( m_FirstDrivingStart == true ) // nothing played yet
+    {
+        m_KeyframeIndex = -1;
+        return;
+    }
+
+    for(int id=JointData::ID_R_SHOULDER_PITCH; id<JointData::NUMBER_OF_JOINTS; id++)
+    {
+        if(m_Joint.GetEnable(id) == true)
+        {
+            m_TargetAngle1024[id] = m_Joint.GetValue(id);
+            if( m_KeyframeIndex > 0 )
+                m_GoalSpeed1024[id] = m_Keyframes[m_KeyframeIndex - 1].speed1024[id];
+            else if( m_Section == PAUSE_SECTION )
+                m_GoalSpeed1024[id] = 0;
+        }
+    }
+
+    m_PageStepCount = 0;
+    m_PlayRepeatCount = m_PlayPage->header.repeat;
+    m_NextPlayPageIndex = 0;
+    m_PlayingFinished = false;
+    m_StopPlaying = false;
+    m_Section = POST_SECTION;
+    m_PauseTime = 0;
+    m_UnitTimeCount = 0;
+    m_UnitTimeNum = 0;
+    m_KeyframeIndex = -1;
+
+    m_BlendTicks = 0;
+    if( BLEND_TIME > 0 )
+    {
+        m_BlendTicks = (unsigned short)(BLEND_TIME / TIME_UNIT + 0.5);
+        if( m_BlendTicks == 0 )
+            m_BlendTicks = 1;
+    }
+}
+
 void Action::Process()
+{
+    if( m_Playing == false )
+    {
+        // asked for after the chain had ended, start from scratch. There is
+        // no time to compile the chain here. A queued page waits for the end
+        // of the preempting one.
+        int index = __sync_lock_test_and_set(&m_PreemptPage, 0);
+        if( index == 0 )
+            index = __sync_lock_test_and_set(&m_QueuedPage, 0);
+        if( index == 0 )
+            return;
+
+        m_PlayPage = m_PageTable[index];
+        m_IndexPlayingPage = index;
+        m_KeyframeIndex = -1;
+        m_FirstDrivingStart = true;
+        m_Playing = true;
+    }
+    else if( m_PreemptPage != 0 )
+    {
+        // Brake() may have taken it back in the meantime
+        int index = __sync_lock_test_and_set(&m_PreemptPage, 0);
+        if( index != 0 )
+            TakePreemptPage(index);
+    }
+
+    // a blend left over from a braked page does not apply to the next one
+    if( m_FirstDrivingStart == true )
+        m_BlendTicks = 0;
+
+    if( m_KeyframeIndex >= 0 )
+        PlayKeyframe();
+    else
+        Interpret();
+}
+
+void Action::Interpret()
 {
     ////////////////////  
     unsigned char bID;
@@ -287,24 +838,24 @@ void Action::Process()
     unsigned char bDirectionChanged;
 
     ///////////////// Static 
-    static unsigned short wpStartAngle1024[JointData::NUMBER_OF_JOINTS]; //   
-    static unsigned short wpTargetAngle1024[JointData::NUMBER_OF_JOINTS]; //   
-    static short int ipMovingAngle1024[JointData::NUMBER_OF_JOINTS]; //   Ÿ
-    static short int ipMainAngle1024[JointData::NUMBER_OF_JOINTS]; //    Ÿ
-    static short int ipAccelAngle1024[JointData::NUMBER_OF_JOINTS]; //    Ÿ
-    static short int ipMainSpeed1024[JointData::NUMBER_OF_JOINTS]; // ǥ ӵ
-    static short int ipLastOutSpeed1024[JointData::NUMBER_OF_JOINTS]; //    ӵ()
-    static short int ipGoalSpeed1024[JointData::NUMBER_OF_JOINTS]; // Ͱ   ǥӵ
-    static unsigned char bpFinishType[JointData::NUMBER_OF_JOINTS]; //    
+    unsigned short *wpStartAngle1024 = m_StartAngle1024; //   
+    unsigned short *wpTargetAngle1024 = m_TargetAngle1024; //   
+    short int *ipMovingAngle1024 = m_MovingAngle1024; //   Ÿ
+    short int *ipMainAngle1024 = m_MainAngle1024; //    Ÿ
+    short int *ipAccelAngle1024 = m_AccelAngle1024; //    Ÿ
+    short int *ipMainSpeed1024 = m_MainSpeed1024; // ǥ ӵ
+    short int *ipLastOutSpeed1024 = m_LastOutSpeed1024; //    ӵ()
+    short int *ipGoalSpeed1024 = m_GoalSpeed1024; // Ͱ   ǥӵ
+    unsigned char *bpFinishType = m_FinishType; //    
     short int iSpeedN;
-    static unsigned short wUnitTimeCount;
-    static unsigned short wUnitTimeNum;
-    static unsigned short wPauseTime;
-    static unsigned short wUnitTimeTotalNum;
-    static unsigned short wAccelStep;
-    static unsigned char bSection;
-    static unsigned char bPlayRepeatCount;
-    static unsigned short wNextPlayPage;
+    unsigned short &wUnitTimeCount = m_UnitTimeCount;
+    unsigned short &wUnitTimeNum = m_UnitTimeNum;
+    unsigned short &wPauseTime = m_PauseTime;
+    unsigned short &wUnitTimeTotalNum = m_UnitTimeTotalNum;
+    unsigned short &wAccelStep = m_AccelStep;
+    unsigned char &bSection = m_Section;
+    unsigned char &bPlayRepeatCount = m_PlayRepeatCount;
+    unsigned short &wNextPlayPage = m_NextPlayPageIndex;
 
     /////////////// Enum 
 
@@ -316,8 +867,6 @@ void Action::Process()
     * -----/  |        |  |    |   \----
     *      PRE  MAIN   PRE MAIN POST PAUSE
     ***************************************/
-    enum{ PRE_SECTION, MAIN_SECTION, POST_SECTION, PAUSE_SECTION };
-    enum{ ZERO_FINISH, NONE_ZERO_FINISH};
 
     if( m_Playing == false )
         return;
@@ -332,14 +881,14 @@ void Action::Process()
         wPauseTime = 0;
         bSection = PAUSE_SECTION;
         m_PageStepCount = 0;
-        bPlayRepeatCount = m_PlayPage.header.repeat;
+        bPlayRepeatCount = m_PlayPage->header.repeat;
         wNextPlayPage = 0;
 
         for( bID=JointData::ID_R_SHOULDER_PITCH; bID<JointData::NUMBER_OF_JOINTS; bID++ )
         {
             if(m_Joint.GetEnable(bID) == true)
             {
-                wpTargetAngle1024[bID] = MotionStatus::m_CurrentJoints.GetValue(bID);
+                wpTargetAngle1024[bID] = m_Status->m_CurrentJoints.GetValue(bID);
                 ipLastOutSpeed1024[bID] = 0;
                 ipMovingAngle1024[bID] = 0;
                 ipGoalSpeed1024[bID] = 0;
@@ -404,8 +953,8 @@ void Action::Process()
                     }
 
                     // lastest MX28 firmwares do not support compliance slopes
-                    //m_Joint.SetSlope(bID, 1 << (m_PlayPage.header.slope[bID]>>4), 1 << (m_PlayPage.header.slope[bID]&0x0f));                    
-                    m_Joint.SetPGain(bID, (256 >> (m_PlayPage.header.slope[bID]>>4)) << 2);
+                    //m_Joint.SetSlope(bID, 1 << (m_PlayPage->header.slope[bID]>>4), 1 << (m_PlayPage->header.slope[bID]&0x0f));                    
+                    m_Joint.SetPGain(bID, (256 >> (m_PlayPage->header.slope[bID]>>4)) << 2);
                 }
             }
         }
@@ -494,22 +1043,22 @@ void Action::Process()
 
             m_PageStepCount++;
 
-            if( m_PageStepCount > m_PlayPage.header.stepnum ) //    ٸ
+            if( m_PageStepCount > m_PlayPage->header.stepnum ) //    ٸ
             {
                 //   
                 m_PlayPage = m_NextPlayPage;
                 if( m_IndexPlayingPage != wNextPlayPage )
-                    bPlayRepeatCount = m_PlayPage.header.repeat;
+                    bPlayRepeatCount = m_PlayPage->header.repeat;
                 m_PageStepCount = 1;
                 m_IndexPlayingPage = wNextPlayPage;
             }
 
-            if( m_PageStepCount == m_PlayPage.header.stepnum ) //  ̶
+            if( m_PageStepCount == m_PlayPage->header.stepnum ) //  ̶
             {
                 //   ε
                 if( m_StopPlaying == true ) //    ִٸ
                 {
-                    wNextPlayPage = m_PlayPage.header.exit; //   Exit 
+                    wNextPlayPage = m_PlayPage->header.exit; //   Exit 
                 }
                 else
                 {
@@ -517,28 +1066,37 @@ void Action::Process()
                     if( bPlayRepeatCount > 0 ) // ݺ Ƚ Ҵٸ
                         wNextPlayPage = m_IndexPlayingPage; //    
                     else // ݺ ߴٸ
-                        wNextPlayPage = m_PlayPage.header.next; //   Next 
+                        wNextPlayPage = m_PlayPage->header.next; //   Next 
+                }
+
+                // the chain ends here, go on with the queued page
+                if( wNextPlayPage == 0 && m_QueuedPage != 0 )
+                {
+                    wNextPlayPage = __sync_lock_test_and_set(&m_QueuedPage, 0);
+                    m_StopPlaying = false;
+                    if( wNextPlayPage == m_IndexPlayingPage )
+                        bPlayRepeatCount = m_PlayPage->header.repeat;
                 }
 
                 if( wNextPlayPage == 0 ) //    ٸ  ܱϰ 
                     m_PlayingFinished = true;
                 else
                 {
-                    //  ε( ޸ , ٸ  б)
+                    // next page, taken from the page table without any file access
                     if( m_IndexPlayingPage != wNextPlayPage )
-                        LoadPage( wNextPlayPage, &m_NextPlayPage );
+                        m_NextPlayPage = m_PageTable[wNextPlayPage];
                     else
                         m_NextPlayPage = m_PlayPage;
 
                     //   ٸ  ܱϰ 
-                    if( m_NextPlayPage.header.repeat == 0 || m_NextPlayPage.header.stepnum == 0 )
+                    if( m_NextPlayPage->header.repeat == 0 || m_NextPlayPage->header.stepnum == 0 )
                         m_PlayingFinished = true;
                 }
             }
 
             //////// Step Ķ 
-            wPauseTime = (((unsigned short)m_PlayPage.step[m_PageStepCount-1].pause) << 5) / m_PlayPage.header.speed;
-            wMaxSpeed256 = ((unsigned short)m_PlayPage.step[m_PageStepCount-1].time * (unsigned short)m_PlayPage.header.speed) >> 5;
+            wPauseTime = (((unsigned short)m_PlayPage->step[m_PageStepCount-1].pause) << 5) / m_PlayPage->header.speed;
+            wMaxSpeed256 = ((unsigned short)m_PlayPage->step[m_PageStepCount-1].time * (unsigned short)m_PlayPage->header.speed) >> 5;
             if( wMaxSpeed256 == 0 )
                 wMaxSpeed256 = 1;
             wMaxAngle1024 = 0;
@@ -552,10 +1110,10 @@ void Action::Process()
                     ipAccelAngle1024[bID] = 0;
 
                     // Find current target angle
-                    if( m_PlayPage.step[m_PageStepCount-1].position[bID] & INVALID_BIT_MASK )
+                    if( m_PlayPage->step[m_PageStepCount-1].position[bID] & INVALID_BIT_MASK )
                         wCurrentTargetAngle = wpTargetAngle1024[bID];
                     else
-                        wCurrentTargetAngle = m_PlayPage.step[m_PageStepCount-1].position[bID];
+                        wCurrentTargetAngle = m_PlayPage->step[m_PageStepCount-1].position[bID];
 
                     // Update start, prev_target, curr_target
                     wpStartAngle1024[bID] = wpTargetAngle1024[bID];
@@ -566,24 +1124,24 @@ void Action::Process()
                     ipMovingAngle1024[bID] = (int)(wpTargetAngle1024[bID] - wpStartAngle1024[bID]);
 
                     // Find Next target angle
-                    if( m_PageStepCount == m_PlayPage.header.stepnum ) //   ̶
+                    if( m_PageStepCount == m_PlayPage->header.stepnum ) //   ̶
                     {
                         if( m_PlayingFinished == true ) //  ̶
                             wNextTargetAngle = wCurrentTargetAngle;
                         else
                         {
-                            if( m_NextPlayPage.step[0].position[bID] & INVALID_BIT_MASK )
+                            if( m_NextPlayPage->step[0].position[bID] & INVALID_BIT_MASK )
                                 wNextTargetAngle = wCurrentTargetAngle;
                             else
-                                wNextTargetAngle = m_NextPlayPage.step[0].position[bID];
+                                wNextTargetAngle = m_NextPlayPage->step[0].position[bID];
                         }
                     }
                     else
                     {
-                        if( m_PlayPage.step[m_PageStepCount].position[bID] & INVALID_BIT_MASK )
+                        if( m_PlayPage->step[m_PageStepCount].position[bID] & INVALID_BIT_MASK )
                             wNextTargetAngle = wCurrentTargetAngle;
                         else
-                            wNextTargetAngle = m_PlayPage.step[m_PageStepCount].position[bID];
+                            wNextTargetAngle = m_PlayPage->step[m_PageStepCount].position[bID];
                     }
 
                     // Find direction change
@@ -608,7 +1166,7 @@ void Action::Process()
                         bpFinishType[bID] = NONE_ZERO_FINISH;
                     }
 
-                    if( m_PlayPage.header.schedule == SPEED_BASE_SCHEDULE )
+                    if( m_PlayPage->header.schedule == SPEED_BASE_SCHEDULE )
                     {
                         //MaxAngle1024 update
                         if( ipMovingAngle1024[bID] < 0 )
@@ -628,12 +1186,19 @@ void Action::Process()
             //wUnitTimeNum = ((wMaxAngle1024*300/1024) /(wMaxSpeed256 * 720/256)) /7.8msec;
             //             = ((128*wMaxAngle1024*300/1024) /(wMaxSpeed256 * 720/256)) ;    (/7.8msec == *128)
             //             = (wMaxAngle1024*40) /(wMaxSpeed256 *3);
-            if( m_PlayPage.header.schedule == TIME_BASE_SCHEDULE )
+            if( m_PlayPage->header.schedule == TIME_BASE_SCHEDULE )
                 wUnitTimeTotalNum  = wMaxSpeed256; //TIME BASE 051025
             else
                 wUnitTimeTotalNum  = (wMaxAngle1024 * 40) / (wMaxSpeed256 * 3);
 
-            wAccelStep = m_PlayPage.header.accel;
+            // a preempting page reaches its first step in BLEND_TIME
+            if( m_BlendTicks != 0 )
+            {
+                wUnitTimeTotalNum = m_BlendTicks;
+                m_BlendTicks = 0;
+            }
+
+            wAccelStep = m_PlayPage->header.accel;
             if( wUnitTimeTotalNum <= (wAccelStep << 1) )
             {
                 if( wUnitTimeTotalNum == 0 )
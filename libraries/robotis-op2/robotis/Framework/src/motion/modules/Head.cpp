@@ -54,8 +54,8 @@ void Head::CheckLimit()
 
 void Head::Initialize()
 {
-	m_PanAngle = MotionStatus::m_CurrentJoints.GetAngle(JointData::ID_HEAD_PAN);
-	m_TiltAngle = -MotionStatus::m_CurrentJoints.GetAngle(JointData::ID_HEAD_TILT);
+	m_PanAngle = m_Status->m_CurrentJoints.GetAngle(JointData::ID_HEAD_PAN);
+	m_TiltAngle = -m_Status->m_CurrentJoints.GetAngle(JointData::ID_HEAD_TILT);
 	CheckLimit();
 
 	InitTracking();
@@ -6,11 +6,10 @@
  */
 #include <stdio.h>
 #include <math.h>
-#include "Vector.h"
-#include "Matrix.h"
 #include "MX28.h"
 #include "MotionStatus.h"
 #include "Kinematics.h"
+#include "LegIK.h"
 #include "Walking.h"
 
 using namespace Robot;
@@ -51,6 +50,12 @@ Walking::Walking()
     A_MOVE_AMPLITUDE = 0;    
     A_MOVE_AIM_ON = false;
     BALANCE_ENABLE = true;
+    PHASE_TABLE_ENABLE = true;
+
+    m_PhaseTable_Count = 0;
+    m_PhaseTable_PeriodTime = 0;
+    m_PhaseTable_DSP_Ratio = 0;
+    m_PhaseTable_Cursor = 0;
 
     m_Joint.SetAngle(JointData::ID_R_SHOULDER_PITCH, -48.345);
     m_Joint.SetAngle(JointData::ID_L_SHOULDER_PITCH, 41.313);
@@ -138,88 +143,9 @@ void Walking::SaveINISettings(minIni* ini, const std::string &section)
     ini->put(section,   "d_gain",                   D_GAIN);
 }
 
-double Walking::wsin(double time, double period, double period_shift, double mag, double mag_shift)
+double Walking::wsin(double time, double period, double period_shift)
 {
-    return mag * sin(2 * 3.141592 / period * time - period_shift) + mag_shift;
-}
-
-bool Walking::computeIK(double *out, double x, double y, double z, double a, double b, double c)
-{
-    Matrix3D Tad, Tda, Tcd, Tdc, Tac;
-    Vector3D vec;
-    double _Rac, _Acos, _Atan, _k, _l, _m, _n, _s, _c, _theta;
-    double LEG_LENGTH = Kinematics::LEG_LENGTH;
-    double THIGH_LENGTH = Kinematics::THIGH_LENGTH;
-    double CALF_LENGTH = Kinematics::CALF_LENGTH;
-    double ANKLE_LENGTH = Kinematics::ANKLE_LENGTH;
-
-    Tad.SetTransform(Point3D(x, y, z - LEG_LENGTH), Vector3D(a * 180.0 / PI, b * 180.0 / PI, c * 180.0 / PI));
-
-    vec.X = x + Tad.m[2] * ANKLE_LENGTH;
-    vec.Y = y + Tad.m[6] * ANKLE_LENGTH;
-    vec.Z = (z - LEG_LENGTH) + Tad.m[10] * ANKLE_LENGTH;
-
-    // Get Knee
-    _Rac = vec.Length();
-    _Acos = acos((_Rac * _Rac - THIGH_LENGTH * THIGH_LENGTH - CALF_LENGTH * CALF_LENGTH) / (2 * THIGH_LENGTH * CALF_LENGTH));
-    if(isnan(_Acos) == 1)
-        return false;
-    *(out + 3) = _Acos;
-
-    // Get Ankle Roll
-    Tda = Tad;
-    if(Tda.Inverse() == false)
-        return false;
-    _k = sqrt(Tda.m[7] * Tda.m[7] + Tda.m[11] * Tda.m[11]);
-    _l = sqrt(Tda.m[7] * Tda.m[7] + (Tda.m[11] - ANKLE_LENGTH) * (Tda.m[11] - ANKLE_LENGTH));
-    _m = (_k * _k - _l * _l - ANKLE_LENGTH * ANKLE_LENGTH) / (2 * _l * ANKLE_LENGTH);
-    if(_m > 1.0)
-        _m = 1.0;
-    else if(_m < -1.0)
-        _m = -1.0;
-    _Acos = acos(_m);
-    if(isnan(_Acos) == 1)
-        return false;
-    if(Tda.m[7] < 0.0)
-        *(out + 5) = -_Acos;
-    else
-        *(out + 5) = _Acos;
-
-    // Get Hip Yaw
-    Tcd.SetTransform(Point3D(0, 0, -ANKLE_LENGTH), Vector3D(*(out + 5) * 180.0 / PI, 0, 0));
-    Tdc = Tcd;
-    if(Tdc.Inverse() == false)
-        return false;
-    Tac = Tad * Tdc;
-    _Atan = atan2(-Tac.m[1] , Tac.m[5]);
-    if(isinf(_Atan) == 1)
-        return false;
-    *(out) = _Atan;
-
-    // Get Hip Roll
-    _Atan = atan2(Tac.m[9], -Tac.m[1] * sin(*(out)) + Tac.m[5] * cos(*(out)));
-    if(isinf(_Atan) == 1)
-        return false;
-    *(out + 1) = _Atan;
-
-    // Get Hip Pitch and Ankle Pitch
-    _Atan = atan2(Tac.m[2] * cos(*(out)) + Tac.m[6] * sin(*(out)), Tac.m[0] * cos(*(out)) + Tac.m[4] * sin(*(out)));
-    if(isinf(_Atan) == 1)
-        return false;
-    _theta = _Atan;
-    _k = sin(*(out + 3)) * CALF_LENGTH;
-    _l = -THIGH_LENGTH - cos(*(out + 3)) * CALF_LENGTH;
-    _m = cos(*(out)) * vec.X + sin(*(out)) * vec.Y;
-    _n = cos(*(out + 1)) * vec.Z + sin(*(out)) * sin(*(out + 1)) * vec.X - cos(*(out)) * sin(*(out + 1)) * vec.Y;
-    _s = (_k * _n + _l * _m) / (_k * _k + _l * _l);
-    _c = (_n - _k * _s) / _l;
-    _Atan = atan2(_s, _c);
-    if(isinf(_Atan) == 1)
-        return false;
-    *(out + 2) = _Atan;
-    *(out + 4) = _theta - *(out + 3) - *(out + 2);
-
-    return true;
+    return sin(2 * 3.141592 / period * time - period_shift);
 }
 
 void Walking::update_param_time()
@@ -249,6 +175,11 @@ void Walking::update_param_time()
     m_Pelvis_Offset = PELVIS_OFFSET*MX28::RATIO_ANGLE2VALUE;
     m_Pelvis_Swing = m_Pelvis_Offset * 0.35;
     m_Arm_Swing_Gain = ARM_SWING_GAIN;
+
+    // called twice per period, the table only changes with the timing parameters
+    if(PHASE_TABLE_ENABLE == true
+        && (m_PhaseTable_Count == 0 || m_PhaseTable_PeriodTime != m_PeriodTime || m_PhaseTable_DSP_Ratio != m_DSP_Ratio))
+        build_phase_table();
 }
 
 void Walking::update_param_move()
@@ -300,6 +231,112 @@ void Walking::update_param_balance()
     m_Hip_Pitch_Offset = HIP_PITCH_OFFSET*MX28::RATIO_ANGLE2VALUE;
 }
 
+void Walking::compute_phase_sample(double time, PhaseSample *sample)
+{
+    sample->time = time;
+    sample->x_swap = wsin(time, m_X_Swap_PeriodTime, m_X_Swap_Phase_Shift);
+    sample->y_swap = wsin(time, m_Y_Swap_PeriodTime, m_Y_Swap_Phase_Shift);
+    sample->z_swap = wsin(time, m_Z_Swap_PeriodTime, m_Z_Swap_Phase_Shift);
+    sample->arm = wsin(time, m_PeriodTime, PI * 1.5);
+
+    // the right foot moves like the left one with the opposite amplitude, except for z
+    if(time <= m_SSP_Time_Start_L)
+    {
+        sample->x_move = wsin(m_SSP_Time_Start_L, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->y_move = wsin(m_SSP_Time_Start_L, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->z_move_l = wsin(m_SSP_Time_Start_L, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->a_move = wsin(m_SSP_Time_Start_L, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->z_move_r = wsin(m_SSP_Time_Start_R, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R);
+        sample->pelvis = 0;
+        sample->pelvis_side = 0;
+    }
+    else if(time <= m_SSP_Time_End_L)
+    {
+        sample->x_move = wsin(time, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->y_move = wsin(time, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->z_move_l = wsin(time, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->a_move = wsin(time, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->z_move_r = wsin(m_SSP_Time_Start_R, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R);
+        sample->pelvis = wsin(time, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->pelvis_side = 1;
+    }
+    else if(time <= m_SSP_Time_Start_R)
+    {
+        sample->x_move = wsin(m_SSP_Time_End_L, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->y_move = wsin(m_SSP_Time_End_L, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->z_move_l = wsin(m_SSP_Time_End_L, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->a_move = wsin(m_SSP_Time_End_L, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->z_move_r = wsin(m_SSP_Time_Start_R, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R);
+        sample->pelvis = 0;
+        sample->pelvis_side = 0;
+    }
+    else if(time <= m_SSP_Time_End_R)
+    {
+        sample->x_move = wsin(time, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_R + PI);
+        sample->y_move = wsin(time, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_R + PI);
+        sample->z_move_l = wsin(m_SSP_Time_End_L, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->a_move = wsin(time, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_R + PI);
+        sample->z_move_r = wsin(time, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R);
+        sample->pelvis = wsin(time, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R);
+        sample->pelvis_side = 2;
+    }
+    else
+    {
+        sample->x_move = wsin(m_SSP_Time_End_R, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_R + PI);
+        sample->y_move = wsin(m_SSP_Time_End_R, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_R + PI);
+        sample->z_move_l = wsin(m_SSP_Time_End_L, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L);
+        sample->a_move = wsin(m_SSP_Time_End_R, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_R + PI);
+        sample->z_move_r = wsin(m_SSP_Time_End_R, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R);
+        sample->pelvis = 0;
+        sample->pelvis_side = 0;
+    }
+}
+
+void Walking::build_phase_table()
+{
+    double TIME_UNIT = MotionModule::TIME_UNIT;
+
+    m_PhaseTable_Count = 0;
+    m_PhaseTable_PeriodTime = m_PeriodTime;
+    m_PhaseTable_DSP_Ratio = m_DSP_Ratio;
+    m_PhaseTable_Cursor = 0;
+
+    // same time sequence as Process(), which jumps to m_Phase_Time2 in the middle of the period
+    double time = 0;
+    while(time < m_PeriodTime && m_PhaseTable_Count < MAX_PHASE_SAMPLES)
+    {
+        if(time >= (m_Phase_Time2 - TIME_UNIT/2) && time < (m_Phase_Time2 + TIME_UNIT/2))
+            time = m_Phase_Time2;
+        compute_phase_sample(time, &m_PhaseTable[m_PhaseTable_Count++]);
+        time += TIME_UNIT;
+    }
+}
+
+const Walking::PhaseSample* Walking::find_phase_sample(double time)
+{
+    unsigned int count = m_PhaseTable_Count;
+
+    // the next tick is almost always the next sample
+    if(m_PhaseTable_Cursor >= count || m_PhaseTable[m_PhaseTable_Cursor].time != time)
+    {
+        unsigned int low = 0, high = count;
+        while(low < high)
+        {
+            unsigned int mid = (low + high) / 2;
+            if(m_PhaseTable[mid].time < time)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        // not a time of the table (parameters changed mid-period), compute it directly
+        if(low >= count || m_PhaseTable[low].time != time)
+            return 0;
+        m_PhaseTable_Cursor = low;
+    }
+
+    return &m_PhaseTable[m_PhaseTable_Cursor++];
+}
+
 void Walking::Initialize()
 {
     X_MOVE_AMPLITUDE   = 0;
@@ -323,6 +360,7 @@ void Walking::Initialize()
     m_Ctrl_Running = false;
     m_Real_Running = false;
     m_Time = 0;
+    m_PhaseTable_Count = 0;
     update_param_time();
     update_param_move();
 
@@ -410,75 +448,43 @@ void Walking::Process()
     update_param_balance();
 
     // Compute endpoints
-    x_swap = wsin(m_Time, m_X_Swap_PeriodTime, m_X_Swap_Phase_Shift, m_X_Swap_Amplitude, m_X_Swap_Amplitude_Shift);
-    y_swap = wsin(m_Time, m_Y_Swap_PeriodTime, m_Y_Swap_Phase_Shift, m_Y_Swap_Amplitude, m_Y_Swap_Amplitude_Shift);
-    z_swap = wsin(m_Time, m_Z_Swap_PeriodTime, m_Z_Swap_Phase_Shift, m_Z_Swap_Amplitude, m_Z_Swap_Amplitude_Shift);
+    const PhaseSample *sample = 0;
+    PhaseSample direct;
+    if(PHASE_TABLE_ENABLE == true)
+        sample = find_phase_sample(m_Time);
+    if(sample == 0)
+    {
+        compute_phase_sample(m_Time, &direct);
+        sample = &direct;
+    }
+
+    x_swap = wamp(sample->x_swap, m_X_Swap_Amplitude, m_X_Swap_Amplitude_Shift);
+    y_swap = wamp(sample->y_swap, m_Y_Swap_Amplitude, m_Y_Swap_Amplitude_Shift);
+    z_swap = wamp(sample->z_swap, m_Z_Swap_Amplitude, m_Z_Swap_Amplitude_Shift);
     a_swap = 0;
     b_swap = 0;
     c_swap = 0;
 
-    if(m_Time <= m_SSP_Time_Start_L)
-    {
-        x_move_l = wsin(m_SSP_Time_Start_L, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_L, m_X_Move_Amplitude, m_X_Move_Amplitude_Shift);
-        y_move_l = wsin(m_SSP_Time_Start_L, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_L, m_Y_Move_Amplitude, m_Y_Move_Amplitude_Shift);
-        z_move_l = wsin(m_SSP_Time_Start_L, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
-        c_move_l = wsin(m_SSP_Time_Start_L, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_L, m_A_Move_Amplitude, m_A_Move_Amplitude_Shift);
-        x_move_r = wsin(m_SSP_Time_Start_L, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_L, -m_X_Move_Amplitude, -m_X_Move_Amplitude_Shift);
-        y_move_r = wsin(m_SSP_Time_Start_L, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_L, -m_Y_Move_Amplitude, -m_Y_Move_Amplitude_Shift);
-        z_move_r = wsin(m_SSP_Time_Start_R, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
-        c_move_r = wsin(m_SSP_Time_Start_L, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_L, -m_A_Move_Amplitude, -m_A_Move_Amplitude_Shift);
-        pelvis_offset_l = 0;
-        pelvis_offset_r = 0;
-    }
-    else if(m_Time <= m_SSP_Time_End_L)
-    {
-        x_move_l = wsin(m_Time, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_L, m_X_Move_Amplitude, m_X_Move_Amplitude_Shift);
-        y_move_l = wsin(m_Time, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_L, m_Y_Move_Amplitude, m_Y_Move_Amplitude_Shift);
-        z_move_l = wsin(m_Time, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
-        c_move_l = wsin(m_Time, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_L, m_A_Move_Amplitude, m_A_Move_Amplitude_Shift);
-        x_move_r = wsin(m_Time, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_L, -m_X_Move_Amplitude, -m_X_Move_Amplitude_Shift);
-        y_move_r = wsin(m_Time, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_L, -m_Y_Move_Amplitude, -m_Y_Move_Amplitude_Shift);
-        z_move_r = wsin(m_SSP_Time_Start_R, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
-        c_move_r = wsin(m_Time, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_L, -m_A_Move_Amplitude, -m_A_Move_Amplitude_Shift);
-        pelvis_offset_l = wsin(m_Time, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L, m_Pelvis_Swing / 2, m_Pelvis_Swing / 2);
-        pelvis_offset_r = wsin(m_Time, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L, -m_Pelvis_Offset / 2, -m_Pelvis_Offset / 2);
-    }
-    else if(m_Time <= m_SSP_Time_Start_R)
+    x_move_l = wamp(sample->x_move, m_X_Move_Amplitude, m_X_Move_Amplitude_Shift);
+    y_move_l = wamp(sample->y_move, m_Y_Move_Amplitude, m_Y_Move_Amplitude_Shift);
+    z_move_l = wamp(sample->z_move_l, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
+    c_move_l = wamp(sample->a_move, m_A_Move_Amplitude, m_A_Move_Amplitude_Shift);
+    x_move_r = wamp(sample->x_move, -m_X_Move_Amplitude, -m_X_Move_Amplitude_Shift);
+    y_move_r = wamp(sample->y_move, -m_Y_Move_Amplitude, -m_Y_Move_Amplitude_Shift);
+    z_move_r = wamp(sample->z_move_r, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
+    c_move_r = wamp(sample->a_move, -m_A_Move_Amplitude, -m_A_Move_Amplitude_Shift);
+    if(sample->pelvis_side == 1)
     {
-        x_move_l = wsin(m_SSP_Time_End_L, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_L, m_X_Move_Amplitude, m_X_Move_Amplitude_Shift);
-        y_move_l = wsin(m_SSP_Time_End_L, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_L, m_Y_Move_Amplitude, m_Y_Move_Amplitude_Shift);
-        z_move_l = wsin(m_SSP_Time_End_L, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
-        c_move_l = wsin(m_SSP_Time_End_L, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_L, m_A_Move_Amplitude, m_A_Move_Amplitude_Shift);
-        x_move_r = wsin(m_SSP_Time_End_L, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_L, -m_X_Move_Amplitude, -m_X_Move_Amplitude_Shift);
-        y_move_r = wsin(m_SSP_Time_End_L, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_L, -m_Y_Move_Amplitude, -m_Y_Move_Amplitude_Shift);
-        z_move_r = wsin(m_SSP_Time_Start_R, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
-        c_move_r = wsin(m_SSP_Time_End_L, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_L, -m_A_Move_Amplitude, -m_A_Move_Amplitude_Shift);
-        pelvis_offset_l = 0;
-        pelvis_offset_r = 0;
+        pelvis_offset_l = wamp(sample->pelvis, m_Pelvis_Swing / 2, m_Pelvis_Swing / 2);
+        pelvis_offset_r = wamp(sample->pelvis, -m_Pelvis_Offset / 2, -m_Pelvis_Offset / 2);
     }
-    else if(m_Time <= m_SSP_Time_End_R)
+    else if(sample->pelvis_side == 2)
     {
-        x_move_l = wsin(m_Time, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_R + PI, m_X_Move_Amplitude, m_X_Move_Amplitude_Shift);
-        y_move_l = wsin(m_Time, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_R + PI, m_Y_Move_Amplitude, m_Y_Move_Amplitude_Shift);
-        z_move_l = wsin(m_SSP_Time_End_L, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
-        c_move_l = wsin(m_Time, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_R + PI, m_A_Move_Amplitude, m_A_Move_Amplitude_Shift);
-        x_move_r = wsin(m_Time, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_R + PI, -m_X_Move_Amplitude, -m_X_Move_Amplitude_Shift);
-        y_move_r = wsin(m_Time, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_R + PI, -m_Y_Move_Amplitude, -m_Y_Move_Amplitude_Shift);
-        z_move_r = wsin(m_Time, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
-        c_move_r = wsin(m_Time, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_R + PI, -m_A_Move_Amplitude, -m_A_Move_Amplitude_Shift);
-        pelvis_offset_l = wsin(m_Time, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R, m_Pelvis_Offset / 2, m_Pelvis_Offset / 2);
-        pelvis_offset_r = wsin(m_Time, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R, -m_Pelvis_Swing / 2, -m_Pelvis_Swing / 2);
+        pelvis_offset_l = wamp(sample->pelvis, m_Pelvis_Offset / 2, m_Pelvis_Offset / 2);
+        pelvis_offset_r = wamp(sample->pelvis, -m_Pelvis_Swing / 2, -m_Pelvis_Swing / 2);
     }
     else
     {
-        x_move_l = wsin(m_SSP_Time_End_R, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_R + PI, m_X_Move_Amplitude, m_X_Move_Amplitude_Shift);
-        y_move_l = wsin(m_SSP_Time_End_R, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_R + PI, m_Y_Move_Amplitude, m_Y_Move_Amplitude_Shift);
-        z_move_l = wsin(m_SSP_Time_End_L, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_L, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
-        c_move_l = wsin(m_SSP_Time_End_R, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_R + PI, m_A_Move_Amplitude, m_A_Move_Amplitude_Shift);
-        x_move_r = wsin(m_SSP_Time_End_R, m_X_Move_PeriodTime, m_X_Move_Phase_Shift + 2 * PI / m_X_Move_PeriodTime * m_SSP_Time_Start_R + PI, -m_X_Move_Amplitude, -m_X_Move_Amplitude_Shift);
-        y_move_r = wsin(m_SSP_Time_End_R, m_Y_Move_PeriodTime, m_Y_Move_Phase_Shift + 2 * PI / m_Y_Move_PeriodTime * m_SSP_Time_Start_R + PI, -m_Y_Move_Amplitude, -m_Y_Move_Amplitude_Shift);
-        z_move_r = wsin(m_SSP_Time_End_R, m_Z_Move_PeriodTime, m_Z_Move_Phase_Shift + 2 * PI / m_Z_Move_PeriodTime * m_SSP_Time_Start_R, m_Z_Move_Amplitude, m_Z_Move_Amplitude_Shift);
-        c_move_r = wsin(m_SSP_Time_End_R, m_A_Move_PeriodTime, m_A_Move_Phase_Shift + 2 * PI / m_A_Move_PeriodTime * m_SSP_Time_Start_R + PI, -m_A_Move_Amplitude, -m_A_Move_Amplitude_Shift);
         pelvis_offset_l = 0;
         pelvis_offset_r = 0;
     }
@@ -522,8 +528,8 @@ void Walking::Process()
     }
     else
     {
-        angle[12] = wsin(m_Time, m_PeriodTime, PI * 1.5, -m_X_Move_Amplitude * m_Arm_Swing_Gain, 0);
-        angle[13] = wsin(m_Time, m_PeriodTime, PI * 1.5, m_X_Move_Amplitude * m_Arm_Swing_Gain, 0);
+        angle[12] = wamp(sample->arm, -m_X_Move_Amplitude * m_Arm_Swing_Gain, 0);
+        angle[13] = wamp(sample->arm, m_X_Move_Amplitude * m_Arm_Swing_Gain, 0);
     }
 
     if(m_Real_Running == true)
@@ -534,8 +540,7 @@ void Walking::Process()
     }
 
     // Compute angles
-    if((computeIK(&angle[0], ep[0], ep[1], ep[2], ep[3], ep[4], ep[5]) == 1)
-        && (computeIK(&angle[6], ep[6], ep[7], ep[8], ep[9], ep[10], ep[11]) == 1))
+    if(LegIK::Compute(&angle[0], ep) == true)
     {
         for(int i=0; i<12; i++)
             angle[i] *= 180.0 / PI;
@@ -562,8 +567,8 @@ void Walking::Process()
     // adjust balance offset
     if(BALANCE_ENABLE == true)
     {
-        double rlGyroErr = MotionStatus::RL_GYRO;
-        double fbGyroErr = MotionStatus::FB_GYRO;
+        double rlGyroErr = m_Status->RL_GYRO;
+        double fbGyroErr = m_Status->FB_GYRO;
         outValue[1] += (int)(dir[1] * rlGyroErr * BALANCE_HIP_ROLL_GAIN*4); // R_HIP_ROLL
         outValue[7] += (int)(dir[7] * rlGyroErr * BALANCE_HIP_ROLL_GAIN*4); // L_HIP_ROLL
 
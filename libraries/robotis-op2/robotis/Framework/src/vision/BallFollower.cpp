@@ -79,11 +79,14 @@ void BallFollower::Process(Point2D ball_pos)
     {
 		m_NoBallCount = 0;		
 
-		double pan = MotionStatus::m_CurrentJoints.GetAngle(JointData::ID_HEAD_PAN);
+		MotionStatusSnapshot status;
+		MotionStatus::GetSnapshot(&status);
+
+		double pan = status.joints.GetAngle(JointData::ID_HEAD_PAN);
 		double pan_range = Head::GetInstance()->GetLeftLimitAngle();
 		double pan_percent = pan / pan_range;
 
-		double tilt = MotionStatus::m_CurrentJoints.GetAngle(JointData::ID_HEAD_TILT);
+		double tilt = status.joints.GetAngle(JointData::ID_HEAD_TILT);
 		double tilt_min = Head::GetInstance()->GetBottomLimitAngle();		
 		double tilt_range = Head::GetInstance()->GetTopLimitAngle() - tilt_min;
 		double tilt_percent = (tilt - tilt_min) / tilt_range;
@@ -5,7 +5,10 @@
  *      Author: zerom
  */
 
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 
 #include "ColorFinder.h"
 #include "ImgProcess.h"
@@ -14,6 +17,15 @@ using namespace Robot;
 
 ColorFinder::ColorFinder() :
         m_center_point(Point2D()),
+        m_row_width(0),
+        m_hsv_row(0),
+        m_mask_rows(0),
+        m_erosion_rows(0),
+        m_temp_row(0),
+        m_temp_bits(0),
+        m_mask_bits(0),
+        m_mask_bits_size(0),
+        m_table(0),
         m_hue(356),
         m_hue_tolerance(15),
         m_min_saturation(50),
@@ -22,11 +34,22 @@ ColorFinder::ColorFinder() :
         m_max_value(100),
         m_min_percent(0.07),
         m_max_percent(30.0),
+        m_table_bits(0),
+        m_find_blobs(false),
         color_section(""),
         m_result(0)
 { }
 
 ColorFinder::ColorFinder(int hue, int hue_tol, int min_sat, int min_val, double min_per, double max_per) :
+        m_row_width(0),
+        m_hsv_row(0),
+        m_mask_rows(0),
+        m_erosion_rows(0),
+        m_temp_row(0),
+        m_temp_bits(0),
+        m_mask_bits(0),
+        m_mask_bits_size(0),
+        m_table(0),
         m_hue(hue),
         m_hue_tolerance(hue_tol),
         m_min_saturation(min_sat),
@@ -35,11 +58,22 @@ ColorFinder::ColorFinder(int hue, int hue_tol, int min_sat, int min_val, double
         m_max_value(100),
         m_min_percent(min_per),
         m_max_percent(max_per),
+        m_table_bits(0),
+        m_find_blobs(false),
         color_section(""),
         m_result(0)
 { }
 
 ColorFinder::ColorFinder(int hue, int hue_tol, int min_sat, int max_sat, int min_val, int max_val, double min_per, double max_per) :
+        m_row_width(0),
+        m_hsv_row(0),
+        m_mask_rows(0),
+        m_erosion_rows(0),
+        m_temp_row(0),
+        m_temp_bits(0),
+        m_mask_bits(0),
+        m_mask_bits_size(0),
+        m_table(0),
         m_hue(hue),
         m_hue_tolerance(hue_tol),
         m_min_saturation(min_sat),
@@ -48,13 +82,98 @@ ColorFinder::ColorFinder(int hue, int hue_tol, int min_sat, int max_sat, int min
         m_max_value(max_val),
         m_min_percent(min_per),
         m_max_percent(max_per),
+        m_table_bits(0),
+        m_find_blobs(false),
         color_section(""),
         m_result(0)
 { }
 
 ColorFinder::~ColorFinder()
 {
-    // TODO Auto-generated destructor stub
+    delete[] m_hsv_row;
+    delete[] m_mask_rows;
+    delete[] m_erosion_rows;
+    delete[] m_temp_row;
+    delete[] m_temp_bits;
+    delete[] m_mask_bits;
+    delete m_table;
+}
+
+/* the open interval of hues, h_min > h_max when it wraps around 0 */
+void ColorFinder::HueRange(int &h_min, int &h_max)
+{
+    h_max = m_hue + m_hue_tolerance;
+    h_min = m_hue - m_hue_tolerance;
+    if(h_max > 360)
+        h_max -= 360;
+    if(h_min < 0)
+        h_min += 360;
+}
+
+/* true if the 4 bytes HSV pixel is of the color */
+inline bool ColorFinder::IsInRange(const unsigned char* hsv, int h_min, int h_max)
+{
+    unsigned int h, s, v;
+
+    h = (hsv[0] << 8) | hsv[1];
+    s =  hsv[2];
+    v =  hsv[3];
+
+    if( h > 360 )
+        h = h % 360;
+
+    if( ((int)s >= m_min_saturation) && ((int)s <= m_max_saturation) &&
+        ((int)v >= m_min_value) && ((int)v <= m_max_value) )
+    {
+        if(h_min <= h_max)
+            return (h_min < (int)h) && ((int)h < h_max);
+        else
+            return (h_min < (int)h) || ((int)h < h_max);
+    }
+
+    return false;
+}
+
+void ColorFinder::AllocateRows(int width)
+{
+    if(m_row_width == width)
+        return;
+
+    delete[] m_hsv_row;
+    delete[] m_mask_rows;
+    delete[] m_erosion_rows;
+    delete[] m_temp_row;
+    delete[] m_temp_bits;
+
+    int words = ImgProcess::GetMaskWords(width);
+    m_row_width = width;
+    m_hsv_row = new unsigned char[width * Image::HSV_PIXEL_SIZE];
+    m_mask_rows = new unsigned long long[words * 3];
+    m_erosion_rows = new unsigned long long[words * 3];
+    m_temp_row = new unsigned char[width];
+    m_temp_bits = new unsigned long long[words];
+}
+
+/* adds the pixels of a packed row to the sums of the centroid */
+static void AddRow(const unsigned long long* bits, int words, int y, int &sum_x, int &sum_y, int &count)
+{
+    // bit j of the index of each bit in a word
+    static const unsigned long long INDEX_BIT[6] = {
+        0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+        0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL };
+
+    for(int i = 0; i < words; i++)
+    {
+        if(bits[i] == 0)
+            continue;
+
+        int n = __builtin_popcountll(bits[i]);
+        count += n;
+        sum_y += n * y;
+        sum_x += n * 64 * i;
+        for(int j = 0; j < 6; j++)
+            sum_x += __builtin_popcountll(bits[i] & INDEX_BIT[j]) << j;
+    }
 }
 
 
@@ -65,51 +184,15 @@ effects: modify m_result. m_result is an image of the same size that img. _resul
 */
 void ColorFinder::Filtering(Image *img)
 {
-    unsigned int h, s, v;
     int h_max, h_min;
 
     if(m_result == NULL)
         m_result = new Image(img->m_Width, img->m_Height, 1);
 
-    h_max = m_hue + m_hue_tolerance;
-    h_min = m_hue - m_hue_tolerance;
-    if(h_max > 360)
-        h_max -= 360;
-    if(h_min < 0)
-        h_min += 360;
+    HueRange(h_min, h_max);
 
     for(int i = 0; i < img->m_NumberOfPixels; i++)
-    {
-        h = (img->m_ImageData[i*img->m_PixelSize + 0] << 8) | img->m_ImageData[i*img->m_PixelSize + 1];
-        s =  img->m_ImageData[i*img->m_PixelSize + 2];
-        v =  img->m_ImageData[i*img->m_PixelSize + 3];
-
-        if( h > 360 )
-            h = h % 360;
-
-        if( ((int)s >= m_min_saturation) && ((int)s <= m_max_saturation) &&
-            ((int)v >= m_min_value) && ((int)v <= m_max_value) )
-        {
-            if(h_min <= h_max)
-            {
-                if((h_min < (int)h) && ((int)h < h_max))
-                    m_result->m_ImageData[i]= 1;
-                else
-                    m_result->m_ImageData[i]= 0;
-            }
-            else
-            {
-                if((h_min < (int)h) || ((int)h < h_max))
-                    m_result->m_ImageData[i]= 1;
-                else
-                    m_result->m_ImageData[i]= 0;
-            }
-        }
-        else
-        {
-            m_result->m_ImageData[i]= 0;
-        }
-    }
+        m_result->m_ImageData[i] = IsInRange(&img->m_ImageData[i*img->m_PixelSize], h_min, h_max) ? 1 : 0;
 }
 
 void ColorFinder::LoadINISettings(minIni* ini)
@@ -158,38 +241,463 @@ input: an image hsv_img
 output: the average point where the color is found, or (-1, -1) if the color is not found 
 effects: modify m_result via Filtering
 */
+/* the center of the sums, or of the best blob, if the number of pixels is between m_min_percent and m_max_percent */
+void ColorFinder::SetCenter(int sum_x, int sum_y, int count, int pixels)
+{
+    double min_count = pixels * m_min_percent / 100, max_count = pixels * m_max_percent / 100;
+
+    m_blobs.clear();
+    if(m_find_blobs)
+        m_blob_finder.Finish(m_blobs, min_count, max_count);
+
+    if(m_find_blobs ? m_blobs.empty() : (count <= min_count || count > max_count))
+    {
+        m_center_point.X = -1.0;
+        m_center_point.Y = -1.0;
+    }
+    else if(m_find_blobs)
+    {
+        m_center_point.X = (int)m_blobs[0].x;
+        m_center_point.Y = (int)m_blobs[0].y;
+    }
+    else
+    {
+        m_center_point.X = (int)((double)sum_x / (double)count);
+        m_center_point.Y = (int)((double)sum_y / (double)count);
+    }
+}
+
 Point2D& ColorFinder::GetPosition(Image* hsv_img)
 {
     int sum_x = 0, sum_y = 0, count = 0;
 
     Filtering(hsv_img);
 
-    ImgProcess::Erosion(m_result);
-    ImgProcess::Dilation(m_result);
+    // the erosion and the dilation of the packed mask, then its sums and m_result
+    int width = m_result->m_Width, height = m_result->m_Height;
+    int words = ImgProcess::GetMaskWords(width);
+
+    if(m_mask_bits_size < 2 * words * height)
+    {
+        delete[] m_mask_bits;
+        m_mask_bits_size = 2 * words * height;
+        m_mask_bits = new unsigned long long[m_mask_bits_size];
+    }
+
+    for(int y = 0; y < height; y++)
+        ImgProcess::PackMask(&m_result->m_ImageData[y * width], &m_mask_bits[y * words], width);
+
+    ImgProcess::Erosion(m_mask_bits, &m_mask_bits[words * height], width, height, 3);
+    ImgProcess::Dilation(m_mask_bits, &m_mask_bits[words * height], width, height, 3);
+
+    if(m_find_blobs)
+        m_blob_finder.Start(width);
+
+    for(int y = 0; y < height; y++)
+    {
+        AddRow(&m_mask_bits[y * words], words, y, sum_x, sum_y, count);
+        if(m_find_blobs)
+            m_blob_finder.AddRow(&m_mask_bits[y * words], y);
+        ImgProcess::UnpackMask(&m_mask_bits[y * words], &m_result->m_ImageData[y * width], width);
+    }
+
+    SetCenter(sum_x, sum_y, count, hsv_img->m_NumberOfPixels);
+
+    return m_center_point;
+}
+
+// ***   WEBOTS PART  *** //
+
+/*
+The pipeline of GetPosition on each row as soon as the rows it needs are known:
+row y of the mask, then row y-1 of its 3x3 erosion, then row y-2 of the dilation
+of the erosion, whose pixels are summed. The erosion rows 0 and height-1 are 0.
+*/
+Point2D& ColorFinder::GetPositionBGRA(Image* bgra_img)
+{
+    int width = bgra_img->m_Width, height = bgra_img->m_Height;
+    int sum_x = 0, sum_y = 0, count = 0;
+    int h_max, h_min;
+
+    // the tests of IsInRange as one lookup per channel, so that the loop has no branch
+    unsigned char hue_table[361], saturation_table[256], value_table[256];
+
+    HueRange(h_min, h_max);
+    for(int h = 0; h <= 360; h++)
+    {
+        if(h_min <= h_max)
+            hue_table[h] = (h_min < h) && (h < h_max);
+        else
+            hue_table[h] = (h_min < h) || (h < h_max);
+    }
+    for(int i = 0; i < 256; i++)
+    {
+        saturation_table[i] = (i >= m_min_saturation) && (i <= m_max_saturation);
+        value_table[i] = (i >= m_min_value) && (i <= m_max_value);
+    }
+    AllocateRows(width);
+
+    ColorTable *table = 0;
+    if(m_table_bits > 0)
+    {
+        if(m_table != 0 && m_table->GetBits() != m_table_bits)
+        {
+            delete m_table;
+            m_table = 0;
+        }
+        if(m_table == 0)
+        {
+            m_table = new ColorTable(m_table_bits);
+            m_table->AddClass(this);
+        }
+        m_table->Update();
+        table = m_table;
+    }
+
+    // local copies, the compiler can not tell that the rows do not overwrite the members
+    int words = ImgProcess::GetMaskWords(width);
+    unsigned char *hsv_row = m_hsv_row, *temp_row = m_temp_row;
+    unsigned long long *mask_rows = m_mask_rows, *erosion_rows = m_erosion_rows, *temp_bits = m_temp_bits;
+    memset(erosion_rows, 0, words * 3 * sizeof(unsigned long long));
+    if(m_find_blobs)
+        m_blob_finder.Start(width);
+
+    for(int y = 0; y < height + 1; y++)
+    {
+        if(y < height)
+        {
+            unsigned char *mask = temp_row;
+            const unsigned char *bgra = &bgra_img->m_ImageData[y * width * bgra_img->m_PixelSize];
+
+            if(table != 0)
+                table->Classify(bgra, mask, width);
+            else
+            {
+                ImgProcess::BGRAtoHSV(bgra, hsv_row, width);
+                for(int x = 0; x < width; x++)
+                {
+                    const unsigned char *hsv = &hsv_row[x * Image::HSV_PIXEL_SIZE];
+                    unsigned int h = (hsv[0] << 8) | hsv[1];
+
+                    // the hue is 0 to 359, or 0xFFFF for a gray pixel
+                    h = (h > 360) ? 0xFFFF % 360 : h;
+                    mask[x] = hue_table[h] & saturation_table[hsv[2]] & value_table[hsv[3]];
+                }
+            }
+
+            ImgProcess::PackMask(mask, &mask_rows[(y % 3) * words], width);
+
+            if(y >= 2)
+            {
+                unsigned long long *erosion = &erosion_rows[((y - 1) % 3) * words];
+
+                for(int i = 0; i < words; i++)
+                    erosion[i] = mask_rows[i] & mask_rows[words + i] & mask_rows[2 * words + i];
+                ImgProcess::ErosionRow(erosion, erosion, width, 3);
+            }
+        }
+        else if(height >= 1)
+            memset(&erosion_rows[((height - 1) % 3) * words], 0, words * sizeof(unsigned long long));
+
+        // row y-2 of the result, once the erosion rows y-3 to y-1 are known
+        int row = y - 2;
+        if(row >= 1 && row <= height - 2)
+        {
+            for(int i = 0; i < words; i++)
+                temp_bits[i] = erosion_rows[i] | erosion_rows[words + i] | erosion_rows[2 * words + i];
+            ImgProcess::DilationRow(temp_bits, temp_bits, width, 3);
+            AddRow(temp_bits, words, row, sum_x, sum_y, count);
+            if(m_find_blobs)
+                m_blob_finder.AddRow(temp_bits, row);
+        }
+    }
+
+    SetCenter(sum_x, sum_y, count, bgra_img->m_NumberOfPixels);
+
+    return m_center_point;
+}
+
+
+
+ColorTable::ColorTable(int bits) :
+        m_Bits((bits < 1) ? 1 : ((bits > 8) ? 8 : bits)),
+        m_NumberOfClasses(0),
+        m_IsUpToDate(false)
+{
+    m_Table = new unsigned char[1 << (3 * m_Bits)];
+    memset(m_Table, 0, 1 << (3 * m_Bits));
+}
+
+ColorTable::~ColorTable()
+{
+    delete[] m_Table;
+}
+
+int ColorTable::AddClass(ColorFinder* finder)
+{
+    if(m_NumberOfClasses >= MAXNUM_CLASSES)
+        return -1;
+
+    m_Finders[m_NumberOfClasses] = finder;
+    m_IsUpToDate = false;
+
+    return m_NumberOfClasses++;
+}
+
+bool ColorTable::Update()
+{
+    bool changed = !m_IsUpToDate;
+
+    for(int k = 0; k < m_NumberOfClasses; k++)
+    {
+        ColorFinder *finder = m_Finders[k];
+        int parameters[6] = { finder->m_hue, finder->m_hue_tolerance,
+                              finder->m_min_saturation, finder->m_max_saturation,
+                              finder->m_min_value, finder->m_max_value };
+
+        if(memcmp(parameters, m_Parameters[k], sizeof(parameters)) != 0)
+        {
+            memcpy(m_Parameters[k], parameters, sizeof(parameters));
+            changed = true;
+        }
+    }
 
-    for(int y = 0; y < m_result->m_Height; y++)
+    if(changed == false)
+        return false;
+
+    int levels = 1 << m_Bits;
+    int shift = 8 - m_Bits;
+    int center = (1 << shift) >> 1;
+    int h_min[MAXNUM_CLASSES], h_max[MAXNUM_CLASSES];
+    unsigned char bgra[256 * Image::BGRA_PIXEL_SIZE], hsv[256 * Image::HSV_PIXEL_SIZE];
+
+    for(int k = 0; k < m_NumberOfClasses; k++)
+        m_Finders[k]->HueRange(h_min[k], h_max[k]);
+
+    // one row of cells along blue at a time, converted as a run of pixels
+    memset(bgra, 0, sizeof(bgra));
+    for(int b = 0; b < levels; b++)
+        bgra[b * Image::BGRA_PIXEL_SIZE + 0] = (unsigned char)((b << shift) | center);
+
+    for(int r = 0; r < levels; r++)
     {
-        for(int x = 0; x < m_result->m_Width; x++)
+        for(int g = 0; g < levels; g++)
         {
-            if(m_result->m_ImageData[m_result->m_Width * y + x] > 0)
+            unsigned char *entry = &m_Table[(r << (2 * m_Bits)) | (g << m_Bits)];
+
+            for(int b = 0; b < levels; b++)
+            {
+                bgra[b * Image::BGRA_PIXEL_SIZE + 1] = (unsigned char)((g << shift) | center);
+                bgra[b * Image::BGRA_PIXEL_SIZE + 2] = (unsigned char)((r << shift) | center);
+            }
+            ImgProcess::BGRAtoHSV(bgra, hsv, levels);
+
+            for(int b = 0; b < levels; b++)
             {
-                sum_x += x;
-                sum_y += y;
-                count++;
+                entry[b] = 0;
+                for(int k = 0; k < m_NumberOfClasses; k++)
+                {
+                    if(m_Finders[k]->IsInRange(&hsv[b * Image::HSV_PIXEL_SIZE], h_min[k], h_max[k]))
+                        entry[b] |= (1 << k);
+                }
             }
         }
     }
 
-    if(count <= (hsv_img->m_NumberOfPixels * m_min_percent / 100) || count > (hsv_img->m_NumberOfPixels * m_max_percent / 100))
+    m_IsUpToDate = true;
+
+    return true;
+}
+
+void ColorTable::Classify(Image* img, Image* classes)
+{
+    Update();
+
+    if(img->m_PixelSize == Image::BGRA_PIXEL_SIZE)
     {
-        m_center_point.X = -1.0;
-        m_center_point.Y = -1.0;
+        Classify(img->m_ImageData, classes->m_ImageData, img->m_NumberOfPixels);
+        return;
+    }
+
+    const unsigned char *pixel = img->m_ImageData;
+    for(int i = 0; i < img->m_NumberOfPixels; i++, pixel += img->m_PixelSize)
+        classes->m_ImageData[i] = GetClasses(pixel[0], pixel[1], pixel[2]);
+}
+
+void ColorTable::Classify(const unsigned char* bgra, unsigned char* classes, int pixels)
+{
+    // local copies, the compiler can not tell that the classes do not overwrite the members
+    const unsigned char *table = m_Table;
+    int bits = m_Bits, shift = 8 - m_Bits;
+
+    for(int i = 0; i < pixels; i++, bgra += Image::BGRA_PIXEL_SIZE)
+        classes[i] = table[((bgra[2] >> shift) << (2 * bits)) | ((bgra[1] >> shift) << bits) | (bgra[0] >> shift)];
+}
+
+
+
+BlobFinder::BlobFinder() :
+        m_Width(0)
+{ }
+
+void BlobFinder::Start(int width)
+{
+    m_Width = width;
+    m_Runs.clear();
+    m_PreviousRuns.clear();
+    m_Parents.clear();
+    m_Sums.clear();
+}
+
+int BlobFinder::Find(int label)
+{
+    // path halving
+    while(m_Parents[label] != label)
+    {
+        m_Parents[label] = m_Parents[m_Parents[label]];
+        label = m_Parents[label];
     }
+    return label;
+}
+
+/* the root of the joined labels, the older of the 2 roots */
+int BlobFinder::Union(int label1, int label2)
+{
+    int root1 = Find(label1), root2 = Find(label2);
+
+    if(root1 < root2)
+        m_Parents[root2] = root1;
     else
+        m_Parents[root1] = root2;
+
+    return (root1 < root2) ? root1 : root2;
+}
+
+void BlobFinder::AddRow(const unsigned long long* bits, int y)
+{
+    int words = ImgProcess::GetMaskWords(m_Width);
+
+    m_PreviousRuns.swap(m_Runs);
+    m_Runs.clear();
+
+    // the runs of set bits, joined across the words
+    for(int i = 0; i < words; i++)
     {
-        m_center_point.X = (int)((double)sum_x / (double)count);
-        m_center_point.Y = (int)((double)sum_y / (double)count);
+        unsigned long long word = bits[i];
+
+        while(word != 0)
+        {
+            int start = __builtin_ctzll(word);
+            unsigned long long clear = ~(word >> start);
+            int end = start + ((clear == 0) ? 64 : __builtin_ctzll(clear));
+
+            if(!m_Runs.empty() && m_Runs.back().end == 64 * i + start)
+                m_Runs.back().end = 64 * i + end;
+            else
+            {
+                Run run = { 64 * i + start, 64 * i + end, -1 };
+                m_Runs.push_back(run);
+            }
+            word = (end >= 64) ? 0 : (word & (~0ULL << end));
+        }
     }
 
-    return m_center_point;
+    // a run touches the runs above from start - 1 to end, both ordered by start
+    size_t first = 0;
+    for(size_t r = 0; r < m_Runs.size(); r++)
+    {
+        Run &run = m_Runs[r];
+
+        while(first < m_PreviousRuns.size() && m_PreviousRuns[first].end < run.start)
+            first++;
+        for(size_t k = first; k < m_PreviousRuns.size() && m_PreviousRuns[k].start <= run.end; k++)
+            run.label = (run.label < 0) ? Find(m_PreviousRuns[k].label) : Union(run.label, m_PreviousRuns[k].label);
+
+        if(run.label < 0)
+        {
+            Sums sums = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, run.start, y, run.end - 1, y };
+            run.label = (int)m_Parents.size();
+            m_Parents.push_back(run.label);
+            m_Sums.push_back(sums);
+        }
+
+        // the pixels x of the run: sum of x and of x * x from start to end - 1
+        double n = run.end - run.start, first_x = run.start, last_x = run.end - 1;
+        double x = n * (first_x + last_x) / 2;
+        double xx = (last_x * (last_x + 1) * (2 * last_x + 1) - (first_x - 1) * first_x * (2 * first_x - 1)) / 6;
+        Sums &sums = m_Sums[run.label];
+
+        sums.n += n;
+        sums.x += x;
+        sums.y += n * y;
+        sums.xx += xx;
+        sums.yy += n * y * y;
+        sums.xy += x * y;
+        sums.left = std::min(sums.left, run.start);
+        sums.right = std::max(sums.right, run.end - 1);
+        sums.bottom = y;
+    }
+}
+
+static bool IsBetterBlob(const Blob &blob1, const Blob &blob2)
+{
+    return blob1.area * blob1.score > blob2.area * blob2.score;
+}
+
+void BlobFinder::Finish(std::vector<Blob>& blobs, double min_area, double max_area)
+{
+    blobs.clear();
+
+    // the sums of the labels into the sums of their root, the older label
+    for(int label = (int)m_Parents.size() - 1; label >= 0; label--)
+    {
+        int root = Find(label);
+        if(root == label)
+            continue;
+
+        Sums &sums = m_Sums[label], &total = m_Sums[root];
+        total.n += sums.n;
+        total.x += sums.x;
+        total.y += sums.y;
+        total.xx += sums.xx;
+        total.yy += sums.yy;
+        total.xy += sums.xy;
+        total.left = std::min(total.left, sums.left);
+        total.top = std::min(total.top, sums.top);
+        total.right = std::max(total.right, sums.right);
+        total.bottom = std::max(total.bottom, sums.bottom);
+    }
+
+    for(int label = 0; label < (int)m_Parents.size(); label++)
+    {
+        const Sums &sums = m_Sums[label];
+        if(m_Parents[label] != label || sums.n <= min_area || sums.n > max_area)
+            continue;
+
+        Blob blob;
+        blob.area = (int)sums.n;
+        blob.left = sums.left;
+        blob.top = sums.top;
+        blob.right = sums.right;
+        blob.bottom = sums.bottom;
+        blob.x = sums.x / sums.n;
+        blob.y = sums.y / sums.n;
+        blob.xx = sums.xx / sums.n - blob.x * blob.x;
+        blob.yy = sums.yy / sums.n - blob.y * blob.y;
+        blob.xy = sums.xy / sums.n - blob.x * blob.y;
+
+        // the axes of the ellipse of the same moments, the pixels as squares of side 1:
+        // a filled disc has the 2 axes equal and the area of the ellipse, 4 pi sqrt(l1 l2)
+        double xx = blob.xx + 1.0 / 12, yy = blob.yy + 1.0 / 12;
+        double half_sum = (xx + yy) / 2, root = sqrt((xx - yy) * (xx - yy) / 4 + blob.xy * blob.xy);
+        double l1 = half_sum + root, l2 = std::max(half_sum - root, 1.0 / 12);
+        double fill = blob.area / (4 * M_PI * sqrt(l1 * l2));
+
+        blob.score = sqrt(l2 / l1) * ((fill < 1.0) ? fill : 1.0 / fill);
+        blobs.push_back(blob);
+    }
+
+    std::sort(blobs.begin(), blobs.end(), IsBetterBlob);
+    if(blobs.size() > (size_t)MAXNUM_BLOBS)
+        blobs.resize(MAXNUM_BLOBS);
 }
@@ -9,129 +9,621 @@
 
 #include "ImgProcess.h"
 
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define IMGPROC_X86
+#include <immintrin.h>
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__)
+#define IMGPROC_NEON
+#include <arm_neon.h>
+#endif
+
 using namespace Robot;
 
-void ImgProcess::YUVtoRGB(FrameBuffer *buf)
+typedef void (*YUVtoRGBFunc)(const unsigned char *yuyv, unsigned char *rgb, int pixels);
+typedef void (*ToHSVFunc)(const unsigned char *src, unsigned char *hsv, int hsv_pixel_size, int pixels);
+
+// ***   Scalar kernels, the reference of the others   *** //
+
+static void YUVtoRGBScalar(const unsigned char *yuyv, unsigned char *rgb, int pixels)
 {
-    unsigned char *yuyv, *rgb;
     int z = 0;
 
-    yuyv = buf->m_YUVFrame->m_ImageData;
-    rgb = buf->m_RGBFrame->m_ImageData;
+    for(int i = 0; i < pixels; i++)
+    {
+        int r, g, b;
+        int y, u, v;
+
+        if(!z)
+            y = yuyv[0] << 8;
+        else
+            y = yuyv[2] << 8;
+        u = yuyv[1] - 128;
+        v = yuyv[3] - 128;
+
+        r = (y + (359 * v)) >> 8;
+        g = (y - (88 * u) - (183 * v)) >> 8;
+        b = (y + (454 * u)) >> 8;
+
+        *(rgb++) = (r > 255) ? 255 : ((r < 0) ? 0 : r);
+        *(rgb++) = (g > 255) ? 255 : ((g < 0) ? 0 : g);
+        *(rgb++) = (b > 255) ? 255 : ((b < 0) ? 0 : b);
+
+        if (z++)
+        {
+            z = 0;
+            yuyv += 4;
+        }
+    }
+}
+
+static inline void HSVPixel(int ir, int ig, int ib, unsigned char *hsv)
+{
+    int imin, imax;
+    int th, ts, tv, diffvmin;
+
+    if( ir > ig )
+    {
+        imax = ir;
+        imin = ig;
+    }
+    else
+    {
+        imax = ig;
+        imin = ir;
+    }
+
+    if( imax > ib ) {
+        if( imin > ib ) imin = ib;
+    } else imax = ib;
+
+    tv = imax;
+    diffvmin = imax - imin;
+
+    if( (tv!=0) && (diffvmin!=0) )
+    {
+        ts = (255* diffvmin) / imax;
+        if( tv == ir ) th = (ig-ib)*60/diffvmin;
+        else if( tv == ig ) th = 120 + (ib-ir)*60/diffvmin;
+        else th = 240 + (ir-ig)*60/diffvmin;
+        if( th < 0 ) th += 360;
+        th &= 0x0000FFFF;
+    }
+    else
+    {
+        tv = 0;
+        ts = 0;
+        th = 0xFFFF;
+    }
+
+    ts = ts * 100 / 255;
+    tv = tv * 100 / 255;
+
+    hsv[0] = (unsigned char)(th >> 8);
+    hsv[1] = (unsigned char)(th & 0xFF);
+    hsv[2] = (unsigned char)(ts & 0xFF);
+    hsv[3] = (unsigned char)(tv & 0xFF);
+}
+
+static void RGBtoHSVScalar(const unsigned char *rgb, unsigned char *hsv, int hsv_pixel_size, int pixels)
+{
+    for(int i = 0; i < pixels; i++)
+        HSVPixel(rgb[3*i+0], rgb[3*i+1], rgb[3*i+2], &hsv[i*hsv_pixel_size]);
+}
+
+static void BGRAtoHSVScalar(const unsigned char *bgra, unsigned char *hsv, int hsv_pixel_size, int pixels)
+{
+    for(int i = 0; i < pixels; i++)
+        HSVPixel(bgra[4*i+2], bgra[4*i+1], bgra[4*i+0], &hsv[i*hsv_pixel_size]);
+}
+
+/*
+ * The vector kernels work on 32 bit lanes and give the same bytes as the scalar ones:
+ * - the divisions by the saturation and hue divisors are done in single precision,
+ *   which truncates to the exact integer quotient while the numerator is below 2^24
+ * - x / 255 is (x * 32897) >> 23 for every x up to 25500
+ * The pixels left after the last full block go through the scalar kernel.
+ */
+
+#ifdef IMGPROC_X86
+
+// ***   SSE4.1 kernels, 16 pixels per iteration   *** //
+
+TARGET_SSE41 static inline __m128i HSVSSE41(__m128i r, __m128i g, __m128i b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi32(1);
+
+    __m128i vmax = _mm_max_epi32(_mm_max_epi32(r, g), b);
+    __m128i diff = _mm_sub_epi32(vmax, _mm_min_epi32(_mm_min_epi32(r, g), b));
+    __m128i is_r = _mm_cmpeq_epi32(vmax, r);
+    __m128i is_g = _mm_andnot_si128(is_r, _mm_cmpeq_epi32(vmax, g));
+    __m128i gray = _mm_cmpeq_epi32(diff, zero);
+
+    // the sector is red if the maximum is red, then green, then blue
+    __m128i num = _mm_sub_epi32(r, g);
+    __m128i th = _mm_set1_epi32(240);
+    num = _mm_blendv_epi8(num, _mm_sub_epi32(b, r), is_g);
+    th = _mm_blendv_epi8(th, _mm_set1_epi32(120), is_g);
+    num = _mm_blendv_epi8(num, _mm_sub_epi32(g, b), is_r);
+    th = _mm_blendv_epi8(th, zero, is_r);
 
-    for(int height = 0; height < buf->m_YUVFrame->m_Height; height++)
+    __m128 fdiff = _mm_cvtepi32_ps(_mm_max_epi32(diff, one));
+    num = _mm_mullo_epi32(num, _mm_set1_epi32(60));
+    th = _mm_add_epi32(th, _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(num), fdiff)));
+    th = _mm_add_epi32(th, _mm_and_si128(_mm_cmplt_epi32(th, zero), _mm_set1_epi32(360)));
+    th = _mm_blendv_epi8(th, _mm_set1_epi32(0xFFFF), gray);
+
+    __m128i ts = _mm_mullo_epi32(diff, _mm_set1_epi32(255));
+    ts = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(ts), _mm_cvtepi32_ps(_mm_max_epi32(vmax, one))));
+    ts = _mm_srli_epi32(_mm_mullo_epi32(ts, _mm_set1_epi32(100 * 32897)), 23);
+    __m128i tv = _mm_srli_epi32(_mm_mullo_epi32(vmax, _mm_set1_epi32(100 * 32897)), 23);
+    ts = _mm_andnot_si128(gray, ts);
+    tv = _mm_andnot_si128(gray, tv);
+
+    // bytes of a pixel: hue high, hue low, saturation, value
+    return _mm_or_si128(_mm_or_si128(_mm_srli_epi32(th, 8), _mm_slli_epi32(_mm_and_si128(th, _mm_set1_epi32(0xFF)), 8)),
+                        _mm_or_si128(_mm_slli_epi32(ts, 16), _mm_slli_epi32(tv, 24)));
+}
+
+TARGET_SSE41 static void YUVtoRGBSSE41(const unsigned char *yuyv, unsigned char *rgb, int pixels)
+{
+    const __m128i y_mask = _mm_setr_epi8(0, -1, -1, -1, 2, -1, -1, -1, 4, -1, -1, -1, 6, -1, -1, -1);
+    const __m128i u_mask = _mm_setr_epi8(1, -1, -1, -1, 1, -1, -1, -1, 5, -1, -1, -1, 5, -1, -1, -1);
+    const __m128i v_mask = _mm_setr_epi8(3, -1, -1, -1, 3, -1, -1, -1, 7, -1, -1, -1, 7, -1, -1, -1);
+    const __m128i rgb_mask = _mm_setr_epi8(0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1, -1, -1, -1);
+    const __m128i offset = _mm_set1_epi32(128);
+    int i = 0;
+
+    // each group of 4 pixels stores 16 bytes, 4 more than its own
+    for(; i + 16 + 2 <= pixels; i += 16)
     {
-        for(int width = 0; width < buf->m_YUVFrame->m_Width; width++)
+        for(int k = i; k < i + 16; k += 4)
         {
-            int r, g, b;
-            int y, u, v;
+            __m128i src = _mm_loadl_epi64((const __m128i *)(yuyv + 2*k));
+            __m128i y = _mm_slli_epi32(_mm_shuffle_epi8(src, y_mask), 8);
+            __m128i u = _mm_sub_epi32(_mm_shuffle_epi8(src, u_mask), offset);
+            __m128i v = _mm_sub_epi32(_mm_shuffle_epi8(src, v_mask), offset);
 
-            if(!z)
-                y = yuyv[0] << 8;
-            else
-                y = yuyv[2] << 8;
-            u = yuyv[1] - 128;
-            v = yuyv[3] - 128;
+            __m128i r = _mm_srai_epi32(_mm_add_epi32(y, _mm_mullo_epi32(v, _mm_set1_epi32(359))), 8);
+            __m128i g = _mm_srai_epi32(_mm_sub_epi32(_mm_sub_epi32(y, _mm_mullo_epi32(u, _mm_set1_epi32(88))),
+                                                     _mm_mullo_epi32(v, _mm_set1_epi32(183))), 8);
+            __m128i b = _mm_srai_epi32(_mm_add_epi32(y, _mm_mullo_epi32(u, _mm_set1_epi32(454))), 8);
+
+            // the saturating packs clamp to 0..255
+            __m128i px = _mm_packus_epi16(_mm_packs_epi32(r, g), _mm_packs_epi32(b, b));
+            _mm_storeu_si128((__m128i *)(rgb + 3*k), _mm_shuffle_epi8(px, rgb_mask));
+        }
+    }
 
-            r = (y + (359 * v)) >> 8;
-            g = (y - (88 * u) - (183 * v)) >> 8;
-            b = (y + (454 * u)) >> 8;
+    YUVtoRGBScalar(yuyv + 2*i, rgb + 3*i, pixels - i);
+}
 
-            *(rgb++) = (r > 255) ? 255 : ((r < 0) ? 0 : r);
-            *(rgb++) = (g > 255) ? 255 : ((g < 0) ? 0 : g);
-            *(rgb++) = (b > 255) ? 255 : ((b < 0) ? 0 : b);
+TARGET_SSE41 static void RGBtoHSVSSE41(const unsigned char *rgb, unsigned char *hsv, int hsv_pixel_size, int pixels)
+{
+    const __m128i r_mask = _mm_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+    const __m128i g_mask = _mm_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1);
+    const __m128i b_mask = _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+    int i = 0;
 
-            if (z++)
+    // each group of 4 pixels loads 16 bytes, 4 more than its own
+    if(hsv_pixel_size == 4)
+    {
+        for(; i + 16 + 2 <= pixels; i += 16)
+        {
+            for(int k = i; k < i + 16; k += 4)
             {
-                z = 0;
-                yuyv += 4;
+                __m128i src = _mm_loadu_si128((const __m128i *)(rgb + 3*k));
+                __m128i px = HSVSSE41(_mm_shuffle_epi8(src, r_mask), _mm_shuffle_epi8(src, g_mask), _mm_shuffle_epi8(src, b_mask));
+                _mm_storeu_si128((__m128i *)(hsv + 4*k), px);
             }
         }
     }
+
+    RGBtoHSVScalar(rgb + 3*i, hsv + hsv_pixel_size*i, hsv_pixel_size, pixels - i);
 }
 
-void ImgProcess::RGBtoHSV(FrameBuffer *buf)
+TARGET_SSE41 static void BGRAtoHSVSSE41(const unsigned char *bgra, unsigned char *hsv, int hsv_pixel_size, int pixels)
 {
-    int ir, ig, ib, imin, imax;
-    int th, ts, tv, diffvmin;
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    int i = 0;
 
-    for(int i = 0; i < buf->m_RGBFrame->m_Width*buf->m_RGBFrame->m_Height; i++)
+    if(hsv_pixel_size == 4)
     {
-        ir = buf->m_RGBFrame->m_ImageData[3*i+0];
-        ig = buf->m_RGBFrame->m_ImageData[3*i+1];
-        ib = buf->m_RGBFrame->m_ImageData[3*i+2];
-
-        if( ir > ig )
+        for(; i + 16 <= pixels; i += 16)
         {
-            imax = ir;
-            imin = ig;
+            for(int k = i; k < i + 16; k += 4)
+            {
+                __m128i src = _mm_loadu_si128((const __m128i *)(bgra + 4*k));
+                __m128i px = HSVSSE41(_mm_and_si128(_mm_srli_epi32(src, 16), mask),
+                                      _mm_and_si128(_mm_srli_epi32(src, 8), mask),
+                                      _mm_and_si128(src, mask));
+                _mm_storeu_si128((__m128i *)(hsv + 4*k), px);
+            }
         }
-        else
+    }
+
+    BGRAtoHSVScalar(bgra + 4*i, hsv + hsv_pixel_size*i, hsv_pixel_size, pixels - i);
+}
+
+// ***   AVX2 kernels, 32 pixels per iteration   *** //
+
+TARGET_AVX2 static inline __m256i HSVAVX2(__m256i r, __m256i g, __m256i b)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+
+    __m256i vmax = _mm256_max_epi32(_mm256_max_epi32(r, g), b);
+    __m256i diff = _mm256_sub_epi32(vmax, _mm256_min_epi32(_mm256_min_epi32(r, g), b));
+    __m256i is_r = _mm256_cmpeq_epi32(vmax, r);
+    __m256i is_g = _mm256_andnot_si256(is_r, _mm256_cmpeq_epi32(vmax, g));
+    __m256i gray = _mm256_cmpeq_epi32(diff, zero);
+
+    __m256i num = _mm256_sub_epi32(r, g);
+    __m256i th = _mm256_set1_epi32(240);
+    num = _mm256_blendv_epi8(num, _mm256_sub_epi32(b, r), is_g);
+    th = _mm256_blendv_epi8(th, _mm256_set1_epi32(120), is_g);
+    num = _mm256_blendv_epi8(num, _mm256_sub_epi32(g, b), is_r);
+    th = _mm256_blendv_epi8(th, zero, is_r);
+
+    __m256 fdiff = _mm256_cvtepi32_ps(_mm256_max_epi32(diff, one));
+    num = _mm256_mullo_epi32(num, _mm256_set1_epi32(60));
+    th = _mm256_add_epi32(th, _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(num), fdiff)));
+    th = _mm256_add_epi32(th, _mm256_and_si256(_mm256_cmpgt_epi32(zero, th), _mm256_set1_epi32(360)));
+    th = _mm256_blendv_epi8(th, _mm256_set1_epi32(0xFFFF), gray);
+
+    __m256i ts = _mm256_mullo_epi32(diff, _mm256_set1_epi32(255));
+    ts = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(ts), _mm256_cvtepi32_ps(_mm256_max_epi32(vmax, one))));
+    ts = _mm256_srli_epi32(_mm256_mullo_epi32(ts, _mm256_set1_epi32(100 * 32897)), 23);
+    __m256i tv = _mm256_srli_epi32(_mm256_mullo_epi32(vmax, _mm256_set1_epi32(100 * 32897)), 23);
+    ts = _mm256_andnot_si256(gray, ts);
+    tv = _mm256_andnot_si256(gray, tv);
+
+    return _mm256_or_si256(_mm256_or_si256(_mm256_srli_epi32(th, 8), _mm256_slli_epi32(_mm256_and_si256(th, _mm256_set1_epi32(0xFF)), 8)),
+                           _mm256_or_si256(_mm256_slli_epi32(ts, 16), _mm256_slli_epi32(tv, 24)));
+}
+
+// 16 bytes in each half
+TARGET_AVX2 static inline __m256i Load2x128(const unsigned char *low, const unsigned char *high)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)low)),
+                                   _mm_loadu_si128((const __m128i *)high), 1);
+}
+
+TARGET_AVX2 static void YUVtoRGBAVX2(const unsigned char *yuyv, unsigned char *rgb, int pixels)
+{
+    const __m256i y_mask = _mm256_setr_epi8(0, -1, -1, -1, 2, -1, -1, -1, 4, -1, -1, -1, 6, -1, -1, -1,
+                                            8, -1, -1, -1, 10, -1, -1, -1, 12, -1, -1, -1, 14, -1, -1, -1);
+    const __m256i u_mask = _mm256_setr_epi8(1, -1, -1, -1, 1, -1, -1, -1, 5, -1, -1, -1, 5, -1, -1, -1,
+                                            9, -1, -1, -1, 9, -1, -1, -1, 13, -1, -1, -1, 13, -1, -1, -1);
+    const __m256i v_mask = _mm256_setr_epi8(3, -1, -1, -1, 3, -1, -1, -1, 7, -1, -1, -1, 7, -1, -1, -1,
+                                            11, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1, 15, -1, -1, -1);
+    const __m256i rgb_mask = _mm256_setr_epi8(0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1, -1, -1, -1,
+                                              0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1, -1, -1, -1);
+    const __m256i offset = _mm256_set1_epi32(128);
+    int i = 0;
+
+    // each group of 8 pixels stores 28 bytes, 4 more than its own
+    for(; i + 32 + 2 <= pixels; i += 32)
+    {
+        for(int k = i; k < i + 32; k += 8)
         {
-            imax = ig;
-            imin = ir;
+            __m256i src = Load2x128(yuyv + 2*k, yuyv + 2*k);
+            __m256i y = _mm256_slli_epi32(_mm256_shuffle_epi8(src, y_mask), 8);
+            __m256i u = _mm256_sub_epi32(_mm256_shuffle_epi8(src, u_mask), offset);
+            __m256i v = _mm256_sub_epi32(_mm256_shuffle_epi8(src, v_mask), offset);
+
+            __m256i r = _mm256_srai_epi32(_mm256_add_epi32(y, _mm256_mullo_epi32(v, _mm256_set1_epi32(359))), 8);
+            __m256i g = _mm256_srai_epi32(_mm256_sub_epi32(_mm256_sub_epi32(y, _mm256_mullo_epi32(u, _mm256_set1_epi32(88))),
+                                                           _mm256_mullo_epi32(v, _mm256_set1_epi32(183))), 8);
+            __m256i b = _mm256_srai_epi32(_mm256_add_epi32(y, _mm256_mullo_epi32(u, _mm256_set1_epi32(454))), 8);
+
+            __m256i px = _mm256_packus_epi16(_mm256_packs_epi32(r, g), _mm256_packs_epi32(b, b));
+            px = _mm256_shuffle_epi8(px, rgb_mask);
+            _mm_storeu_si128((__m128i *)(rgb + 3*k), _mm256_castsi256_si128(px));
+            _mm_storeu_si128((__m128i *)(rgb + 3*k + 12), _mm256_extracti128_si256(px, 1));
         }
+    }
 
-        if( imax > ib ) {
-            if( imin > ib ) imin = ib;
-        } else imax = ib;
+    YUVtoRGBScalar(yuyv + 2*i, rgb + 3*i, pixels - i);
+}
 
-        tv = imax;
-        diffvmin = imax - imin;
+TARGET_AVX2 static void RGBtoHSVAVX2(const unsigned char *rgb, unsigned char *hsv, int hsv_pixel_size, int pixels)
+{
+    const __m256i r_mask = _mm256_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1,
+                                            0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+    const __m256i g_mask = _mm256_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1,
+                                            1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1);
+    const __m256i b_mask = _mm256_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1,
+                                            2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+    int i = 0;
 
-        if( (tv!=0) && (diffvmin!=0) )
+    // each group of 8 pixels loads 28 bytes, 4 more than its own
+    if(hsv_pixel_size == 4)
+    {
+        for(; i + 32 + 2 <= pixels; i += 32)
         {
-            ts = (255* diffvmin) / imax;
-            if( tv == ir ) th = (ig-ib)*60/diffvmin;
-            else if( tv == ig ) th = 120 + (ib-ir)*60/diffvmin;
-            else th = 240 + (ir-ig)*60/diffvmin;
-            if( th < 0 ) th += 360;
-            th &= 0x0000FFFF;
+            for(int k = i; k < i + 32; k += 8)
+            {
+                __m256i src = Load2x128(rgb + 3*k, rgb + 3*k + 12);
+                __m256i px = HSVAVX2(_mm256_shuffle_epi8(src, r_mask), _mm256_shuffle_epi8(src, g_mask), _mm256_shuffle_epi8(src, b_mask));
+                _mm256_storeu_si256((__m256i *)(hsv + 4*k), px);
+            }
         }
-        else
+    }
+
+    RGBtoHSVScalar(rgb + 3*i, hsv + hsv_pixel_size*i, hsv_pixel_size, pixels - i);
+}
+
+TARGET_AVX2 static void BGRAtoHSVAVX2(const unsigned char *bgra, unsigned char *hsv, int hsv_pixel_size, int pixels)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    int i = 0;
+
+    if(hsv_pixel_size == 4)
+    {
+        for(; i + 32 <= pixels; i += 32)
         {
-            tv = 0;
-            ts = 0;
-            th = 0xFFFF;
+            for(int k = i; k < i + 32; k += 8)
+            {
+                __m256i src = _mm256_loadu_si256((const __m256i *)(bgra + 4*k));
+                __m256i px = HSVAVX2(_mm256_and_si256(_mm256_srli_epi32(src, 16), mask),
+                                     _mm256_and_si256(_mm256_srli_epi32(src, 8), mask),
+                                     _mm256_and_si256(src, mask));
+                _mm256_storeu_si256((__m256i *)(hsv + 4*k), px);
+            }
         }
+    }
+
+    BGRAtoHSVScalar(bgra + 4*i, hsv + hsv_pixel_size*i, hsv_pixel_size, pixels - i);
+}
+
+#endif
+
+#ifdef IMGPROC_NEON
 
-        ts = ts * 100 / 255;
-        tv = tv * 100 / 255;
+// ***   NEON kernels, 16 pixels per iteration   *** //
 
-        //buf->m_HSVFrame->m_ImageData[i]= (unsigned int)th | ((unsigned int)ts<<16) | ((unsigned int)tv<<24);
-        buf->m_HSVFrame->m_ImageData[i*buf->m_HSVFrame->m_PixelSize+0] = (unsigned char)(th >> 8);
-        buf->m_HSVFrame->m_ImageData[i*buf->m_HSVFrame->m_PixelSize+1] = (unsigned char)(th & 0xFF);
-        buf->m_HSVFrame->m_ImageData[i*buf->m_HSVFrame->m_PixelSize+2] = (unsigned char)(ts & 0xFF);
-        buf->m_HSVFrame->m_ImageData[i*buf->m_HSVFrame->m_PixelSize+3] = (unsigned char)(tv & 0xFF);
+static inline uint32x4_t HSVNEON(int32x4_t r, int32x4_t g, int32x4_t b)
+{
+    const int32x4_t one = vdupq_n_s32(1);
+
+    int32x4_t vmax = vmaxq_s32(vmaxq_s32(r, g), b);
+    int32x4_t diff = vsubq_s32(vmax, vminq_s32(vminq_s32(r, g), b));
+    uint32x4_t is_r = vceqq_s32(vmax, r);
+    uint32x4_t is_g = vbicq_u32(vceqq_s32(vmax, g), is_r);
+    uint32x4_t gray = vceqq_s32(diff, vdupq_n_s32(0));
+
+    // the sector is red if the maximum is red, then green, then blue
+    int32x4_t num = vsubq_s32(r, g);
+    int32x4_t th = vdupq_n_s32(240);
+    num = vbslq_s32(is_g, vsubq_s32(b, r), num);
+    th = vbslq_s32(is_g, vdupq_n_s32(120), th);
+    num = vbslq_s32(is_r, vsubq_s32(g, b), num);
+    th = vbslq_s32(is_r, vdupq_n_s32(0), th);
+
+    float32x4_t fdiff = vcvtq_f32_s32(vmaxq_s32(diff, one));
+    num = vmulq_n_s32(num, 60);
+    th = vaddq_s32(th, vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(num), fdiff)));
+    th = vaddq_s32(th, vandq_s32(vreinterpretq_s32_u32(vcltq_s32(th, vdupq_n_s32(0))), vdupq_n_s32(360)));
+    th = vbslq_s32(gray, vdupq_n_s32(0xFFFF), th);
+
+    int32x4_t ts = vmulq_n_s32(diff, 255);
+    ts = vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(ts), vcvtq_f32_s32(vmaxq_s32(vmax, one))));
+    uint32x4_t uts = vshrq_n_u32(vmulq_n_u32(vreinterpretq_u32_s32(ts), 100 * 32897), 23);
+    uint32x4_t utv = vshrq_n_u32(vmulq_n_u32(vreinterpretq_u32_s32(vmax), 100 * 32897), 23);
+    uts = vbicq_u32(uts, gray);
+    utv = vbicq_u32(utv, gray);
+
+    // bytes of a pixel: hue high, hue low, saturation, value
+    uint32x4_t uth = vreinterpretq_u32_s32(th);
+    return vorrq_u32(vorrq_u32(vshrq_n_u32(uth, 8), vshlq_n_u32(vandq_u32(uth, vdupq_n_u32(0xFF)), 8)),
+                     vorrq_u32(vshlq_n_u32(uts, 16), vshlq_n_u32(utv, 24)));
+}
+
+// 16 pixels given as planes of red, green and blue
+static inline void HSVNEON16(uint8x16_t r, uint8x16_t g, uint8x16_t b, unsigned char *hsv)
+{
+    uint16x8_t r16[2] = { vmovl_u8(vget_low_u8(r)), vmovl_u8(vget_high_u8(r)) };
+    uint16x8_t g16[2] = { vmovl_u8(vget_low_u8(g)), vmovl_u8(vget_high_u8(g)) };
+    uint16x8_t b16[2] = { vmovl_u8(vget_low_u8(b)), vmovl_u8(vget_high_u8(b)) };
+
+    for(int k = 0; k < 2; k++)
+    {
+        uint32x4_t low = HSVNEON(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(r16[k]))),
+                                 vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(g16[k]))),
+                                 vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(b16[k]))));
+        uint32x4_t high = HSVNEON(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(r16[k]))),
+                                  vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(g16[k]))),
+                                  vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(b16[k]))));
+        vst1q_u8(hsv + 32*k, vreinterpretq_u8_u32(low));
+        vst1q_u8(hsv + 32*k + 16, vreinterpretq_u8_u32(high));
     }
 }
 
-void ImgProcess::Erosion(Image* img)
+// 8 pixels of one parity, the saturating narrows clamp to 0..255
+static inline void YUVtoRGBNEON8(uint8x8_t y8, int16x8_t u, int16x8_t v, uint8x8_t *r, uint8x8_t *g, uint8x8_t *b)
 {
-    int x, y;
+    uint16x8_t y16 = vmovl_u8(y8);
+    int32x4_t y[2] = { vshlq_n_s32(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(y16))), 8),
+                       vshlq_n_s32(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(y16))), 8) };
+    int32x4_t u32[2] = { vmovl_s16(vget_low_s16(u)), vmovl_s16(vget_high_s16(u)) };
+    int32x4_t v32[2] = { vmovl_s16(vget_low_s16(v)), vmovl_s16(vget_high_s16(v)) };
+    int16x4_t r16[2], g16[2], b16[2];
+
+    for(int k = 0; k < 2; k++)
+    {
+        r16[k] = vqmovn_s32(vshrq_n_s32(vmlaq_n_s32(y[k], v32[k], 359), 8));
+        g16[k] = vqmovn_s32(vshrq_n_s32(vmlsq_n_s32(vmlsq_n_s32(y[k], u32[k], 88), v32[k], 183), 8));
+        b16[k] = vqmovn_s32(vshrq_n_s32(vmlaq_n_s32(y[k], u32[k], 454), 8));
+    }
+
+    *r = vqmovun_s16(vcombine_s16(r16[0], r16[1]));
+    *g = vqmovun_s16(vcombine_s16(g16[0], g16[1]));
+    *b = vqmovun_s16(vcombine_s16(b16[0], b16[1]));
+}
+
+static void YUVtoRGBNEON(const unsigned char *yuyv, unsigned char *rgb, int pixels)
+{
+    int i = 0;
+
+    for(; i + 16 <= pixels; i += 16)
+    {
+        // planes of the even Y, U, odd Y and V
+        uint8x8x4_t src = vld4_u8(yuyv + 2*i);
+        int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(src.val[1], vdup_n_u8(128)));
+        int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(src.val[3], vdup_n_u8(128)));
+        uint8x8_t r[2], g[2], b[2];
 
-    unsigned char* temp_img = new unsigned char[img->m_Width*img->m_Height];
-    memset(temp_img, 0, img->m_Width*img->m_Height);
+        YUVtoRGBNEON8(src.val[0], u, v, &r[0], &g[0], &b[0]);
+        YUVtoRGBNEON8(src.val[2], u, v, &r[1], &g[1], &b[1]);
 
-    for( y=1; y<(img->m_Height-1); y++ )
+        uint8x8x2_t rr = vzip_u8(r[0], r[1]);
+        uint8x8x2_t gg = vzip_u8(g[0], g[1]);
+        uint8x8x2_t bb = vzip_u8(b[0], b[1]);
+        uint8x16x3_t dst;
+        dst.val[0] = vcombine_u8(rr.val[0], rr.val[1]);
+        dst.val[1] = vcombine_u8(gg.val[0], gg.val[1]);
+        dst.val[2] = vcombine_u8(bb.val[0], bb.val[1]);
+        vst3q_u8(rgb + 3*i, dst);
+    }
+
+    YUVtoRGBScalar(yuyv + 2*i, rgb + 3*i, pixels - i);
+}
+
+static void RGBtoHSVNEON(const unsigned char *rgb, unsigned char *hsv, int hsv_pixel_size, int pixels)
+{
+    int i = 0;
+
+    if(hsv_pixel_size == 4)
+    {
+        for(; i + 16 <= pixels; i += 16)
+        {
+            uint8x16x3_t src = vld3q_u8(rgb + 3*i);
+            HSVNEON16(src.val[0], src.val[1], src.val[2], hsv + 4*i);
+        }
+    }
+
+    RGBtoHSVScalar(rgb + 3*i, hsv + hsv_pixel_size*i, hsv_pixel_size, pixels - i);
+}
+
+static void BGRAtoHSVNEON(const unsigned char *bgra, unsigned char *hsv, int hsv_pixel_size, int pixels)
+{
+    int i = 0;
+
+    if(hsv_pixel_size == 4)
     {
-        for( x=1; x<(img->m_Width-1); x++ )
+        for(; i + 16 <= pixels; i += 16)
         {
-            temp_img[y*img->m_Width+x]= img->m_ImageData[(y-1)*img->m_Width+(x-1)]
-                                      & img->m_ImageData[(y-1)*img->m_Width+(x  )]
-                                      & img->m_ImageData[(y-1)*img->m_Width+(x+1)]
-                                      & img->m_ImageData[(y  )*img->m_Width+(x-1)]
-                                      & img->m_ImageData[(y  )*img->m_Width+(x  )]
-                                      & img->m_ImageData[(y  )*img->m_Width+(x+1)]
-                                      & img->m_ImageData[(y+1)*img->m_Width+(x-1)]
-                                      & img->m_ImageData[(y+1)*img->m_Width+(x  )]
-                                      & img->m_ImageData[(y+1)*img->m_Width+(x+1)];
+            uint8x16x4_t src = vld4q_u8(bgra + 4*i);
+            HSVNEON16(src.val[2], src.val[1], src.val[0], hsv + 4*i);
         }
     }
 
-    memcpy(img->m_ImageData, temp_img, img->m_Width*img->m_Height);
+    BGRAtoHSVScalar(bgra + 4*i, hsv + hsv_pixel_size*i, hsv_pixel_size, pixels - i);
+}
+
+#endif
+
+// ***   Dispatch   *** //
+
+static int g_Kernel = -1;
+static YUVtoRGBFunc g_YUVtoRGB = YUVtoRGBScalar;
+static ToHSVFunc g_RGBtoHSV = RGBtoHSVScalar;
+static ToHSVFunc g_BGRAtoHSV = BGRAtoHSVScalar;
+
+static bool IsSupported(int kernel)
+{
+    switch(kernel)
+    {
+    case ImgProcess::KERNEL_SCALAR:
+        return true;
+#ifdef IMGPROC_X86
+    case ImgProcess::KERNEL_SSE41:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.1") != 0;
+    case ImgProcess::KERNEL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+#ifdef IMGPROC_NEON
+    case ImgProcess::KERNEL_NEON:
+        return true;
+#endif
+    }
+    return false;
+}
+
+static void SelectKernel()
+{
+    if(g_Kernel >= 0)
+        return;
+
+    if(ImgProcess::SetKernel(ImgProcess::KERNEL_AVX2) == false
+        && ImgProcess::SetKernel(ImgProcess::KERNEL_SSE41) == false
+        && ImgProcess::SetKernel(ImgProcess::KERNEL_NEON) == false)
+        ImgProcess::SetKernel(ImgProcess::KERNEL_SCALAR);
+}
+
+int ImgProcess::GetKernel()
+{
+    SelectKernel();
+    return g_Kernel;
+}
+
+bool ImgProcess::SetKernel(int kernel)
+{
+    if(IsSupported(kernel) == false)
+        return false;
+
+    g_YUVtoRGB = YUVtoRGBScalar;
+    g_RGBtoHSV = RGBtoHSVScalar;
+    g_BGRAtoHSV = BGRAtoHSVScalar;
+#ifdef IMGPROC_X86
+    if(kernel == KERNEL_SSE41)
+    {
+        g_YUVtoRGB = YUVtoRGBSSE41;
+        g_RGBtoHSV = RGBtoHSVSSE41;
+        g_BGRAtoHSV = BGRAtoHSVSSE41;
+    }
+    else if(kernel == KERNEL_AVX2)
+    {
+        g_YUVtoRGB = YUVtoRGBAVX2;
+        g_RGBtoHSV = RGBtoHSVAVX2;
+        g_BGRAtoHSV = BGRAtoHSVAVX2;
+    }
+#endif
+#ifdef IMGPROC_NEON
+    if(kernel == KERNEL_NEON)
+    {
+        g_YUVtoRGB = YUVtoRGBNEON;
+        g_RGBtoHSV = RGBtoHSVNEON;
+        g_BGRAtoHSV = BGRAtoHSVNEON;
+    }
+#endif
+    g_Kernel = kernel;
+
+    return true;
+}
 
-    delete[] temp_img;
+void ImgProcess::YUVtoRGB(FrameBuffer *buf)
+{
+    SelectKernel();
+    g_YUVtoRGB(buf->m_YUVFrame->m_ImageData, buf->m_RGBFrame->m_ImageData,
+               buf->m_YUVFrame->m_Width*buf->m_YUVFrame->m_Height);
+}
+
+void ImgProcess::RGBtoHSV(FrameBuffer *buf)
+{
+    SelectKernel();
+    g_RGBtoHSV(buf->m_RGBFrame->m_ImageData, buf->m_HSVFrame->m_ImageData, buf->m_HSVFrame->m_PixelSize,
+               buf->m_RGBFrame->m_Width*buf->m_RGBFrame->m_Height);
+}
+
+void ImgProcess::Erosion(Image* img)
+{
+    Erosion(img, 3);
 }
 
 void ImgProcess::Erosion(Image* src, Image* dest)
@@ -157,30 +649,7 @@ void ImgProcess::Erosion(Image* src, Image* dest)
 
 void ImgProcess::Dilation(Image* img)
 {
-    int x, y;
-
-    unsigned char* temp_img = new unsigned char[img->m_Width*img->m_Height];
-    memset(temp_img, 0, img->m_Width*img->m_Height);
-
-    for( y=1; y<(img->m_Height-1); y++ )
-    {
-        for( x=1; x<(img->m_Width-1); x++ )
-        {
-            temp_img[y*img->m_Width+x]= img->m_ImageData[(y-1)*img->m_Width+(x-1)]
-                                      | img->m_ImageData[(y-1)*img->m_Width+(x  )]
-                                      | img->m_ImageData[(y-1)*img->m_Width+(x+1)]
-                                      | img->m_ImageData[(y  )*img->m_Width+(x-1)]
-                                      | img->m_ImageData[(y  )*img->m_Width+(x  )]
-                                      | img->m_ImageData[(y  )*img->m_Width+(x+1)]
-                                      | img->m_ImageData[(y+1)*img->m_Width+(x-1)]
-                                      | img->m_ImageData[(y+1)*img->m_Width+(x  )]
-                                      | img->m_ImageData[(y+1)*img->m_Width+(x+1)];
-        }
-    }
-
-    memcpy(img->m_ImageData, temp_img, img->m_Width*img->m_Height);
-
-    delete[] temp_img;
+    Dilation(img, 3);
 }
 
 
@@ -208,6 +677,336 @@ void ImgProcess::Dilation(Image* src, Image* dest)
     }
 }
 
+// ***   Binary masks, 64 pixels per word   *** //
+
+static const unsigned long long LOW_BITS = 0x0101010101010101ULL;
+static const unsigned long long HIGH_BITS = 0x7F7F7F7F7F7F7F7FULL;
+
+#ifdef IMGPROC_X86
+
+// 16 pixels per iteration, the pixels done are returned. A block of 16 never straddles two words.
+TARGET_SSE41 static int PackMaskSSE41(const unsigned char *mask, unsigned long long *bits, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+
+    for(; x + 16 <= width; x += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&mask[x]);
+        unsigned long long set = (unsigned int)~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xFFFF;
+        bits[x >> 6] |= set << (x & 63);
+    }
+    return x;
+}
+
+// the 16 bits to the 16 bytes, byte k keeps bit k % 8 of its byte of bits
+TARGET_SSE41 static int UnpackMaskSSE41(const unsigned long long *bits, unsigned char *mask, int width)
+{
+    const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i one = _mm_set1_epi8(1);
+    int x = 0;
+
+    for(; x + 16 <= width; x += 16)
+    {
+        int set = (int)((bits[x >> 6] >> (x & 63)) & 0xFFFF);
+        __m128i v = _mm_and_si128(_mm_shuffle_epi8(_mm_cvtsi32_si128(set), spread), bit);
+        _mm_storeu_si128((__m128i *)&mask[x], _mm_and_si128(_mm_cmpeq_epi8(v, bit), one));
+    }
+    return x;
+}
+
+#endif
+
+void ImgProcess::PackMask(const unsigned char *mask, unsigned long long *bits, int width)
+{
+    int x = 0;
+
+    for(int i = 0; i < GetMaskWords(width); i++)
+        bits[i] = 0;
+
+#ifdef IMGPROC_X86
+    if(GetKernel() != KERNEL_SCALAR)
+        x = PackMaskSSE41(mask, bits, width);
+#endif
+
+    // 8 bytes at a time (little endian): 1 in each byte not 0, then the 8 bytes to 8 bits
+    for(; x + 8 <= width; x += 8)
+    {
+        unsigned long long v;
+        memcpy(&v, &mask[x], 8);
+        v = ((((v & HIGH_BITS) + HIGH_BITS) | v) >> 7) & LOW_BITS;
+        bits[x >> 6] |= ((v * 0x0102040810204080ULL) >> 56) << (x & 63);
+    }
+    for(; x < width; x++)
+    {
+        if(mask[x] != 0)
+            bits[x >> 6] |= 1ULL << (x & 63);
+    }
+}
+
+void ImgProcess::UnpackMask(const unsigned long long *bits, unsigned char *mask, int width)
+{
+    int x = 0;
+
+#ifdef IMGPROC_X86
+    if(GetKernel() != KERNEL_SCALAR)
+        x = UnpackMaskSSE41(bits, mask, width);
+#endif
+
+    // the byte repeated 8 times, byte k keeps bit k, then 1 in each byte not 0
+    for(; x + 8 <= width; x += 8)
+    {
+        unsigned long long v = (bits[x >> 6] >> (x & 63)) & 0xFF;
+        v = ((((v * LOW_BITS) & 0x8040201008040201ULL) + HIGH_BITS) >> 7) & LOW_BITS;
+        memcpy(&mask[x], &v, 8);
+    }
+    for(; x < width; x++)
+        mask[x] = (unsigned char)((bits[x >> 6] >> (x & 63)) & 1);
+}
+
+// bit x becomes the AND (or OR) of the bits x and x + shift, the bits past the row are 0
+static void GatherRow(unsigned long long *bits, int words, int shift, bool erosion)
+{
+    int q = shift >> 6, b = shift & 63;
+
+    for(int i = 0; i < words; i++)
+    {
+        unsigned long long low = (i + q < words) ? bits[i + q] : 0;
+        unsigned long long high = (i + q + 1 < words) ? bits[i + q + 1] : 0;
+        unsigned long long shifted = (b == 0) ? low : ((low >> b) | (high << (64 - b)));
+
+        bits[i] = erosion ? (bits[i] & shifted) : (bits[i] | shifted);
+    }
+}
+
+// bit x becomes the bit x - shift
+static void ShiftRowUp(unsigned long long *bits, int words, int shift)
+{
+    int q = shift >> 6, b = shift & 63;
+
+    for(int i = words - 1; i >= 0; i--)
+    {
+        unsigned long long high = (i - q >= 0) ? bits[i - q] : 0;
+        unsigned long long low = (i - q - 1 >= 0) ? bits[i - q - 1] : 0;
+
+        bits[i] = (b == 0) ? high : ((high << b) | (low >> (64 - b)));
+    }
+}
+
+// bits from to to - 1 become 0
+static void ClearBits(unsigned long long *bits, int from, int to)
+{
+    for(int x = from; x < to; )
+    {
+        int n = 64 - (x & 63);
+        if(n > to - x)
+            n = to - x;
+        bits[x >> 6] &= ~(((n == 64) ? ~0ULL : (1ULL << n) - 1) << (x & 63));
+        x += n;
+    }
+}
+
+// bit x of cur becomes the AND (or OR) of the bits x - radius to x + radius,
+// prev and next are the words before and after it
+static inline unsigned long long Window(unsigned long long prev, unsigned long long cur, unsigned long long next, int radius, bool erosion)
+{
+    unsigned long long v = cur;
+
+    // the 3x3 of ColorFinder without the loop
+    if(radius == 1)
+    {
+        unsigned long long right = (cur >> 1) | (next << 63), left = (cur << 1) | (prev >> 63);
+        return erosion ? (v & right & left) : (v | right | left);
+    }
+
+    for(int k = 1; k <= radius; k++)
+    {
+        unsigned long long right = (cur >> k) | (next << (64 - k)), left = (cur << k) | (prev >> (64 - k));
+        v = erosion ? (v & right & left) : (v | right | left);
+    }
+    return v;
+}
+
+// Windows up to 127 pixels: the bits x - radius to x + radius of a word are in the word
+// and its two neighbours, read before they are written so that src may be dest
+static void MorphologyRowNear(const unsigned long long *src, unsigned long long *dest, int width, int radius, bool erosion)
+{
+    int words = ImgProcess::GetMaskWords(width);
+    unsigned long long last = (width & 63) ? (1ULL << (width & 63)) - 1 : ~0ULL;
+    unsigned long long prev = 0;
+    unsigned long long cur = (words == 1) ? (src[0] & last) : src[0];
+
+    for(int i = 0; i < words - 1; i++)
+    {
+        unsigned long long next = (i + 2 == words) ? (src[i + 1] & last) : src[i + 1];
+        dest[i] = Window(prev, cur, next, radius, erosion);
+        prev = cur;
+        cur = next;
+    }
+    dest[words - 1] = Window(prev, cur, 0, radius, erosion);
+
+    // only the pixels from radius to width - radius - 1 are kept
+    if(2 * radius >= width)
+    {
+        memset(dest, 0, words * sizeof(unsigned long long));
+        return;
+    }
+    ClearBits(dest, 0, radius);
+    ClearBits(dest, width - radius, words * 64);
+}
+
+static void MorphologyRow(const unsigned long long *src, unsigned long long *dest, int width, int size, bool erosion)
+{
+    int words = ImgProcess::GetMaskWords(width);
+    int radius = size / 2, length = 2 * radius + 1;
+
+    if(radius < 64)
+    {
+        MorphologyRowNear(src, dest, width, radius, erosion);
+        return;
+    }
+
+    if(dest != src)
+        memcpy(dest, src, words * sizeof(unsigned long long));
+    if(width & 63)
+        dest[words - 1] &= (1ULL << (width & 63)) - 1;
+
+    // bit x gathers the bits x to x + n - 1, n doubling up to the length of the window
+    for(int n = 1; n < length; )
+    {
+        int shift = (2 * n <= length) ? n : length - n;
+        GatherRow(dest, words, shift, erosion);
+        n += shift;
+    }
+    ShiftRowUp(dest, words, radius);
+
+    // only the pixels from radius to width - radius - 1 are kept
+    for(int i = 0; i < words; i++)
+    {
+        int from = radius - 64 * i, to = width - radius - 64 * i;
+        unsigned long long keep = 0;
+
+        if(from < 64 && to > 0 && from < to)
+        {
+            keep = ~0ULL;
+            if(from > 0)
+                keep &= ~0ULL << from;
+            if(to < 64)
+                keep &= (1ULL << to) - 1;
+        }
+        dest[i] &= keep;
+    }
+}
+
+// the rows into scratch, then the columns of the rows
+static void Morphology(unsigned long long *bits, unsigned long long *rows, int width, int height, int size, bool erosion)
+{
+    int words = ImgProcess::GetMaskWords(width);
+    int radius = size / 2;
+
+    for(int y = 0; y < height; y++)
+        MorphologyRow(&bits[y * words], &rows[y * words], width, size, erosion);
+
+    for(int y = 0; y < height; y++)
+    {
+        unsigned long long *dest = &bits[y * words];
+
+        if(y < radius || y >= height - radius)
+        {
+            memset(dest, 0, words * sizeof(unsigned long long));
+            continue;
+        }
+
+        const unsigned long long *src = &rows[(y - radius) * words];
+        const unsigned long long *end = &rows[(y + radius) * words];
+        for(int i = 0; i < words; i++)
+        {
+            unsigned long long v = src[i];
+            if(erosion)
+            {
+                for(const unsigned long long *row = &src[words + i]; row <= &end[i]; row += words)
+                    v &= *row;
+            }
+            else
+            {
+                for(const unsigned long long *row = &src[words + i]; row <= &end[i]; row += words)
+                    v |= *row;
+            }
+            dest[i] = v;
+        }
+    }
+}
+
+void ImgProcess::ErosionRow(const unsigned long long *src, unsigned long long *dest, int width, int size)
+{
+    MorphologyRow(src, dest, width, size, true);
+}
+
+void ImgProcess::DilationRow(const unsigned long long *src, unsigned long long *dest, int width, int size)
+{
+    MorphologyRow(src, dest, width, size, false);
+}
+
+void ImgProcess::Erosion(unsigned long long *bits, unsigned long long *scratch, int width, int height, int size)
+{
+    Morphology(bits, scratch, width, height, size, true);
+}
+
+void ImgProcess::Dilation(unsigned long long *bits, unsigned long long *scratch, int width, int height, int size)
+{
+    Morphology(bits, scratch, width, height, size, false);
+}
+
+// the packed mask, grown to the largest image and kept for the next frames
+// a call made while another one uses it packs into its own
+static unsigned long long *g_MorphologyBits = 0;
+static int g_MorphologyWords = 0;
+static volatile int g_MorphologyBusy = 0;
+
+static void Morphology(Image *img, int size, bool erosion)
+{
+    int words = ImgProcess::GetMaskWords(img->m_Width);
+    unsigned long long *bits;
+    bool shared = __sync_lock_test_and_set(&g_MorphologyBusy, 1) == 0;
+
+    if(shared == false)
+        bits = new unsigned long long[2 * words * img->m_Height];
+    else
+    {
+        if(g_MorphologyWords < 2 * words * img->m_Height)
+        {
+            delete[] g_MorphologyBits;
+            g_MorphologyWords = 2 * words * img->m_Height;
+            g_MorphologyBits = new unsigned long long[g_MorphologyWords];
+        }
+        bits = g_MorphologyBits;
+    }
+
+    for(int y = 0; y < img->m_Height; y++)
+        ImgProcess::PackMask(&img->m_ImageData[y * img->m_Width], &bits[y * words], img->m_Width);
+
+    Morphology(bits, &bits[words * img->m_Height], img->m_Width, img->m_Height, size, erosion);
+
+    for(int y = 0; y < img->m_Height; y++)
+        ImgProcess::UnpackMask(&bits[y * words], &img->m_ImageData[y * img->m_Width], img->m_Width);
+
+    if(shared == true)
+        __sync_lock_release(&g_MorphologyBusy);
+    else
+        delete[] bits;
+}
+
+void ImgProcess::Erosion(Image* img, int size)
+{
+    Morphology(img, size, true);
+}
+
+void ImgProcess::Dilation(Image* img, int size)
+{
+    Morphology(img, size, false);
+}
+
 void ImgProcess::HFlipYUV(Image* img)
 {
     int sizeline = img->m_Width * 2; /* 2 bytes per pixel*/
@@ -246,57 +1045,14 @@ void ImgProcess::VFlipYUV(Image* img)
 
 void ImgProcess::BGRAtoHSV(FrameBuffer *buf)
 {
-    int ir, ig, ib, imin, imax;
-    int th, ts, tv, diffvmin;
-
-    for(int i = 0; i < buf->m_BGRAFrame->m_Width*buf->m_BGRAFrame->m_Height; i++)
-    {
-        ib = buf->m_BGRAFrame->m_ImageData[4*i+0];
-        ig = buf->m_BGRAFrame->m_ImageData[4*i+1];
-        ir = buf->m_BGRAFrame->m_ImageData[4*i+2];
-
-        if( ir > ig )
-        {
-            imax = ir;
-            imin = ig;
-        }
-        else
-        {
-            imax = ig;
-            imin = ir;
-        }
-
-        if( imax > ib ) {
-            if( imin > ib ) imin = ib;
-        } else imax = ib;
-
-        tv = imax;
-        diffvmin = imax - imin;
-
-        if( (tv!=0) && (diffvmin!=0) )
-        {
-            ts = (255* diffvmin) / imax;
-            if( tv == ir ) th = (ig-ib)*60/diffvmin;
-            else if( tv == ig ) th = 120 + (ib-ir)*60/diffvmin;
-            else th = 240 + (ir-ig)*60/diffvmin;
-            if( th < 0 ) th += 360;
-            th &= 0x0000FFFF;
-        }
-        else
-        {
-            tv = 0;
-            ts = 0;
-            th = 0xFFFF;
-        }
-
-        ts = ts * 100 / 255;
-        tv = tv * 100 / 255;
-
-        //buf->m_HSVFrame->m_ImageData[i]= (unsigned int)th | ((unsigned int)ts<<16) | ((unsigned int)tv<<24);
-        buf->m_HSVFrame->m_ImageData[i*buf->m_HSVFrame->m_PixelSize+0] = (unsigned char)(th >> 8);
-        buf->m_HSVFrame->m_ImageData[i*buf->m_HSVFrame->m_PixelSize+1] = (unsigned char)(th & 0xFF);
-        buf->m_HSVFrame->m_ImageData[i*buf->m_HSVFrame->m_PixelSize+2] = (unsigned char)(ts & 0xFF);
-        buf->m_HSVFrame->m_ImageData[i*buf->m_HSVFrame->m_PixelSize+3] = (unsigned char)(tv & 0xFF);
-    }
+    SelectKernel();
+    g_BGRAtoHSV(buf->m_BGRAFrame->m_ImageData, buf->m_HSVFrame->m_ImageData, buf->m_HSVFrame->m_PixelSize,
+                buf->m_BGRAFrame->m_Width*buf->m_BGRAFrame->m_Height);
+}
+
+void ImgProcess::BGRAtoHSV(const unsigned char *bgra, unsigned char *hsv, int pixels)
+{
+    SelectKernel();
+    g_BGRAtoHSV(bgra, hsv, Image::HSV_PIXEL_SIZE, pixels);
 }
 
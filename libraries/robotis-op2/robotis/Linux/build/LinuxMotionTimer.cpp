@@ -0,0 +1,243 @@
+/*
+ *   LinuxMotionTimer.cpp
+ *
+ *   Author: ROBOTIS
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "MotionModule.h"
+#include "LinuxMotionTimer.h"
+
+using namespace Robot;
+
+static void AddNanoseconds(struct timespec *time, long long ns)
+{
+  long long nsec = time->tv_nsec + ns;
+  time->tv_sec += nsec / 1000000000;
+  time->tv_nsec = nsec % 1000000000;
+}
+
+static long long DiffNanoseconds(const struct timespec *end, const struct timespec *start)
+{
+  return (end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec);
+}
+
+static void AddToHistogram(unsigned long *bins, long value_us, int bin_us)
+{
+  int bin = (value_us < 0) ? 0 : value_us / bin_us;
+  if(bin >= LinuxMotionTimerStats::NUMBER_OF_BINS)
+    bin = LinuxMotionTimerStats::NUMBER_OF_BINS - 1;
+  bins[bin]++;
+}
+
+
+LinuxMotionTimerStats::LinuxMotionTimerStats()
+{
+  Reset();
+}
+
+void LinuxMotionTimerStats::Reset()
+{
+  ticks = 0;
+  overruns = 0;
+  missed = 0;
+  max_latency_us = 0;
+  max_process_us = 0;
+  for(int i = 0; i < NUMBER_OF_BINS; i++)
+  {
+    latency[i] = 0;
+    process[i] = 0;
+  }
+}
+
+void LinuxMotionTimerStats::Print(FILE *stream)
+{
+  fprintf(stream, "ticks: %lu, overruns: %lu, missed deadlines: %lu\n", ticks, overruns, missed);
+
+  fprintf(stream, "wake-up latency (max %ld us)\n", max_latency_us);
+  for(int i = 0; i < NUMBER_OF_BINS; i++)
+  {
+    if(latency[i] != 0)
+      fprintf(stream, "  %s%5d us: %lu\n", (i == NUMBER_OF_BINS - 1) ? ">=" : "< ",
+              (i == NUMBER_OF_BINS - 1) ? i * LATENCY_BIN_US : (i + 1) * LATENCY_BIN_US, latency[i]);
+  }
+
+  fprintf(stream, "process duration (max %ld us)\n", max_process_us);
+  for(int i = 0; i < NUMBER_OF_BINS; i++)
+  {
+    if(process[i] != 0)
+      fprintf(stream, "  %s%5d us: %lu\n", (i == NUMBER_OF_BINS - 1) ? ">=" : "< ",
+              (i == NUMBER_OF_BINS - 1) ? i * PROCESS_BIN_US : (i + 1) * PROCESS_BIN_US, process[i]);
+  }
+}
+
+
+LinuxMotionTimer::LinuxMotionTimer(MotionManager* manager)
+  : m_Manager(manager)
+{
+  this->m_Interval_ns = MotionModule::TIME_UNIT * 1000000;
+  this->m_FinishTimer = false;
+  this->m_TimerRunning = false;
+
+  this->m_Priority = 31;
+  this->m_CPU = -1;
+  this->m_LockMemory = false;
+
+  // the timer thread must not wait behind a low priority reader of the statistics
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+  pthread_mutex_init(&this->m_StatsMutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+void *LinuxMotionTimer::TimerProc(void *param)
+{
+  LinuxMotionTimer *timer = (LinuxMotionTimer *)param;
+  struct timespec next_time, wake_time, done_time;
+  long long interval = timer->m_Interval_ns;
+
+  clock_gettime(CLOCK_MONOTONIC, &next_time);
+
+  while(!timer->m_FinishTimer)
+  {
+    // sleep to an absolute deadline so that the period does not drift
+    AddNanoseconds(&next_time, interval);
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL) == EINTR)
+      ;
+
+    clock_gettime(CLOCK_MONOTONIC, &wake_time);
+    if(timer->m_Manager != NULL)
+      timer->m_Manager->Process();
+    clock_gettime(CLOCK_MONOTONIC, &done_time);
+
+    long latency_us = DiffNanoseconds(&wake_time, &next_time) / 1000;
+    long process_us = DiffNanoseconds(&done_time, &wake_time) / 1000;
+
+    // an overrun skips the deadlines already gone instead of running them back to back
+    long long late = DiffNanoseconds(&done_time, &next_time);
+    unsigned long missed = 0;
+    if(late >= interval)
+    {
+      missed = late / interval;
+      AddNanoseconds(&next_time, missed * interval);
+    }
+
+    pthread_mutex_lock(&timer->m_StatsMutex);
+    LinuxMotionTimerStats &stats = timer->m_Stats;
+    stats.ticks++;
+    if(missed > 0)
+    {
+      stats.overruns++;
+      stats.missed += missed;
+    }
+    if(latency_us > stats.max_latency_us)
+      stats.max_latency_us = latency_us;
+    if(process_us > stats.max_process_us)
+      stats.max_process_us = process_us;
+    AddToHistogram(stats.latency, latency_us, LinuxMotionTimerStats::LATENCY_BIN_US);
+    AddToHistogram(stats.process, process_us, LinuxMotionTimerStats::PROCESS_BIN_US);
+    pthread_mutex_unlock(&timer->m_StatsMutex);
+  }
+
+  pthread_exit(NULL);
+}
+
+void LinuxMotionTimer::Start(void)
+{
+  int error;
+  struct sched_param param;
+  pthread_attr_t attr;
+
+  if(this->m_TimerRunning)
+    return;
+
+  if(this->m_LockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    fprintf(stderr, "LinuxMotionTimer: mlockall failed (%s)\n", strerror(errno));
+
+  pthread_attr_init(&attr);
+
+  if(this->m_Priority > 0)
+  {
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = this->m_Priority;
+    pthread_attr_setschedparam(&attr, &param);
+  }
+
+  if(this->m_CPU >= 0)
+  {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(this->m_CPU, &cpus);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+  }
+
+  // create and start the thread
+  this->m_FinishTimer = false;
+  error = pthread_create(&this->m_Thread, &attr, this->TimerProc, this);
+  if(error == EPERM && this->m_Priority > 0)
+  {
+    fprintf(stderr, "LinuxMotionTimer: no real-time rights, the timer runs with the normal scheduler\n");
+    pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+    error = pthread_create(&this->m_Thread, &attr, this->TimerProc, this);
+  }
+  pthread_attr_destroy(&attr);
+
+  if(error != 0)
+    exit(-1);
+
+  this->m_TimerRunning = true;
+}
+
+void LinuxMotionTimer::Stop()
+{
+  int error = 0;
+
+  // set the flag to end the thread
+  if(this->m_TimerRunning)
+  {
+    this->m_FinishTimer = true;
+    // wait for the thread to end
+    if((error = pthread_join(this->m_Thread, NULL)) != 0)
+      exit(-1);
+    this->m_FinishTimer = false;
+    this->m_TimerRunning = false;
+  }
+}
+
+bool LinuxMotionTimer::IsRunning()
+{
+  return this->m_TimerRunning;
+}
+
+void LinuxMotionTimer::GetStatistics(LinuxMotionTimerStats *stats)
+{
+  pthread_mutex_lock(&this->m_StatsMutex);
+  *stats = this->m_Stats;
+  pthread_mutex_unlock(&this->m_StatsMutex);
+}
+
+void LinuxMotionTimer::ResetStatistics()
+{
+  pthread_mutex_lock(&this->m_StatsMutex);
+  this->m_Stats.Reset();
+  pthread_mutex_unlock(&this->m_StatsMutex);
+}
+
+LinuxMotionTimer::~LinuxMotionTimer()
+{
+  this->Stop();
+  this->m_Manager = NULL;
+  pthread_mutex_destroy(&this->m_StatsMutex);
+}
@@ -8,6 +8,7 @@
 #ifndef _LINUX_CM730_H_
 #define _LINUX_CM730_H_
 
+#include <poll.h>
 #include <semaphore.h>
 #include "CM730.h"
 
@@ -63,6 +64,20 @@ namespace Robot
 		double GetUpdateTime();
 
 		virtual void Sleep(double msec);
+
+		// Block on the serial port instead of spinning on ReadPort
+		void WaitPort()
+		{
+			double remain = m_PacketWaitTime - GetPacketTime();
+			if(remain <= 0.0)
+				return;
+
+			struct pollfd pfd;
+			pfd.fd = m_Socket_fd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			poll(&pfd, 1, (int)remain + 1);
+		}
 		////////////////////////////////////////////////////////
 	};
 }
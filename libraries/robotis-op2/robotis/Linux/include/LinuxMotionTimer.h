@@ -9,11 +9,37 @@
 #define _LINUX_MOTION_MANAGER_H_
 
 #include <pthread.h>
+#include <stdio.h>
 #include "MotionManager.h"
 #include <time.h>
 
 namespace Robot
 {
+  // Timing of the ticks run so far, see LinuxMotionTimer::GetStatistics()
+  class LinuxMotionTimerStats
+  {
+    public:
+      enum
+      {
+        NUMBER_OF_BINS  = 64,   // the last bin also counts everything above it
+        LATENCY_BIN_US  = 10,   // wake-up latency resolution
+        PROCESS_BIN_US  = 100   // MotionManager::Process() duration resolution
+      };
+
+      unsigned long ticks;
+      unsigned long overruns;   // ticks that ended after the next deadline
+      unsigned long missed;     // deadlines skipped because of those overruns
+      long max_latency_us;
+      long max_process_us;
+      unsigned long latency[NUMBER_OF_BINS];
+      unsigned long process[NUMBER_OF_BINS];
+
+      LinuxMotionTimerStats();
+
+      void Reset();
+      void Print(FILE *stream);
+  };
+
   class LinuxMotionTimer
   {
     private:
@@ -23,6 +49,13 @@ namespace Robot
       bool m_TimerRunning;
       bool m_FinishTimer;
 
+      int m_Priority;
+      int m_CPU;
+      bool m_LockMemory;
+
+      pthread_mutex_t m_StatsMutex;
+      LinuxMotionTimerStats m_Stats;
+
     protected:
       static void *TimerProc(void *param);// thread function
 
@@ -33,6 +66,17 @@ namespace Robot
       void Start();
       void Stop();
       bool IsRunning();
+
+      // To be called before Start(). The thread runs SCHED_FIFO at the given priority
+      // (0 for the normal scheduler), on the given CPU (-1 for any) and mlockall() is
+      // called when memory locking is on. Without the rights the timer still starts.
+      void SetPriority(int priority)    { m_Priority = priority; }
+      void SetCPU(int cpu)              { m_CPU = cpu; }
+      void SetLockMemory(bool lock)     { m_LockMemory = lock; }
+
+      // Safe to call while the timer runs
+      void GetStatistics(LinuxMotionTimerStats *stats);
+      void ResetStatistics();
   };
 }
 
@@ -28,6 +28,7 @@
 namespace Robot {
   class CM730;
   class LinuxCM730;
+  class SyncWriteCache;
 }  // namespace Robot
 
 namespace webots {
@@ -62,6 +63,8 @@ namespace webots {
 
     // not member(s) of the Webots API function: please don't use
     ::Robot::CM730 *getCM730() const { return mCM730; }
+    // what step() last sent, to forget after writing a motor register directly
+    ::Robot::SyncWriteCache *getSyncWriteCache() const { return mSyncWriteCache; }
     static Robot *getInstance() { return cInstance; }
 
   private:
@@ -78,8 +81,10 @@ namespace webots {
     Keyboard *mKeyboard;
     ::Robot::LinuxCM730 *mLinuxCM730;
     ::Robot::CM730 *mCM730;
+    ::Robot::SyncWriteCache *mSyncWriteCache;
     struct timeval mStart;
     double mPreviousStepTime;
+    std::map<int, int> mAlarms;  // overload and overheating bits last logged per motor id
   };
 }  // namespace webots
 
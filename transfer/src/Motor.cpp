@@ -18,6 +18,7 @@
 #include <CM730.h>
 #include <JointData.h>
 #include <MX28.h>
+#include <SyncWriteCache.h>
 
 #include <algorithm>
 #include <cmath>
@@ -168,9 +169,11 @@ void Motor::setVelocity(double vel) {
 
 void Motor::setTorque(double torque) {
   CM730 *cm730 = Robot::getInstance()->getCM730();
-  if (torque == 0)
+  if (torque == 0) {
     cm730->WriteWord(mNamesToIDs[getName()], MX28::P_TORQUE_ENABLE, 0, 0);
-  else {
+    // the next step() sends the goal position again, even if it did not change
+    Robot::getInstance()->getSyncWriteCache()->Invalidate(mNamesToIDs[getName()]);
+  } else {
     this->setAvailableTorque(fabs(torque));
     int firm_ver = 0;
     if (cm730->ReadByte(JointData::ID_HEAD_PAN, MX28::P_VERSION, &firm_ver, 0) != CM730::SUCCESS)
@@ -197,6 +200,7 @@ void Motor::setAvailableTorque(double availableTorque) {
     mTorqueLimit = 0;
     mTorqueEnable = 0;
     cm730->WriteWord(mNamesToIDs[getName()], MX28::P_TORQUE_ENABLE, 0, 0);
+    Robot::getInstance()->getSyncWriteCache()->Invalidate(mNamesToIDs[getName()]);
   }
 
   // don't override the motor alarm
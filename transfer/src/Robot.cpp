@@ -42,7 +42,9 @@ webots::Robot::Robot() {
     exit(-1);
   }
 
+  mSyncWriteCache = new ::Robot::SyncWriteCache();
   initRobotisOp2();
+  mSyncWriteCache->SetCM730(mCM730);  // the writes of MotionManager and of the devices go past it
   initDevices();
   gettimeofday(&mStart, NULL);
   mPreviousStepTime = 0.0;
@@ -94,6 +96,7 @@ webots::Robot::Robot() {
 }
 
 webots::Robot::~Robot() {
+  delete mSyncWriteCache;
 }
 
 int webots::Robot::step(int duration) {
@@ -123,10 +126,16 @@ int webots::Robot::step(int duration) {
     motor->setPresentSpeed(mCM730->m_BulkReadData[motorId].ReadWord(::Robot::MX28::P_PRESENT_SPEED_L));
     motor->setPresentLoad(mCM730->m_BulkReadData[motorId].ReadWord(::Robot::MX28::P_PRESENT_LOAD_L));
 
-    int alarmShutdownControlTableValue = mCM730->m_BulkReadData[motorId].ReadWord(::Robot::MX28::P_ALARM_SHUTDOWN);
-    if (alarmShutdownControlTableValue != 0) {
-      cerr << "Alarm detected on id = " << motorId << " with value = " << alarmShutdownControlTableValue << endl;
-      exit(EXIT_FAILURE);
+    // the alarm bits come with every status packet, P_ALARM_SHUTDOWN is only the EEPROM mask,
+    // they are logged when they change: the servo shuts its torque down by itself
+    int error = mCM730->m_BulkReadData[motorId].error;
+    int alarm = (error > 0) ? error & (::Robot::CM730::OVERHEATING | ::Robot::CM730::OVERLOAD) : 0;
+    if (alarm != mAlarms[motorId]) {
+      if (alarm != 0)
+        cerr << "Alarm detected on id = " << motorId << " with value = " << error << endl;
+      else
+        cerr << "Alarm cleared on id = " << motorId << endl;
+      mAlarms[motorId] = alarm;
     }
   }
 
@@ -173,6 +182,8 @@ int webots::Robot::step(int duration) {
   int changed_motors = 0;
   int value;
 
+  // the enable flags are read live rather than from the last published snapshot: the managers
+  // switch them from this thread, and a joint they just handed over must be written at once
   for (motorIt = Motor::mNamesToIDs.begin(); motorIt != Motor::mNamesToIDs.end(); ++motorIt) {
     Motor *motor = static_cast<Motor *>(mDevices[(*motorIt).first]);
     int motorId = (*motorIt).second;
@@ -193,7 +204,12 @@ int webots::Robot::step(int duration) {
       changed_motors++;
     }
   }
-  mCM730->SyncWrite(::Robot::MX28::P_P_GAIN, msgLength, changed_motors, param);
+  // only the motors and registers that changed since the last step are sent
+  int startAddress = ::Robot::MX28::P_P_GAIN;
+  int eachLength = msgLength;
+  changed_motors = mSyncWriteCache->Filter(&startAddress, &eachLength, changed_motors, param);
+  if (changed_motors > 0 && mCM730->SyncWrite(startAddress, eachLength, changed_motors, param) != ::Robot::CM730::SUCCESS)
+    mSyncWriteCache->Invalidate();
 
   // -------- Keyboard Reset ----------- //
   mKeyboard->resetKeyboard();